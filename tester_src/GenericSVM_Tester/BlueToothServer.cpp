@@ -255,6 +255,7 @@ int sendNormParams()
 //KANE -- yeah this isnt auto-generated to size, i got lazy.
 
 char kernel_modelFile[10][300];
+int activeModelSlot = -1;	/* model_select of the last Kernel Data Msg sent */
 
 int sendKernelData(int model)
 {
@@ -356,6 +357,7 @@ int sendKernelData(int model)
         return -1;
 #endif
     }
+	activeModelSlot = model;
 
 	return 0;
 }
@@ -663,6 +665,42 @@ linenum++;
 
 
 
+/***************************************************************************/
+/* Hot model swap.  The new model is written into a slot the FPGA is not   */
+/* classifying with, and model_select only moves to it, together with its  */
+/* kernel parameters, once the whole model has been sent.  The FPGA loads  */
+/* every slot in one transfer, so the other slots are sent again from the  */
+/* files already in modelFile; slots never loaded get the new model too.   */
+/* With NUM_MODELS 1 there is no spare slot and slot 0 is overwritten.     */
+/***************************************************************************/
+int stageModelData(const char *modelAFile, const char *kernelFile)
+{
+	int slot, i;
+
+	slot = (activeModelSlot < 0) ? 0 : (activeModelSlot + 1) % NUM_MODELS;
+	for(i = 0; i < NUM_MODELS; i++)
+	{
+		if(i == slot || modelFile[i][0] == '\0')
+		{
+			strcpy(modelFile[i],modelAFile);
+			strcpy(kernel_modelFile[i],kernelFile);
+		}
+	}
+
+	if(sendModelData() != 0)
+	{
+		printf("ERROR staging %s in model slot %d\n",modelAFile,slot);
+		return -1;
+	}
+	if(sendKernelData(slot) != 0)
+		return -1;
+	printf("Model %s selected in slot %d\n",modelAFile,slot);
+	return slot;
+}
+
+
+
+
 int closeBTComms()
 {
 	CloseHandle(serialHandle);
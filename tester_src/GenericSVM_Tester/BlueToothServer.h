@@ -6,6 +6,7 @@
 int sendNormParams();
 int sendModelData();
 int sendKernelData(int model);
+int stageModelData(const char *modelAFile, const char *kernelFile);
 int sendRTData(float * Data);
 int setupBluetooth();
 int recvClass(unsigned short *classification, double* classificationTime);
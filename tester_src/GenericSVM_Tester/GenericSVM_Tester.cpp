@@ -17,6 +17,16 @@
 #include "svm.h"
 #include "norm_params.h"
 #include "BlueToothServer.h"
+#include "predict_cache.h"
+#include "svm_quant.h"
+#include "svm_adaptive.h"
+#include "svm_multi.h"
+#include "svm_csr.h"
+#include "svm_fixed.h"
+#include "numa_pool.h"
+#include "model_handle.h"
+#include "latency_pool.h"
+#include "svm_data.h"
 
 /* Prototypes */
 void ClearScreen (void);
@@ -27,6 +37,14 @@ void MoveCursor (int x, int y);
 struct svm_node *x;
 int max_nr_attr = NUM_FEATURES*2;	//was 64
 struct svm_model* model[NUM_MODELS+5];	//+5 is just to get the warning to go away if NUM_MODEL < 4
+struct svm_adaptive_model* adaptiveModel[NUM_MODELS+5];	//fp32 copies used when CPU_ADAPTIVE_PREDICT is set
+struct svm_csr_model* csrModel[NUM_MODELS+5];			//CSR copies used when CPU_CSR_MODEL is set
+svm_fixed_model<NUM_FEATURES,NUM_CLASS>* fixedModel[NUM_MODELS+5];	//dense fixed shape copies used when CPU_FIXED_SHAPE is set
+latencyPool* latencyPools[NUM_MODELS+5];	//per-vector thread pools used when CPU_PREDICT_THREADS is set
+long adaptivePairs = 0, adaptiveRecomputed = 0;	//decision functions evaluated / redone in double
+double *multiLabel[4];			//CPU_MULTI_MODEL: label of every test vector for FNAME_1..4
+double *multiTime;				//CPU_MULTI_MODEL: time (ms) to predict one vector with all 4 models
+int multiCount = 0;				//CPU_MULTI_MODEL: vectors in multiLabel, 0 if the pass did not run
 extern char modelFile[10][300];
 extern char kernel_modelFile[10][300];
 extern int G_CMD_SET;
@@ -105,6 +123,29 @@ int predict(char *input, int modelNum, int *prediction)
 		}
 		x[i].index = -1;
 
+#if CPU_ADAPTIVE_PREDICT
+		if(adaptiveModel[modelNum-1] != NULL)
+		{
+			int recomputed;
+			predict_label = svm_adaptive_predict(adaptiveModel[modelNum-1],x,&recomputed);
+			adaptivePairs += nr_class*(nr_class-1)/2;
+			adaptiveRecomputed += recomputed;
+		}
+		else
+#endif
+#if CPU_CSR_MODEL
+		if(csrModel[modelNum-1] != NULL)
+			predict_label = svm_csr_predict(csrModel[modelNum-1],x);
+		else
+#endif
+#if CPU_FIXED_SHAPE
+		if(fixedModel[modelNum-1] != NULL)
+			predict_label = svm_fixed_predict(fixedModel[modelNum-1],x);
+		else
+#endif
+		if(latencyPools[modelNum-1] != NULL)
+			predict_label = latencyPoolPredict(latencyPools[modelNum-1],x);
+		else
 		predict_label = svm_predict((model[modelNum-1]),x);
 		*prediction = (int)predict_label;
 
@@ -142,6 +183,402 @@ int predict(char *input, int modelNum, int *prediction)
 
 
 
+/***************************************************************************/
+/* Model loading.  With USE_BINARY_MODELS the mapped binary copy is used,  */
+/* and created from the text model the first time it is missing.           */
+/***************************************************************************/
+struct svm_model *loadModel(const char *fname)
+{
+#if USE_BINARY_MODELS
+	char binName[310];
+	struct svm_model *m;
+
+	sprintf(binName,"%s.bin",fname);
+	if((m = svm_load_model_binary(binName)) != NULL)
+		return m;
+	if((m = svm_load_model(fname)) != NULL && svm_save_model_binary(binName,m) == 0)
+		printf("Wrote binary model %s\n",binName);
+	return m;
+#else
+	return svm_load_model(fname);
+#endif
+}
+
+
+
+
+/***************************************************************************/
+/* CPU_MULTI_MODEL: predict the test file with all four models in a single */
+/* pass.  SVs shared between the models are evaluated once per vector.     */
+/***************************************************************************/
+int multiModelPass(void)
+{
+	const char *fnames[4] = {FNAME_1, FNAME_2, FNAME_3, FNAME_4};
+	struct svm_model *models[4];
+	struct svm_multi_model *mm;
+	struct svm_problem prob;
+	struct svm_node *xSpace;
+	LARGE_INTEGER ticksPerSecond,tick1,tick2;
+	int correct[4] = {0,0,0,0};
+	int m, s, total = 0;
+
+	for(m=0;m<4;m++)
+	{
+		models[m] = loadModel(fnames[m]);
+		if(models[m] == NULL)
+		{
+			printf("Error, %s could not be loaded.\n",fnames[m]);
+			while(m-- > 0) svm_free_and_destroy_model(&models[m]);
+			return -1;
+		}
+		total += models[m]->l;
+	}
+	if(readProblem(TEST_FNAME,&prob,&xSpace,NULL) != 0 ||
+	   (mm = svm_multi_create(models,4)) == NULL)
+	{
+		for(m=0;m<4;m++) svm_free_and_destroy_model(&models[m]);
+		return -1;
+	}
+
+	for(m=0;m<4;m++)
+		multiLabel[m] = (double *)malloc(prob.l*sizeof(double));
+	multiTime = (double *)malloc(prob.l*sizeof(double));
+
+	QueryPerformanceFrequency(&ticksPerSecond);
+	for(s=0;s<prob.l;s++)
+	{
+		double labels[4];
+		QueryPerformanceCounter(&tick1);
+		svm_multi_predict(mm,prob.x[s],labels);
+		QueryPerformanceCounter(&tick2);
+		multiTime[s] = (double)(tick2.QuadPart-tick1.QuadPart)/(ticksPerSecond.QuadPart/1000);
+		for(m=0;m<4;m++)
+		{
+			multiLabel[m][s] = labels[m];
+			if(labels[m] == prob.y[s]) correct[m]++;
+		}
+	}
+	multiCount = prob.l;
+
+	printf("Multi-Model Pass: %d Vectors, %d SVs (%d Unique)\n",prob.l,total,svm_multi_nr_unique_sv(mm));
+	for(m=0;m<4;m++)
+		printf("    %s: %d/%d Correct (%f%%)\n",fnames[m],correct[m],prob.l,(double)correct[m]/prob.l*100.0);
+
+	svm_multi_free(&mm);
+	for(m=0;m<4;m++)
+		svm_free_and_destroy_model(&models[m]);
+	freeProblem(&prob,xSpace);
+	return 0;
+}
+
+
+
+
+/***************************************************************************/
+/* NUMA_BENCHMARK: CPU throughput of FNAME_1 over the test file, with the  */
+/* model shared by all sockets and with one copy per NUMA node.            */
+/***************************************************************************/
+int numaBenchmark(void)
+{
+	struct svm_model *benchModel;
+	struct svm_problem prob;
+	struct svm_node *xSpace;
+	int rtnVal;
+
+	if((benchModel = loadModel(FNAME_1)) == NULL)
+	{
+		printf("Error, %s could not be loaded.\n",FNAME_1);
+		return -1;
+	}
+	if(readProblem(TEST_FNAME,&prob,&xSpace,NULL) != 0)
+	{
+		svm_free_and_destroy_model(&benchModel);
+		return -1;
+	}
+	rtnVal = numaPoolBenchmark(benchModel,prob.x,prob.l,NUMA_BENCHMARK_PASSES,stdout);
+	svm_free_and_destroy_model(&benchModel);
+	freeProblem(&prob,xSpace);
+	return rtnVal;
+}
+
+
+
+
+/***************************************************************************/
+/* HOT_SWAP_MODELS: reader threads predict the test file without pause     */
+/* while FNAME_2..4 are swapped in under them, each also staged on the     */
+/* FPGA.  Reports predictions served and the slowest single prediction.    */
+/***************************************************************************/
+typedef struct
+{
+	modelHandle *handle;
+	struct svm_problem *prob;
+	volatile LONG *quit;
+	long predictions;
+	double worstMs;
+} hotSwapReader;
+
+static DWORD WINAPI hotSwapReaderMain(LPVOID arg)
+{
+	hotSwapReader *r = (hotSwapReader *)arg;
+	LARGE_INTEGER ticksPerSecond,tick1,tick2;
+	int reader = modelHandleRegister(r->handle);
+	int s = 0;
+
+	if(reader < 0)
+		return 1;
+	QueryPerformanceFrequency(&ticksPerSecond);
+	while(!*r->quit)
+	{
+		const struct svm_model *current;
+		double ms;
+
+		QueryPerformanceCounter(&tick1);
+		current = modelHandleAcquire(r->handle,reader);
+		svm_predict(current,r->prob->x[s]);
+		modelHandleRelease(r->handle,reader);
+		QueryPerformanceCounter(&tick2);
+		ms = (double)(tick2.QuadPart-tick1.QuadPart)/(ticksPerSecond.QuadPart/1000);
+		if(ms > r->worstMs) r->worstMs = ms;
+		r->predictions++;
+		if(++s == r->prob->l) s = 0;
+	}
+	return 0;
+}
+
+int hotSwapPass(void)
+{
+	const char *fnames[4] = {FNAME_1, FNAME_2, FNAME_3, FNAME_4};
+	const char *aFnames[4] = {MODEL_FNAME_1A, MODEL_FNAME_2A, MODEL_FNAME_3A, MODEL_FNAME_4A};
+	hotSwapReader readers[HOT_SWAP_READERS];
+	HANDLE threads[HOT_SWAP_READERS];
+	struct svm_model *next;
+	struct svm_problem prob;
+	struct svm_node *xSpace;
+	modelHandle *handle;
+	volatile LONG quit = 0;
+	long total = 0;
+	double worstMs = 0.0;
+	int m, t, pending = 0;
+
+	if((next = loadModel(fnames[0])) == NULL)
+	{
+		printf("Error, %s could not be loaded.\n",fnames[0]);
+		return -1;
+	}
+	if(readProblem(TEST_FNAME,&prob,&xSpace,NULL) != 0 ||
+	   (handle = modelHandleCreate(next,HOT_SWAP_READERS)) == NULL)
+	{
+		svm_free_and_destroy_model(&next);
+		return -1;
+	}
+	stageModelData(aFnames[0],fnames[0]);
+
+	for(t=0;t<HOT_SWAP_READERS;t++)
+	{
+		readers[t].handle = handle;
+		readers[t].prob = &prob;
+		readers[t].quit = &quit;
+		readers[t].predictions = 0;
+		readers[t].worstMs = 0.0;
+		threads[t] = CreateThread(NULL,0,hotSwapReaderMain,&readers[t],0,NULL);
+		if(threads[t] == NULL)
+		{
+			printf("Error starting hot swap reader %d of %d, skipping the hot swap pass.\n",t,HOT_SWAP_READERS);
+			InterlockedExchange(&quit,1);
+			while(t-- > 0)
+			{
+				WaitForSingleObject(threads[t],INFINITE);
+				CloseHandle(threads[t]);
+			}
+			modelHandleDestroy(handle);
+			freeProblem(&prob,xSpace);
+			return -1;
+		}
+	}
+
+	for(m=1;m<4;m++)
+	{
+		Sleep(HOT_SWAP_INTERVAL_MS);
+		if((next = loadModel(fnames[m])) == NULL)
+		{
+			printf("Error, %s could not be loaded, keeping the current model.\n",fnames[m]);
+			continue;
+		}
+		pending = modelHandleSwap(handle,next);
+		stageModelData(aFnames[m],fnames[m]);
+		printf("Hot Swap %ld: %s (%d retired models still in use)\n",modelHandleVersion(handle),fnames[m],pending);
+	}
+	Sleep(HOT_SWAP_INTERVAL_MS);
+
+	InterlockedExchange(&quit,1);
+	for(t=0;t<HOT_SWAP_READERS;t++)
+	{
+		WaitForSingleObject(threads[t],INFINITE);
+		CloseHandle(threads[t]);
+		total += readers[t].predictions;
+		if(readers[t].worstMs > worstMs) worstMs = readers[t].worstMs;
+	}
+	printf("Hot Swap Pass: %d Readers, %ld Predictions, Slowest Prediction %f ms\n",HOT_SWAP_READERS,total,worstMs);
+
+	modelHandleDestroy(handle);
+	freeProblem(&prob,xSpace);
+	return 0;
+}
+
+
+
+
+/***************************************************************************/
+/* CPU cache key: the values predict() parses from a test line, placed by  */
+/* feature index with 0 where a feature is absent, as svm_predict treats   */
+/* it.  Returns -1 for an index outside 1..NUM_FEATURES, the line is then  */
+/* predicted without the cache.                                            */
+/***************************************************************************/
+int cpuCacheKey(const char *line, double *key)
+{
+	const char *p;
+	char *endptr;
+	int k, index;
+
+	for(k=0;k<NUM_FEATURES;k++)
+		key[k] = 0.0;
+	strtod(line,&endptr);		/* target label */
+	p = endptr;
+	while(1)
+	{
+		while(isspace((unsigned char)*p))
+			p++;
+		if(*p == '\0')
+			return 0;
+		index = (int)strtol(p,&endptr,10);
+		if(endptr == p || *endptr != ':' || index < 1 || index > NUM_FEATURES)
+			return -1;
+		key[index-1] = strtod(endptr+1,&endptr);
+		p = endptr;
+	}
+}
+
+
+
+
+/***************************************************************************/
+/* Memoized CPU / FPGA predictions.  A NULL cache, or a NULL CPU key, goes */
+/* straight through.  hit is set when the result came from the cache, the  */
+/* time measured for it is then not a prediction time.                     */
+/***************************************************************************/
+int cachedPredict(predictCache *cache, char *input, int modelNum, const double *features,
+				  double target_label, int *prediction, int *hit)
+{
+	double unused;
+	int lookup = PCACHE_BYPASS;
+	int rtnVal;
+
+	if(cache != NULL && features != NULL)
+		lookup = pcacheLookupDouble(cache,features,prediction,&unused);
+	*hit = (lookup == PCACHE_HIT);
+	if(lookup == PCACHE_HIT)
+		return (*prediction == target_label) ? TRUE : FALSE;
+
+	rtnVal = predict(input,modelNum,prediction);
+	if(lookup == PCACHE_MISS)
+		pcacheFillDouble(cache,features,*prediction,0.0);
+
+	return rtnVal;
+}
+
+int cachedFPGAPredict(predictCache *cache, float *features, unsigned short *classification,
+					  double *classificationTime, int *hit)
+{
+	int label;
+	int lookup = PCACHE_BYPASS;
+
+	if(cache != NULL)
+		lookup = pcacheLookup(cache,features,&label,classificationTime);
+	*hit = (lookup == PCACHE_HIT);
+	if(lookup == PCACHE_HIT)
+	{
+		/* Nothing was sent, so there is no FPGA evaluation time to report */
+		*classification = (unsigned short)label;
+		*classificationTime = 0.0;
+		return 0;
+	}
+
+	sendRTData(features);
+	if(recvClass(classification,classificationTime) != 0)
+	{
+		if(lookup == PCACHE_MISS)
+			pcacheAbandon(cache,features);
+		return -1;
+	}
+	if(lookup == PCACHE_MISS)
+		pcacheFill(cache,features,*classification,*classificationTime);
+
+	return 0;
+}
+
+/* uncachedMs is the summed time of the uncached predictions, hits are left out of the mean */
+void printCacheStats(FILE *out, const char *name, predictCache *cache, double uncachedMs, int uncached)
+{
+	predictCacheStats stats;
+
+	if(cache == NULL)
+		return;
+	pcacheGetStats(cache,&stats);
+	fprintf(out,"%s Cache: %lu Hits %lu Lookups (%f%%), %lu Coalesced, %lu Evictions, %lu Bypassed, "
+			"Mean Uncached Time %f ms over %d Predictions\n",
+			name,stats.hits,stats.lookups,pcacheHitRate(&stats)*100.0,
+			stats.coalesced,stats.evictions,stats.bypassed,
+			uncached > 0 ? uncachedMs/uncached : 0.0,uncached);
+}
+
+void printAdaptiveStats(FILE *out)
+{
+	if(adaptivePairs == 0)
+		return;
+	fprintf(out,"Adaptive CPU Predict: %ld of %ld Decision Functions Recomputed in Double (%f%%)\n",
+			adaptiveRecomputed,adaptivePairs,(double)adaptiveRecomputed/adaptivePairs*100.0);
+}
+
+void printMultiStats(FILE *out, int matches, int attempted)
+{
+	if(attempted == 0)
+		return;
+	fprintf(out,"Multi-Model Pass: %d/%d Labels Match the CPU Prediction (%f%%)\n",
+			matches,attempted,(double)matches/attempted*100.0);
+}
+
+/* Bytes held by the double precision libsvm model (coefficients and SV nodes) */
+unsigned long doubleModelBytes(const struct svm_model *m)
+{
+	unsigned long bytes = (unsigned long)m->l*(m->nr_class-1)*sizeof(double);
+	const struct svm_node *p;
+	int k;
+
+	for(k=0;k<m->l;k++)
+	{
+		for(p=m->SV[k];p->index != -1;p++)
+			bytes += sizeof(struct svm_node);
+		bytes += sizeof(struct svm_node);
+	}
+	return bytes;
+}
+
+void printQuantStats(FILE *out, struct svm_quantized_model *qmodel, struct svm_model *model,
+					 int matchCPU, int matchFPGA, int attempted)
+{
+	if(qmodel == NULL || attempted == 0)
+		return;
+	fprintf(out,"%s SV/%s Coef Model (%lu bytes, double %lu bytes): CPU Matches %d/%d (%f%%), FPGA Matches %d/%d (%f%%)\n",
+			svm_store_format_name(CPU_MODEL_STORAGE),svm_store_format_name(CPU_COEF_STORAGE),
+			(unsigned long)svm_quantized_model_bytes(qmodel),doubleModelBytes(model),
+			matchCPU,attempted,(double)matchCPU/attempted*100.0,
+			matchFPGA,attempted,(double)matchFPGA/attempted*100.0);
+}
+
+
+
+
 int main(int argc, char **argv)
 {
 	FILE *output, *testFile,*summary_outf;	//Output used for datalog; testFile used for test vector input
@@ -156,6 +593,8 @@ int main(int argc, char **argv)
 
 	//Feature Storage
 	static float Feature_Data[NUM_FEATURES];
+	static double CPU_Key[NUM_FEATURES];	//CPU cache key, the doubles svm_predict is given
+	int cpuKeyed;
 
 	//Prediction variables
 	int testnum,numFail;
@@ -164,25 +603,56 @@ int main(int argc, char **argv)
     int current_prediction=0;				//Current CPU Prediction
 	unsigned short FPGA_Prediction = 0xff;	//Current FPGA Prediction
 	int numMatch = 0;						//Number of predicitons that FPGA and CPU match for
+	int multiMatch = 0, multiAttempted = 0;	//CPU_MULTI_MODEL labels that match the CPU prediction
+	int cpuHit, fpgaHit;					//Prediction answered by the memo cache
 	int run = 1;
 
 	//Log Information
 	int DataLogging=FALSE, LogSize=0, FirstPass = FALSE;
 	static double Log_Channel_1_Data[300000],Log_Channel_2_Data[300000],
 		Log_Channel_3_Data[300000],Log_Channel_4_Data[300000],
-		Log_Channel_5_Data[300000],Log_Channel_6_Data[300000];
+		Log_Channel_5_Data[300000],Log_Channel_6_Data[300000],
+		Log_Channel_7_Data[300000],Log_Channel_8_Data[300000];
 
 	//Timing Info
 	LARGE_INTEGER ticksPerSecond,tick1,tick2;
 	double PredictionTime=0.0, FPGA_Prediction_Time=0.0;
+	double MultiModelTime=0.0;				//CPU_MULTI_MODEL pass time for all 4 models, 0 without it
+	double cpuUncachedMs=0.0, fpgaUncachedMs=0.0;	//Summed times of the predictions the caches missed
+	int cpuUncached=0, fpgaUncached=0;
+
+	//Prediction memo caches (NULL when PREDICT_CACHE_ENTRIES is 0)
+	predictCache *cpuCache = pcacheCreateDouble(PREDICT_CACHE_ENTRIES,NUM_FEATURES,PREDICT_CACHE_QUANT_BITS);
+	predictCache *fpgaCache = pcacheCreate(PREDICT_CACHE_ENTRIES,NUM_FEATURES,PREDICT_CACHE_QUANT_BITS);
+	double target_label;
+
+	//Reduced precision copy of the model (NULL when CPU_MODEL_STORAGE is SVM_STORE_DOUBLE)
+	struct svm_quantized_model *qmodel = NULL;
+	int quant_prediction;
+	int quantMatchCPU = 0, quantMatchFPGA = 0;
 
 	//Take over the OS for better performance
 	SetPriorityClass (GetCurrentProcess(),REALTIME_PRIORITY_CLASS);
 	SetThreadPriority (GetCurrentThread(),THREAD_PRIORITY_TIME_CRITICAL);
 
+#if MODEL_HUGE_PAGES
+	if(svm_set_huge_pages(TRUE) != 0)
+		printf("Large pages not available (needs the Lock Pages in Memory right), using normal pages\n");
+#endif
+
 	// Perform Bluetooth Initialization
 	setupBluetooth();
 
+#if CPU_MULTI_MODEL
+	multiModelPass();
+#endif
+#if NUMA_BENCHMARK
+	numaBenchmark();
+#endif
+#if HOT_SWAP_MODELS
+	hotSwapPass();
+#endif
+
 	//Perform Model Loading for LibSVM -- This is HARD-CODED
 	for(iter=0;iter<4;iter++)
 	{
@@ -192,6 +662,8 @@ int main(int argc, char **argv)
 		current_prediction=0;				//Current CPU Prediction
 		FPGA_Prediction = 0xff;				//Current FPGA Prediction
 		numMatch = 0;
+		quantMatchCPU = 0;
+		quantMatchFPGA = 0;
 		DataLogging=FALSE;
 		LogSize=0;
 		FirstPass = FALSE;
@@ -204,7 +676,7 @@ int main(int argc, char **argv)
 		if(iter==0)
 		{
 			printf("Model %s Selected.\n",FNAME_1);
-			model[0] = svm_load_model(FNAME_1);
+			model[0] = loadModel(FNAME_1);
 			strcpy(outputFilename,FNAME_1);
 			strcpy(modelFile[0],MODEL_FNAME_1A);
 			strcpy(kernel_modelFile[0],FNAME_1);
@@ -212,7 +684,7 @@ int main(int argc, char **argv)
 		else if(iter==1)
 		{
 			printf("Model %s Selected.\n",FNAME_2);
-			model[0] = svm_load_model(FNAME_2);
+			model[0] = loadModel(FNAME_2);
 			strcpy(outputFilename,FNAME_2);
 			strcpy(modelFile[0],MODEL_FNAME_2A);
 			strcpy(kernel_modelFile[0],FNAME_2);
@@ -220,7 +692,7 @@ int main(int argc, char **argv)
 		else if(iter==2)
 		{
 			printf("Model %s Selected.\n",FNAME_3);
-			model[0] = svm_load_model(FNAME_3);
+			model[0] = loadModel(FNAME_3);
 			strcpy(outputFilename,FNAME_3);
 			strcpy(modelFile[0],MODEL_FNAME_3A);
 			strcpy(kernel_modelFile[0],FNAME_3);
@@ -228,7 +700,7 @@ int main(int argc, char **argv)
 		else if(iter==3)
 		{
 			printf("Model %s Selected.\n",FNAME_4);
-			model[0] = svm_load_model(FNAME_4);
+			model[0] = loadModel(FNAME_4);
 			strcpy(outputFilename,FNAME_4);
 			strcpy(modelFile[0],MODEL_FNAME_4A);
 			strcpy(kernel_modelFile[0],FNAME_4);
@@ -238,6 +710,34 @@ int main(int argc, char **argv)
 			printf("Error, shouldnt get here. Iter = %d\n",iter);
 			return -1;
 		}
+#if CPU_ADAPTIVE_PREDICT
+		adaptiveModel[0] = (model[0] != NULL) ? svm_adaptive_create(model[0]) : NULL;
+		adaptivePairs = 0;
+		adaptiveRecomputed = 0;
+#endif
+#if CPU_CSR_MODEL
+		csrModel[0] = (model[0] != NULL) ? svm_csr_from_model(model[0],CPU_CSR_FLOAT) : NULL;
+		if(csrModel[0] != NULL)
+			printf("CSR Model: %lu bytes (double model %lu bytes)\n",
+				   (unsigned long)svm_csr_model_bytes(csrModel[0]),doubleModelBytes(model[0]));
+#endif
+#if CPU_FIXED_SHAPE
+		fixedModel[0] = svm_fixed_create<NUM_FEATURES,NUM_CLASS>(model[0]);
+		if(fixedModel[0] == NULL && model[0] != NULL)
+			printf("Model does not have the %d feature / %d class shape, using svm_predict\n",NUM_FEATURES,NUM_CLASS);
+#endif
+		if(CPU_PREDICT_THREADS > 1 && model[0] != NULL && model[0]->l >= CPU_PREDICT_MIN_SV)
+		{
+			latencyPools[0] = latencyPoolCreate(model[0],CPU_PREDICT_THREADS);
+			if(latencyPools[0] != NULL)
+				printf("CPU predictions split over %d threads\n",latencyPoolThreads(latencyPools[0]));
+		}
+		if(CPU_MODEL_STORAGE != SVM_STORE_DOUBLE && model[0] != NULL)
+		{
+			qmodel = svm_quantize_model(model[0],CPU_MODEL_STORAGE,CPU_COEF_STORAGE);
+			if(qmodel == NULL)
+				printf("Error, could not build the %s model copy\n",svm_store_format_name(CPU_MODEL_STORAGE));
+		}
 		x = (struct svm_node *) malloc(max_nr_attr*sizeof(struct svm_node));
 		strcpy(summaryoutputFilename,outputFilename);
 		strcat(summaryoutputFilename,".txt");
@@ -286,28 +786,30 @@ int main(int argc, char **argv)
 				continue;
 			}
 			correct_predicts=0;
+			multiMatch = 0;
+			multiAttempted = 0;
+			cpuUncachedMs = fpgaUncachedMs = 0.0;
+			cpuUncached = fpgaUncached = 0;
 
-			//Send Kernel Parameters via BlueTooth	
+			//Send Kernel Parameters via BlueTooth
 			sendKernelData(i-1);
 			printf("Sent Kernel Data Msg\n");
 
+			//Cached results belong to the previous model
+			if(cpuCache != NULL) pcacheClear(cpuCache);
+			if(fpgaCache != NULL) pcacheClear(fpgaCache);
+
 			while((fscanf(testFile, "%[^\n]%*c", temp_svm_node)) != EOF)
 			{
 				testnum++;
 				sprintf(local_svm_node,"START_DATA %sEND:TEST END_DATA",temp_svm_node);
 				G_CMD_SET=0;
+				target_label = strtod(temp_svm_node,NULL);
+				cpuKeyed = (cpuCache != NULL && cpuCacheKey(temp_svm_node,&CPU_Key[0]) == 0);
 
-				// Have the computer make the prediction and time it.  PredictionTime stores this timing information.
-				QueryPerformanceCounter(&tick1);			
-				if (predict(&local_svm_node[0], i, &current_prediction) == TRUE) correct_predicts++;
-				attempted_predicts++;
-				QueryPerformanceCounter(&tick2);
-				QueryPerformanceFrequency(&ticksPerSecond);
-				PredictionTime = (double)(tick2.QuadPart-tick1.QuadPart)/(ticksPerSecond.QuadPart/1000);
-
-				////////////////////////////
-				// Read features for fpga //
-				////////////////////////////
+				//////////////////////////////////////////////////
+				// Read features for fpga (also its cache key)  //
+				//////////////////////////////////////////////////
 				v = 0;
 				pch = strtok(temp_svm_node," :");
 				while(pch != NULL)
@@ -325,11 +827,43 @@ int main(int argc, char **argv)
 					return -1;
 				}
 
-				//Sent Real Time Feature Data to the FPGA
-				sendRTData(&Feature_Data[0]);
-			
-				//wait for FPGA Response
-				recvClass(&FPGA_Prediction,&FPGA_Prediction_Time);
+				// Have the computer make the prediction and time it.  PredictionTime stores this timing information.
+				QueryPerformanceCounter(&tick1);
+				if (cachedPredict(cpuCache, &local_svm_node[0], i, cpuKeyed ? &CPU_Key[0] : NULL, target_label, &current_prediction, &cpuHit) == TRUE) correct_predicts++;
+				attempted_predicts++;
+				QueryPerformanceCounter(&tick2);
+				QueryPerformanceFrequency(&ticksPerSecond);
+				PredictionTime = (double)(tick2.QuadPart-tick1.QuadPart)/(ticksPerSecond.QuadPart/1000);
+				if(!cpuHit)
+				{
+					cpuUncachedMs += PredictionTime;
+					cpuUncached++;
+				}
+
+				// The multi-model pass predicted this vector with all 4 models at once, logged beside it
+				MultiModelTime = 0.0;
+				if(testnum <= multiCount)
+				{
+					if((int)multiLabel[iter][testnum-1] == current_prediction) multiMatch++;
+					multiAttempted++;
+					MultiModelTime = multiTime[testnum-1];
+				}
+
+				//Sent Real Time Feature Data to the FPGA and wait for its response
+				cachedFPGAPredict(fpgaCache,&Feature_Data[0],&FPGA_Prediction,&FPGA_Prediction_Time,&fpgaHit);
+				if(!fpgaHit)
+				{
+					fpgaUncachedMs += FPGA_Prediction_Time;
+					fpgaUncached++;
+				}
+
+				//Reduced precision CPU prediction, compared before translation
+				if(qmodel != NULL)
+				{
+					quant_prediction = (int)svm_quantized_predict_dense(qmodel,&Feature_Data[0],NUM_FEATURES);
+					if(quant_prediction == current_prediction) quantMatchCPU++;
+					if(translatePrediction(quant_prediction) == FPGA_Prediction) quantMatchFPGA++;
+				}
 
 				/***************************************************************************/
 				/* Translation Code                                                        */
@@ -360,6 +894,8 @@ int main(int argc, char **argv)
 					Log_Channel_4_Data[LogSize] = FPGA_Prediction_Time; //FPGA Prediction Time
 					Log_Channel_5_Data[LogSize] = correct_predicts;		//LIBSVM Model Correct Predictions
 					Log_Channel_6_Data[LogSize] = attempted_predicts;	//LIBSVM Model # Predictions
+					Log_Channel_7_Data[LogSize] = MultiModelTime;		//Multi-Model Pass Time (all 4 models)
+					Log_Channel_8_Data[LogSize] = cpuHit | (fpgaHit << 1);	//Cache Hits: 1 CPU, 2 FPGA, time is not a prediction time
 					LogSize++;
 				}
 				if (LogSize >= 299900 && FirstPass == FALSE)
@@ -380,6 +916,16 @@ int main(int argc, char **argv)
 				   "FPGA/CPU Matches: %d/%d (%f%%)\n\n", run,
 					   correct_predicts,attempted_predicts,((float)correct_predicts/(float)attempted_predicts)*(float)100.0,
 					   numMatch,attempted_predicts, ((float)numMatch/(float)attempted_predicts)*(float)100.0);
+			printCacheStats(stdout,"CPU",cpuCache,cpuUncachedMs,cpuUncached);
+			printCacheStats(stdout,"FPGA",fpgaCache,fpgaUncachedMs,fpgaUncached);
+			printCacheStats(summary_outf,"CPU",cpuCache,cpuUncachedMs,cpuUncached);
+			printCacheStats(summary_outf,"FPGA",fpgaCache,fpgaUncachedMs,fpgaUncached);
+			printQuantStats(stdout,qmodel,model[i-1],quantMatchCPU,quantMatchFPGA,attempted_predicts);
+			printQuantStats(summary_outf,qmodel,model[i-1],quantMatchCPU,quantMatchFPGA,attempted_predicts);
+			printAdaptiveStats(stdout);
+			printAdaptiveStats(summary_outf);
+			printMultiStats(stdout,multiMatch,multiAttempted);
+			printMultiStats(summary_outf,multiMatch,multiAttempted);
 			run++;
 			printf("Hit enter to continue\n");
   			fflush(stdin);
@@ -411,6 +957,10 @@ int main(int argc, char **argv)
 					fprintf(output,"%.15f",Log_Channel_5_Data[i]);
 					fprintf(output,",");
 					fprintf(output,"%.15f",Log_Channel_6_Data[i]);
+					fprintf(output,",");
+					fprintf(output,"%.15f",Log_Channel_7_Data[i]);
+					fprintf(output,",");
+					fprintf(output,"%.15f",Log_Channel_8_Data[i]);
 					fprintf(output,"\n");
 				}
 			}//End Else from If Open Failed 
@@ -420,8 +970,14 @@ int main(int argc, char **argv)
 		//Free the LIBSVM Models
 		for(u = 0; u < NUM_MODELS; u++)
 		{
+			svm_adaptive_free(&adaptiveModel[u]);
+			svm_csr_free(&csrModel[u]);
+			svm_fixed_free(&fixedModel[u]);
+			latencyPoolDestroy(latencyPools[u]);
+			latencyPools[u] = NULL;
 			svm_free_and_destroy_model(&model[u]);
 		}
+		svm_free_quantized_model(&qmodel);
 		free(x);
 		x = NULL;
 
@@ -436,6 +992,13 @@ int main(int argc, char **argv)
 
 	}
 	closeBTComms();
+	pcacheDestroy(cpuCache);
+	pcacheDestroy(fpgaCache);
+	if(multiCount > 0)
+	{
+		for(u=0;u<4;u++) free(multiLabel[u]);
+		free(multiTime);
+	}
 
 	return 0;
 }
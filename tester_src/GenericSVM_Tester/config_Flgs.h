@@ -13,6 +13,70 @@
 /* COM PORT, Change if computer is using a different one */
 #define COM_PORT_TO_USE					"COM3"
 
+/* Prediction memo cache, 0 entries disables it.  Repeated feature vectors are */
+/* answered without svm_predict or a UART round trip.  The FPGA key is the     */
+/* fp32 feature image, the CPU key the doubles svm_predict is given.  Both     */
+/* ignore the low PREDICT_CACHE_QUANT_BITS bits of an fp32 mantissa, or the    */
+/* matching bits of a double.                                                  */
+#define PREDICT_CACHE_ENTRIES			0
+#define PREDICT_CACHE_QUANT_BITS		0		/* 0 (exact) to 22 */
+
+/* Load models from the binary copy <model file>.bin, written on first use.  */
+/* Delete the .bin files after retraining, they are not checked for age.     */
+#define USE_BINARY_MODELS				FALSE
+
+/* Back each loaded model's single allocation with large (2 MB) pages.  On   */
+/* Windows the account needs the "Lock pages in memory" right.               */
+#define MODEL_HUGE_PAGES				FALSE
+
+/* Storage format of a second, reduced precision CPU model used alongside the */
+/* double model, SVM_STORE_DOUBLE disables it.  Formats (svm_quant.h) are     */
+/* SVM_STORE_FP32, _FP16, _BF16 and _INT8; coefficients may stay double.      */
+/* Its labels are compared against the double CPU and the FPGA predictions.   */
+#define CPU_MODEL_STORAGE				SVM_STORE_DOUBLE
+#define CPU_COEF_STORAGE				SVM_STORE_DOUBLE
+
+/* CPU predictions evaluate the kernels in fp32 SIMD and only redo, in double, */
+/* the decision functions that land within their rounding error bound of 0.  */
+/* Labels are identical to svm_predict.                                      */
+#define CPU_ADAPTIVE_PREDICT			FALSE
+
+/* Predict the test file with all 4 models (FNAME_1..4) in one pass before  */
+/* the FPGA runs, evaluating SVs shared between the models once.  The runs */
+/* still predict each model and log the pass time in a column of its own.  */
+#define CPU_MULTI_MODEL					FALSE
+
+/* CPU predictions use a compressed sparse row copy of the model (contiguous */
+/* uint16/uint32 feature indices and values, no svm_node padding or -1      */
+/* terminators).  CPU_CSR_FLOAT stores the values as float.                  */
+#define CPU_CSR_MODEL					FALSE
+#define CPU_CSR_FLOAT					FALSE
+
+/* CPU predictions use a copy of the model specialized at compile time for  */
+/* NUM_FEATURES and NUM_CLASS, with the kernel chosen once per prediction.  */
+/* Models of another shape fall back to svm_predict.                        */
+#define CPU_FIXED_SHAPE					FALSE
+
+/* Split each CPU prediction across this many pinned threads (0 or 1 = off), */
+/* for models with at least CPU_PREDICT_MIN_SV SVs.  Lowers the latency of  */
+/* one vector on large models; the workers spin while predictions arrive.   */
+#define CPU_PREDICT_THREADS				0
+#define CPU_PREDICT_MIN_SV				10000
+
+/* Before the FPGA runs, measure CPU prediction throughput of FNAME_1 with   */
+/* 1, 2, 4 ... threads pinned across the NUMA nodes, sharing one model and */
+/* with a node-local copy of the model per node.                          */
+#define NUMA_BENCHMARK					FALSE
+#define NUMA_BENCHMARK_PASSES			10
+
+/* Before the FPGA runs, HOT_SWAP_READERS threads predict the test file     */
+/* nonstop while FNAME_2..4 replace FNAME_1 every HOT_SWAP_INTERVAL_MS, with */
+/* no locks on the prediction path.  Each model is also staged in a spare   */
+/* FPGA model slot before model_select moves to it.                         */
+#define HOT_SWAP_MODELS					FALSE
+#define HOT_SWAP_READERS				2
+#define HOT_SWAP_INTERVAL_MS			1000
+
 /*******************************************************************************/
 /* MODEL Selection, Also selects CPU Prediction to FPGA Prediction Translation */
 /*		!!! Edit ME TO SELECT THE RIGHT MODEL !!!							   */
@@ -0,0 +1,175 @@
+// fpga_model.cpp : FPGA side of a libsvm model for the model tools.
+//
+// Cycle counts follow the pipeline constants in vhdl_src (fp_components.vhd,
+// multi_kernel.vhd, svmClassEval.vhd).  The kernel unit streams one SV per
+// clock and the class evaluation consumes the kernel values as they are
+// written, so a prediction costs the kernel pipeline fill plus one clock per
+// SV and a fixed overhead per class.  The estimate ignores the UART transfer.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config_Flgs.h"
+#include "fpga_model.h"
+
+/* fp_components.vhd */
+#define NUM_FPSUB_CYCLES		7
+#define NUM_FPADD_CYCLES		7
+#define NUM_FPMULT_CYCLES		5
+#define NUM_EXP_CYCLES			17
+#define NUM_LOG_CYCLES			21
+#define NUM_FPDIV_CYCLES		6
+
+/* svmClassEval.vhd */
+#define NUM_CYCLES_MULTACCUM	13
+#define FINAL_COMPARE_STAGES	7
+#define CLASS_FLUSH_CYCLES		(5 + NUM_CYCLES_MULTACCUM + 32)	/* accumRemainingData_PTA + _PTB */
+#define CLASS_SETUP_CYCLES		3								/* rdOffset, rdNumCoeffInClass, last rho */
+
+
+static int log2c(int n)
+{
+	int bits = 0;
+
+	while((1 << bits) < n)
+		bits++;
+	return bits;
+}
+
+/* KERNEL_PIPELINE_STALL_TIME_* of multi_kernel.vhd */
+static int kernelStallCycles(int kernelType, int numFeatures)
+{
+	int numStages = log2c(numFeatures);
+
+	switch(kernelType)
+	{
+	case POLY:
+		return NUM_FPMULT_CYCLES + numStages*NUM_FPADD_CYCLES +
+			   (NUM_FPMULT_CYCLES + NUM_FPADD_CYCLES + NUM_LOG_CYCLES) +
+			   (NUM_FPMULT_CYCLES + NUM_EXP_CYCLES) - 1 + 2;
+	case RBF:
+		return (NUM_FPSUB_CYCLES + NUM_FPMULT_CYCLES) + numStages*NUM_FPADD_CYCLES +
+			   (NUM_FPMULT_CYCLES + NUM_FPADD_CYCLES) +
+			   (NUM_FPMULT_CYCLES + NUM_EXP_CYCLES) - 1 + 1;
+	case SIGMOID:
+		return NUM_FPMULT_CYCLES + numStages*NUM_FPADD_CYCLES +
+			   (NUM_FPMULT_CYCLES + NUM_FPADD_CYCLES) +
+			   (NUM_FPMULT_CYCLES + NUM_EXP_CYCLES + NUM_FPADD_CYCLES + NUM_FPDIV_CYCLES) - 1;
+	default:
+		return NUM_FPMULT_CYCLES + numStages*NUM_FPADD_CYCLES - 1;
+	}
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      fpgaPredictCycles
+* Arguments: model - classification model
+*            numFeatures - NUM_FEATURES the bitstream was built with
+* Returns:   estimated FPGA clocks from start of evaluation to the class
+*
+***************************************************************************/
+long fpgaPredictCycles(const struct svm_model *model, int numFeatures)
+{
+	int nrClass = model->nr_class;
+	long cycles;
+	int i;
+
+	cycles = 2 + kernelStallCycles(model->param.kernel_type,numFeatures);
+	for(i=0;i<nrClass;i++)
+	{
+		cycles += CLASS_SETUP_CYCLES + (nrClass - 1) + CLASS_FLUSH_CYCLES;
+		cycles += (model->nSV != NULL) ? model->nSV[i] : model->l/nrClass;
+	}
+	cycles += nrClass*(nrClass-1)/2 + NUM_FPADD_CYCLES + FINAL_COMPARE_STAGES + nrClass;
+
+	return cycles;
+}
+
+double fpgaCyclesToUs(long cycles)
+{
+	return (double)cycles/FPGA_CLOCK_FREQ_MHZ;
+}
+
+int fpgaModelFits(const struct svm_model *model)
+{
+	return (model->l <= FPGA_TOTAL_NUM_SV && model->nr_class <= FPGA_NUM_CLASS_MAX) ? TRUE : FALSE;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      saveFPGAModel
+* Arguments: fname - output file, the MODEL_FNAME_xA file of config_Flgs.h
+*            model - classification model
+*            numFeatures - every SV is written densely with this many features
+* Returns:   0 on success, -1 on error
+*
+* Writes the "A" model layout parsed by sendModelData: gamma first, then
+* nr_class, total_sv and the feature count, followed by rho, labels, SVs per
+* class and one dense "coef ... 1:v 2:v ... N:v" line per SV.  The keywords
+* carry no digits so they are skipped by the number scanner.
+*
+***************************************************************************/
+int saveFPGAModel(const char *fname, const struct svm_model *model, int numFeatures)
+{
+	FILE *fp;
+	int nrClass = model->nr_class;
+	int i, j;
+
+	if(model->nSV == NULL || model->label == NULL)
+	{
+		printf("ERROR %s: only classification models can be sent to the FPGA!\n",fname);
+		return -1;
+	}
+	if(!(fp = fopen(fname,"w")))
+	{
+		printf("ERROR opening %s for writing!\n",fname);
+		return -1;
+	}
+
+	fprintf(fp,"gamma %.8g\n",(model->param.kernel_type == LINEAR) ? 0.0 : model->param.gamma);
+	fprintf(fp,"nr_class %d\n",nrClass);
+	fprintf(fp,"total_sv %d\n",model->l);
+	fprintf(fp,"features %d\n",numFeatures);
+	fprintf(fp,"rho");
+	for(i=0;i<nrClass*(nrClass-1)/2;i++)
+		fprintf(fp," %.8g",model->rho[i]);
+	fprintf(fp,"\nlabel");
+	for(i=0;i<nrClass;i++)
+		fprintf(fp," %d",model->label[i]);
+	fprintf(fp,"\nnr_sv");
+	for(i=0;i<nrClass;i++)
+		fprintf(fp," %d",model->nSV[i]);
+	fprintf(fp,"\nSV\n");
+
+	for(i=0;i<model->l;i++)
+	{
+		const struct svm_node *p = model->SV[i];
+
+		for(j=0;j<nrClass-1;j++)
+			fprintf(fp,"%.8g ",model->sv_coef[j][i]);
+		for(j=1;j<=numFeatures;j++)
+		{
+			double value = 0.0;
+
+			while(p->index != -1 && p->index < j)
+				p++;
+			if(p->index == j)
+				value = p->value;
+			fprintf(fp,"%d:%.8g ",j,value);
+		}
+		fprintf(fp,"\n");
+	}
+
+	if(ferror(fp) != 0 || fclose(fp) != 0)
+	{
+		printf("ERROR writing %s!\n",fname);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef _FPGA_MODEL_H
+#define _FPGA_MODEL_H
+
+#include "svm.h"
+
+/* Capacity of the current bitstream (svm_top_test.vhd) */
+#define FPGA_TOTAL_NUM_SV		15000
+#define FPGA_NUM_CLASS_MAX		26
+
+
+/* Function Prototypes */
+long fpgaPredictCycles(const struct svm_model *model, int numFeatures);
+double fpgaCyclesToUs(long cycles);
+int fpgaModelFits(const struct svm_model *model);
+int saveFPGAModel(const char *fname, const struct svm_model *model, int numFeatures);
+
+
+#endif /* _FPGA_MODEL_H */
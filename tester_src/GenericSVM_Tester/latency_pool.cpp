@@ -0,0 +1,294 @@
+// latency_pool.cpp : Single-vector CPU prediction split across cores.
+//
+// The SVs are cut into one contiguous slice per thread.  For each test
+// vector every thread computes the kernel values of its slice and its
+// share of every pairwise decision sum; the calling thread takes slice 0
+// and then adds the partial sums in thread order, so the result does not
+// depend on timing.  It can differ from svm_predict in the last bits of a
+// decision value, because the sums are grouped by slice.
+//
+// Workers are pinned one per CPU and spin on a job counter instead of
+// waiting on an event, so a new vector starts without a wake-up.  After
+// LATENCY_SPIN_LIMIT idle polls a worker yields its time slice between
+// polls, leaving the CPU to other threads while no predictions come in.
+//
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "latency_pool.h"
+
+#define LATENCY_MAX_THREADS		64
+#define LATENCY_SPIN_LIMIT		200000
+#define LATENCY_LINE_DOUBLES	8		/* doubles per 64 byte cache line */
+#define LATENCY_STACK_PAIRS		512		/* decision values kept on the stack */
+#define LATENCY_STACK_CLASSES	64
+
+typedef struct
+{
+	struct latencyPool *pool;
+	int index;
+	int begin, end;			/* SV slice */
+	double *partial;		/* one sum per class pair, own cache lines */
+	DWORD_PTR cpuMask;
+	HANDLE thread;
+} latencyWorker;
+
+struct latencyPool
+{
+	const struct svm_model *model;
+	int numThreads;
+	int numPairs;
+	int *start;				/* first SV of each class, nr_class+1 entries */
+	double *kvalue;			/* l kernel values, each thread writes its slice */
+	double *partialSpace;
+	latencyWorker worker[LATENCY_MAX_THREADS];
+
+	/* current job */
+	const struct svm_node *volatile x;
+	volatile LONG job;		/* bumped once per vector */
+	volatile LONG done;		/* workers finished with the current job */
+	volatile LONG quit;
+};
+
+
+/* kernel values and pairwise partial sums of SVs [begin,end) */
+static void evalSlice(latencyPool *pool, latencyWorker *w)
+{
+	const struct svm_model *model = pool->model;
+	const struct svm_node *x = pool->x;
+	int nr_class = model->nr_class;
+	int i, j, k, p = 0;
+
+	for(k=w->begin;k<w->end;k++)
+		pool->kvalue[k] = svm_k_function(x,model->SV[k],&model->param);
+
+	for(i=0;i<nr_class;i++)
+		for(j=i+1;j<nr_class;j++)
+		{
+			const double *coef1 = model->sv_coef[j-1];
+			const double *coef2 = model->sv_coef[i];
+			int b = (pool->start[i] > w->begin) ? pool->start[i] : w->begin;
+			int e = (pool->start[i+1] < w->end) ? pool->start[i+1] : w->end;
+			double sum = 0;
+
+			for(k=b;k<e;k++)
+				sum += coef1[k] * pool->kvalue[k];
+			b = (pool->start[j] > w->begin) ? pool->start[j] : w->begin;
+			e = (pool->start[j+1] < w->end) ? pool->start[j+1] : w->end;
+			for(k=b;k<e;k++)
+				sum += coef2[k] * pool->kvalue[k];
+			w->partial[p++] = sum;
+		}
+}
+
+static DWORD WINAPI workerMain(LPVOID arg)
+{
+	latencyWorker *w = (latencyWorker *)arg;
+	latencyPool *pool = w->pool;
+	LONG seen = 0;
+
+	SetThreadAffinityMask(GetCurrentThread(),w->cpuMask);
+	while(1)
+	{
+		long spins = 0;
+
+		while(pool->job == seen && !pool->quit)
+		{
+			if(++spins < LATENCY_SPIN_LIMIT)
+				YieldProcessor();
+			else
+				SwitchToThread();
+		}
+		if(pool->quit)
+			break;
+		seen = pool->job;
+		evalSlice(pool,w);
+		InterlockedIncrement(&pool->done);
+	}
+	return 0;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      latencyPoolCreate
+* Arguments: model - classification model, must outlive the pool
+*            numThreads - threads per prediction including the caller,
+*                         <= 0 for one per CPU
+* Returns:   the pool, NULL if the model is not a classifier or on error
+*
+* Worker t is pinned to CPU t, the calling thread is left as it is.  If a
+* worker cannot be started, those already running are stopped and NULL is
+* returned, since its slice would never be computed.
+*
+***************************************************************************/
+latencyPool *latencyPoolCreate(const struct svm_model *model, int numThreads)
+{
+	SYSTEM_INFO si;
+	latencyPool *pool;
+	size_t offset;
+	int nr_class, i, lines;
+
+	if(model == NULL || model->nSV == NULL ||
+	   (model->param.svm_type != C_SVC && model->param.svm_type != NU_SVC))
+		return NULL;
+	GetSystemInfo(&si);
+	if(numThreads <= 0 || numThreads > (int)si.dwNumberOfProcessors)
+		numThreads = (int)si.dwNumberOfProcessors;
+	if(numThreads > LATENCY_MAX_THREADS)
+		numThreads = LATENCY_MAX_THREADS;
+	if(numThreads > model->l)
+		numThreads = (model->l > 0) ? model->l : 1;
+
+	pool = (latencyPool *)calloc(1,sizeof(latencyPool));
+	if(pool == NULL)
+		return NULL;
+	nr_class = model->nr_class;
+	pool->model = model;
+	pool->numThreads = numThreads;
+	pool->numPairs = nr_class*(nr_class-1)/2;
+	pool->start = (int *)malloc((nr_class+1)*sizeof(int));
+	pool->kvalue = (double *)malloc((model->l+1)*sizeof(double));
+	lines = (pool->numPairs + LATENCY_LINE_DOUBLES-1) / LATENCY_LINE_DOUBLES;
+	pool->partialSpace = (double *)malloc(((size_t)numThreads*lines+1)*LATENCY_LINE_DOUBLES*sizeof(double));
+	if(pool->start == NULL || pool->kvalue == NULL || pool->partialSpace == NULL)
+	{
+		printf("Error allocating the latency pool for %d SVs\n",model->l);
+		free(pool->start);
+		free(pool->kvalue);
+		free(pool->partialSpace);
+		free(pool);
+		return NULL;
+	}
+	pool->start[0] = 0;
+	for(i=0;i<nr_class;i++)
+		pool->start[i+1] = pool->start[i] + model->nSV[i];
+
+	/* start each thread's sums on a cache line boundary */
+	offset = (LATENCY_LINE_DOUBLES - ((size_t)pool->partialSpace / sizeof(double)) % LATENCY_LINE_DOUBLES) % LATENCY_LINE_DOUBLES;
+	for(i=0;i<numThreads;i++)
+	{
+		latencyWorker *w = &pool->worker[i];
+
+		w->pool = pool;
+		w->index = i;
+		w->begin = (int)((long long)model->l * i / numThreads);
+		w->end = (int)((long long)model->l * (i+1) / numThreads);
+		w->partial = pool->partialSpace + offset + (size_t)i*lines*LATENCY_LINE_DOUBLES;
+		w->cpuMask = (DWORD_PTR)1 << (i % (8*sizeof(DWORD_PTR)));
+	}
+	for(i=1;i<numThreads;i++)
+	{
+		pool->worker[i].thread = CreateThread(NULL,0,workerMain,&pool->worker[i],0,NULL);
+		if(pool->worker[i].thread == NULL)
+		{
+			printf("Error starting latency pool thread %d of %d\n",i,numThreads);
+			pool->numThreads = i;		/* the workers to stop */
+			latencyPoolDestroy(pool);
+			return NULL;
+		}
+	}
+	return pool;
+}
+
+void latencyPoolDestroy(latencyPool *pool)
+{
+	int i;
+
+	if(pool == NULL)
+		return;
+	InterlockedExchange(&pool->quit,TRUE);
+	for(i=1;i<pool->numThreads;i++)
+	{
+		WaitForSingleObject(pool->worker[i].thread,INFINITE);
+		CloseHandle(pool->worker[i].thread);
+	}
+	free(pool->start);
+	free(pool->kvalue);
+	free(pool->partialSpace);
+	free(pool);
+}
+
+int latencyPoolThreads(const latencyPool *pool)
+{
+	return pool->numThreads;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      latencyPoolPredictValues
+* Arguments: pool - the pool
+*            x - test vector
+*            decValues - receives nr_class*(nr_class-1)/2 decision values
+* Returns:   predicted label
+*
+* Only one thread may predict with a pool at a time.
+*
+***************************************************************************/
+double latencyPoolPredictValues(latencyPool *pool, const struct svm_node *x, double *decValues)
+{
+	const struct svm_model *model = pool->model;
+	int nr_class = model->nr_class;
+	int vote[LATENCY_STACK_CLASSES], *votes = vote;
+	long spins;
+	int i, j, t, p, voteMaxIdx = 0;
+
+	pool->x = x;
+	pool->done = 0;
+	InterlockedIncrement(&pool->job);
+	evalSlice(pool,&pool->worker[0]);
+	for(spins=0;pool->done < pool->numThreads-1;spins++)
+	{
+		if(spins < LATENCY_SPIN_LIMIT)
+			YieldProcessor();
+		else
+			SwitchToThread();
+	}
+
+	if(nr_class > LATENCY_STACK_CLASSES)
+		votes = (int *)malloc(nr_class*sizeof(int));
+	for(i=0;i<nr_class;i++)
+		votes[i] = 0;
+	p = 0;
+	for(i=0;i<nr_class;i++)
+		for(j=i+1;j<nr_class;j++)
+		{
+			double sum = 0;
+			for(t=0;t<pool->numThreads;t++)
+				sum += pool->worker[t].partial[p];
+			sum -= model->rho[p];
+			decValues[p] = sum;
+			if(sum > 0)
+				++votes[i];
+			else
+				++votes[j];
+			p++;
+		}
+	for(i=1;i<nr_class;i++)
+		if(votes[i] > votes[voteMaxIdx])
+			voteMaxIdx = i;
+	i = model->label[voteMaxIdx];
+	if(votes != vote)
+		free(votes);
+	return i;
+}
+
+double latencyPoolPredict(latencyPool *pool, const struct svm_node *x)
+{
+	double stackValues[LATENCY_STACK_PAIRS];
+	double *decValues = stackValues;
+	double label;
+
+	if(pool->numPairs > LATENCY_STACK_PAIRS)
+		decValues = (double *)malloc(pool->numPairs*sizeof(double));
+	label = latencyPoolPredictValues(pool,x,decValues);
+	if(decValues != stackValues)
+		free(decValues);
+	return label;
+}
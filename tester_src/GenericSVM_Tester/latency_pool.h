@@ -0,0 +1,17 @@
+#ifndef _LATENCY_POOL_H
+#define _LATENCY_POOL_H
+
+#include "svm.h"
+
+typedef struct latencyPool latencyPool;
+
+
+/* Function Prototypes */
+latencyPool *latencyPoolCreate(const struct svm_model *model, int numThreads);
+void latencyPoolDestroy(latencyPool *pool);
+int latencyPoolThreads(const latencyPool *pool);
+double latencyPoolPredictValues(latencyPool *pool, const struct svm_node *x, double *decValues);
+double latencyPoolPredict(latencyPool *pool, const struct svm_node *x);
+
+
+#endif /* _LATENCY_POOL_H */
@@ -0,0 +1,262 @@
+// model_handle.cpp : Current model for predictor threads, swappable while
+// they run.
+//
+// Readers never lock.  A reader announces the global epoch in its own slot
+// and then loads the model pointer; a swap exchanges the pointer, advances
+// the epoch and retires the old model tagged with the new epoch.  A reader
+// that announced that epoch or a later one loaded its pointer after the
+// exchange, so a retired model is freed once every busy reader has
+// announced at least its retire epoch.  Idle readers hold 0, and the epoch
+// starts at 1.  The interlocked calls are full barriers, which orders each
+// reader's announce before its pointer load and each swap before the
+// reclaim scan.
+//
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "model_handle.h"
+
+typedef struct
+{
+	volatile LONG epoch;	/* epoch announced while reading, 0 when idle */
+	char pad[64 - sizeof(LONG)];	/* one cache line per reader */
+} readerSlot;
+
+typedef struct retiredModel
+{
+	struct svm_model *model;
+	LONG epoch;				/* epoch published with the replacement */
+	struct retiredModel *next;
+} retiredModel;
+
+struct modelHandle
+{
+	struct svm_model *volatile current;
+	volatile LONG epoch;
+	volatile LONG numReaders;
+	int maxReaders;
+	readerSlot *reader;
+	retiredModel *retired;
+	int numRetired;
+	CRITICAL_SECTION writeLock;	/* swaps and reclaims only */
+};
+
+
+
+
+/***************************************************************************
+*
+* Name:      modelHandleCreate
+* Arguments: model - first model to serve, owned by the handle from now on
+*            maxReaders - number of reader threads that may register
+* Returns:   the handle, NULL on error
+*
+***************************************************************************/
+modelHandle *modelHandleCreate(struct svm_model *model, int maxReaders)
+{
+	modelHandle *handle;
+
+	if(model == NULL || maxReaders <= 0)
+		return NULL;
+	handle = (modelHandle *)calloc(1,sizeof(modelHandle));
+	if(handle == NULL)
+		return NULL;
+	handle->reader = (readerSlot *)calloc(maxReaders,sizeof(readerSlot));
+	if(handle->reader == NULL)
+	{
+		printf("Error allocating %d model handle readers\n",maxReaders);
+		free(handle);
+		return NULL;
+	}
+	handle->current = model;
+	handle->epoch = 1;
+	handle->maxReaders = maxReaders;
+	InitializeCriticalSection(&handle->writeLock);
+	return handle;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      modelHandleDestroy
+* Arguments: handle - handle to free, no reader may still be running
+* Returns:   none
+*
+* Frees the current model and every retired one.
+*
+***************************************************************************/
+void modelHandleDestroy(modelHandle *handle)
+{
+	struct svm_model *model;
+
+	if(handle == NULL)
+		return;
+	while(handle->retired != NULL)
+	{
+		retiredModel *r = handle->retired;
+		handle->retired = r->next;
+		svm_free_and_destroy_model(&r->model);
+		free(r);
+	}
+	model = handle->current;
+	svm_free_and_destroy_model(&model);
+	DeleteCriticalSection(&handle->writeLock);
+	free(handle->reader);
+	free(handle);
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      modelHandleRegister
+* Arguments: handle - model handle
+* Returns:   reader slot for the calling thread, -1 if all are taken
+*
+***************************************************************************/
+int modelHandleRegister(modelHandle *handle)
+{
+	LONG slot = InterlockedIncrement(&handle->numReaders) - 1;
+
+	if(slot >= handle->maxReaders)
+	{
+		printf("Model handle has no free reader slot (%d readers)\n",handle->maxReaders);
+		return -1;
+	}
+	return (int)slot;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      modelHandleAcquire
+* Arguments: handle - model handle
+*            reader - slot from modelHandleRegister
+* Returns:   the current model, valid until modelHandleRelease
+*
+* Acquire/release pairs do not nest.
+*
+***************************************************************************/
+const struct svm_model *modelHandleAcquire(modelHandle *handle, int reader)
+{
+	InterlockedExchange(&handle->reader[reader].epoch,handle->epoch);
+	return handle->current;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      modelHandleRelease
+* Arguments: handle - model handle
+*            reader - slot passed to modelHandleAcquire
+* Returns:   none
+*
+***************************************************************************/
+void modelHandleRelease(modelHandle *handle, int reader)
+{
+	InterlockedExchange(&handle->reader[reader].epoch,0);
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      modelHandleSwap
+* Arguments: handle - model handle
+*            model - replacement, owned by the handle from now on
+* Returns:   number of retired models still held by readers, -1 on error
+*
+* Readers that acquire after the swap get the new model.  The old one is
+* freed here if no reader holds it, otherwise by a later swap or
+* modelHandleReclaim.
+*
+***************************************************************************/
+int modelHandleSwap(modelHandle *handle, struct svm_model *model)
+{
+	retiredModel *r;
+
+	if(model == NULL)
+		return -1;
+	r = (retiredModel *)malloc(sizeof(retiredModel));
+	if(r == NULL)
+		return -1;
+
+	EnterCriticalSection(&handle->writeLock);
+	r->model = (struct svm_model *)InterlockedExchangePointer((PVOID volatile *)&handle->current,model);
+	r->epoch = InterlockedIncrement(&handle->epoch);
+	r->next = handle->retired;
+	handle->retired = r;
+	handle->numRetired++;
+	LeaveCriticalSection(&handle->writeLock);
+
+	return modelHandleReclaim(handle);
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      modelHandleReclaim
+* Arguments: handle - model handle
+* Returns:   number of retired models still held by readers
+*
+***************************************************************************/
+int modelHandleReclaim(modelHandle *handle)
+{
+	retiredModel **link;
+	LONG oldest = 0;
+	int i, rtnVal;
+
+	EnterCriticalSection(&handle->writeLock);
+
+	/* oldest epoch any reader is still inside, 0 if all are idle */
+	for(i=0;i<handle->maxReaders;i++)
+	{
+		LONG e = handle->reader[i].epoch;
+		if(e != 0 && (oldest == 0 || e < oldest))
+			oldest = e;
+	}
+
+	link = &handle->retired;
+	while(*link != NULL)
+	{
+		retiredModel *r = *link;
+		if(oldest == 0 || r->epoch <= oldest)
+		{
+			*link = r->next;
+			svm_free_and_destroy_model(&r->model);
+			free(r);
+			handle->numRetired--;
+		}
+		else
+			link = &r->next;
+	}
+	rtnVal = handle->numRetired;
+
+	LeaveCriticalSection(&handle->writeLock);
+	return rtnVal;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      modelHandleVersion
+* Arguments: handle - model handle
+* Returns:   number of swaps so far
+*
+***************************************************************************/
+long modelHandleVersion(const modelHandle *handle)
+{
+	return (long)handle->epoch - 1;
+}
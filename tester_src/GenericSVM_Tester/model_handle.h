@@ -0,0 +1,20 @@
+#ifndef _MODEL_HANDLE_H
+#define _MODEL_HANDLE_H
+
+#include "svm.h"
+
+typedef struct modelHandle modelHandle;
+
+
+/* Function Prototypes */
+modelHandle *modelHandleCreate(struct svm_model *model, int maxReaders);
+void modelHandleDestroy(modelHandle *handle);
+int modelHandleRegister(modelHandle *handle);
+const struct svm_model *modelHandleAcquire(modelHandle *handle, int reader);
+void modelHandleRelease(modelHandle *handle, int reader);
+int modelHandleSwap(modelHandle *handle, struct svm_model *model);
+int modelHandleReclaim(modelHandle *handle);
+long modelHandleVersion(const modelHandle *handle);
+
+
+#endif /* _MODEL_HANDLE_H */
@@ -0,0 +1,357 @@
+// numa_pool.cpp : NUMA-aware CPU prediction pool.
+//
+// Workers are pinned round robin across the NUMA nodes, one CPU each.
+// With replication the first worker on every node copies the model with
+// svm_copy_model after it has been pinned, so the copy's pages are first
+// touched, and therefore placed, on that node; every worker then reads
+// only its own node's copy.  Without replication all workers share the
+// model as loaded, wherever its pages happen to be.
+//
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "numa_pool.h"
+
+#define NUMA_MAX_NODES	64
+
+typedef struct
+{
+	struct numaPool *pool;
+	int index;
+	int node;
+	int nodeLeader;			/* copies the model for its node */
+	DWORD_PTR cpuMask;
+	HANDLE thread;
+	HANDLE startEvent;
+} numaWorker;
+
+typedef struct
+{
+	int threads;
+	int nodes;
+	int replicated;
+	double seconds;
+	double predictsPerSec;
+} numaPoolResult;
+
+struct numaPool
+{
+	const struct svm_model *model;
+	int numNodes;
+	int numThreads;
+	int replicate;
+	numaWorker *worker;
+	struct svm_model *nodeModel[NUMA_MAX_NODES];	/* model read by each node's workers */
+	struct svm_model *replica[NUMA_MAX_NODES];		/* copies owned by the pool */
+	HANDLE doneEvent;
+	volatile LONG pending;
+	volatile LONG quit;
+
+	/* current job */
+	struct svm_node *const *x;
+	int n;
+	double *labels;
+};
+
+
+static void workerDone(numaPool *pool)
+{
+	if(InterlockedDecrement(&pool->pending) == 0)
+		SetEvent(pool->doneEvent);
+}
+
+static DWORD WINAPI workerMain(LPVOID arg)
+{
+	numaWorker *w = (numaWorker *)arg;
+	numaPool *pool = w->pool;
+
+	SetThreadAffinityMask(GetCurrentThread(),w->cpuMask);
+	if(w->nodeLeader && pool->replicate)
+	{
+		pool->replica[w->node] = svm_copy_model(pool->model);
+		if(pool->replica[w->node] != NULL)
+			pool->nodeModel[w->node] = pool->replica[w->node];
+	}
+	workerDone(pool);
+
+	while(1)
+	{
+		int i, begin, end;
+		const struct svm_model *model;
+
+		WaitForSingleObject(w->startEvent,INFINITE);
+		if(pool->quit)
+			break;
+
+		model = pool->nodeModel[w->node];
+		begin = (int)((long long)pool->n * w->index / pool->numThreads);
+		end = (int)((long long)pool->n * (w->index+1) / pool->numThreads);
+		for(i=begin;i<end;i++)
+			pool->labels[i] = svm_predict(model,pool->x[i]);
+		workerDone(pool);
+	}
+	return 0;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      numaPoolCreate
+* Arguments: model - model to predict with, must outlive the pool
+*            maxThreads - number of workers, <= 0 for one per CPU
+*            replicate - TRUE to give every node its own copy of the model
+* Returns:   the pool, NULL on error
+*
+* Spreads the workers evenly over the nodes, pins each to one CPU and
+* waits until every node's copy of the model has been made.  If a worker
+* cannot be started, those already running are stopped and NULL is
+* returned, since the wait for it would never end.
+*
+***************************************************************************/
+numaPool *numaPoolCreate(const struct svm_model *model, int maxThreads, int replicate)
+{
+	ULONG highestNode = 0;
+	ULONGLONG nodeMask[NUMA_MAX_NODES];
+	int nodeCpus[NUMA_MAX_NODES];
+	int nodeId[NUMA_MAX_NODES];
+	int numNodes = 0, totalCpus = 0;
+	int i, n;
+	numaPool *pool;
+
+	if(!GetNumaHighestNodeNumber(&highestNode))
+		highestNode = 0;
+	for(n=0;n<=(int)highestNode && n<NUMA_MAX_NODES;n++)
+	{
+		ULONGLONG mask = 0;
+		int cpus = 0, b;
+		if(!GetNumaNodeProcessorMask((UCHAR)n,&mask) || mask == 0)
+			continue;
+		for(b=0;b<(int)(8*sizeof(DWORD_PTR));b++)
+			if(mask & ((ULONGLONG)1 << b)) cpus++;
+		nodeMask[numNodes] = mask;
+		nodeCpus[numNodes] = cpus;
+		nodeId[numNodes] = n;
+		numNodes++;
+		totalCpus += cpus;
+	}
+	if(numNodes == 0)
+	{
+		printf("No NUMA node reports any processors\n");
+		return NULL;
+	}
+	if(maxThreads <= 0 || maxThreads > totalCpus)
+		maxThreads = totalCpus;
+	if(numNodes > maxThreads)
+		numNodes = maxThreads;		/* only nodes that get a worker */
+
+	pool = (numaPool *)calloc(1,sizeof(numaPool));
+	if(pool == NULL)
+	{
+		printf("Error allocating the NUMA pool\n");
+		return NULL;
+	}
+	pool->model = model;
+	pool->numNodes = numNodes;
+	pool->numThreads = maxThreads;
+	pool->replicate = replicate;
+	pool->worker = (numaWorker *)calloc(maxThreads,sizeof(numaWorker));
+	pool->doneEvent = CreateEvent(NULL,FALSE,FALSE,NULL);
+	pool->pending = maxThreads;
+	if(pool->worker == NULL || pool->doneEvent == NULL)
+	{
+		printf("Error allocating the NUMA pool\n");
+		numaPoolDestroy(pool);
+		return NULL;
+	}
+	for(n=0;n<numNodes;n++)
+		pool->nodeModel[n] = (struct svm_model *)model;
+
+	/* worker i goes to node i % numNodes, on that node's (i / numNodes)th CPU */
+	for(i=0;i<maxThreads;i++)
+	{
+		numaWorker *w = &pool->worker[i];
+		int node = i % numNodes;
+		int nth = (i / numNodes) % nodeCpus[node];
+		int b;
+
+		for(b=0;b<(int)(8*sizeof(DWORD_PTR));b++)
+			if((nodeMask[node] & ((ULONGLONG)1 << b)) && nth-- == 0)
+				break;
+		w->pool = pool;
+		w->index = i;
+		w->node = node;
+		w->nodeLeader = (i < numNodes);
+		w->cpuMask = (DWORD_PTR)1 << b;
+		w->startEvent = CreateEvent(NULL,FALSE,FALSE,NULL);
+		if(w->startEvent == NULL)
+		{
+			printf("Error creating the start event of NUMA pool thread %d\n",i);
+			numaPoolDestroy(pool);
+			return NULL;
+		}
+	}
+	for(i=0;i<maxThreads;i++)
+	{
+		pool->worker[i].thread = CreateThread(NULL,0,workerMain,&pool->worker[i],0,NULL);
+		if(pool->worker[i].thread == NULL)
+		{
+			printf("Error starting NUMA pool thread %d of %d\n",i,maxThreads);
+			numaPoolDestroy(pool);
+			return NULL;
+		}
+	}
+	WaitForSingleObject(pool->doneEvent,INFINITE);
+
+	if(replicate)
+		for(n=0;n<numNodes;n++)
+			if(pool->replica[n] == NULL)
+				printf("Node %d could not copy the model, it shares the original\n",nodeId[n]);
+	return pool;
+}
+
+void numaPoolDestroy(numaPool *pool)
+{
+	int i;
+
+	if(pool == NULL)
+		return;
+	pool->quit = TRUE;
+	/* a pool that failed to start has workers without a thread or event */
+	if(pool->worker != NULL)
+	{
+		for(i=0;i<pool->numThreads;i++)
+			if(pool->worker[i].thread != NULL)
+				SetEvent(pool->worker[i].startEvent);
+		for(i=0;i<pool->numThreads;i++)
+		{
+			if(pool->worker[i].thread != NULL)
+			{
+				WaitForSingleObject(pool->worker[i].thread,INFINITE);
+				CloseHandle(pool->worker[i].thread);
+			}
+			if(pool->worker[i].startEvent != NULL)
+				CloseHandle(pool->worker[i].startEvent);
+		}
+	}
+	for(i=0;i<pool->numNodes;i++)
+		svm_free_and_destroy_model(&pool->replica[i]);
+	if(pool->doneEvent != NULL)
+		CloseHandle(pool->doneEvent);
+	free(pool->worker);
+	free(pool);
+}
+
+int numaPoolNodes(const numaPool *pool)
+{
+	return pool->numNodes;
+}
+
+int numaPoolThreads(const numaPool *pool)
+{
+	return pool->numThreads;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      numaPoolPredict
+* Arguments: pool - the pool
+*            x - n test vectors
+*            n - number of vectors
+*            labels - receives the n predicted labels
+* Returns:   0
+*
+* Splits the vectors into one contiguous block per worker and blocks
+* until all of them are predicted.
+*
+***************************************************************************/
+int numaPoolPredict(numaPool *pool, struct svm_node *const *x, int n, double *labels)
+{
+	int i;
+
+	pool->x = x;
+	pool->n = n;
+	pool->labels = labels;
+	pool->pending = pool->numThreads;
+	for(i=0;i<pool->numThreads;i++)
+		SetEvent(pool->worker[i].startEvent);
+	WaitForSingleObject(pool->doneEvent,INFINITE);
+	return 0;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      numaPoolBenchmark
+* Arguments: model - model to predict with
+*            x - n test vectors
+*            n - number of vectors
+*            passes - times the vectors are predicted per measurement
+*            out - report destination
+* Returns:   0 on success, -1 on error
+*
+* Measures prediction throughput at 1, 2, 4 ... threads up to one per CPU,
+* each with the shared model and with one copy per node.
+*
+***************************************************************************/
+int numaPoolBenchmark(const struct svm_model *model, struct svm_node *const *x, int n,
+					  int passes, FILE *out)
+{
+	LARGE_INTEGER ticksPerSecond,tick1,tick2;
+	double *labels = (double *)malloc(n*sizeof(double));
+	numaPoolResult result[2];
+	int threads, maxThreads, r, p;
+	numaPool *pool;
+
+	if(labels == NULL || (pool = numaPoolCreate(model,0,FALSE)) == NULL)
+	{
+		free(labels);
+		return -1;
+	}
+	maxThreads = numaPoolThreads(pool);
+	fprintf(out,"NUMA Benchmark: %d Nodes, %d CPUs, %d Vectors x %d Passes\n",
+			numaPoolNodes(pool),maxThreads,n,passes);
+	fprintf(out,"Threads  Shared (pred/s)  Replicated (pred/s)  Speedup\n");
+	numaPoolDestroy(pool);
+
+	QueryPerformanceFrequency(&ticksPerSecond);
+	for(threads=1;;threads*=2)
+	{
+		if(threads > maxThreads)
+			threads = maxThreads;
+		for(r=0;r<2;r++)
+		{
+			pool = numaPoolCreate(model,threads,r);
+			if(pool == NULL)
+			{
+				printf("Error creating a %d thread NUMA pool\n",threads);
+				free(labels);
+				return -1;
+			}
+			numaPoolPredict(pool,x,n,labels);	/* warm up */
+			QueryPerformanceCounter(&tick1);
+			for(p=0;p<passes;p++)
+				numaPoolPredict(pool,x,n,labels);
+			QueryPerformanceCounter(&tick2);
+			result[r].threads = threads;
+			result[r].nodes = numaPoolNodes(pool);
+			result[r].replicated = r;
+			result[r].seconds = (double)(tick2.QuadPart-tick1.QuadPart)/ticksPerSecond.QuadPart;
+			result[r].predictsPerSec = (double)n*passes/result[r].seconds;
+			numaPoolDestroy(pool);
+		}
+		fprintf(out,"%7d  %15.0f  %19.0f  %7.3f\n",threads,result[0].predictsPerSec,
+				result[1].predictsPerSec,result[1].predictsPerSec/result[0].predictsPerSec);
+		if(threads == maxThreads)
+			break;
+	}
+	free(labels);
+	return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef _NUMA_POOL_H
+#define _NUMA_POOL_H
+
+#include <stdio.h>
+#include "svm.h"
+
+typedef struct numaPool numaPool;
+
+
+/* Function Prototypes */
+numaPool *numaPoolCreate(const struct svm_model *model, int maxThreads, int replicate);
+void numaPoolDestroy(numaPool *pool);
+int numaPoolNodes(const numaPool *pool);
+int numaPoolThreads(const numaPool *pool);
+int numaPoolPredict(numaPool *pool, struct svm_node *const *x, int n, double *labels);
+int numaPoolBenchmark(const struct svm_model *model, struct svm_node *const *x, int n,
+					  int passes, FILE *out);
+
+
+#endif /* _NUMA_POOL_H */
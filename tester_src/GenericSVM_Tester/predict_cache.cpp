@@ -0,0 +1,434 @@
+// predict_cache.cpp : Prediction memo cache for the CPU and FPGA paths.
+//
+// Streaming data frequently repeats the exact same feature vector (sensors
+// holding steady).  Each vector is quantized to its fp32 image, optionally
+// dropping low mantissa bits, and hashed.  A cache made by pcacheCreateDouble
+// keys on the double values instead, for callers that predict from doubles
+// and must not share a result between vectors with one fp32 image.  A hit
+// returns the memoized class
+// without running svm_predict or a UART round trip.  A miss leaves an
+// in-flight entry behind so identical requests arriving in the meantime wait
+// for that first result instead of computing it again.
+//
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "predict_cache.h"
+
+#define PCACHE_NIL		(-1)
+
+enum { ENTRY_FREE, ENTRY_PENDING, ENTRY_READY };
+
+typedef struct
+{
+	unsigned int hash;
+	int state;
+	int label;
+	double time;
+	int chainNext;			/* next entry in the same hash bucket          */
+	int lruPrev, lruNext;	/* READY entries only, lruHead is most recent  */
+} pcacheEntry;
+
+struct predictCache
+{
+	int capacity;
+	int numFeatures;
+	int doubleKey;			/* features are double, two key words each */
+	int keyWords;			/* key words per vector */
+	unsigned int quantMask;
+	unsigned long long quantMask64;
+	unsigned int bucketMask;
+	int *bucket;
+	pcacheEntry *entry;
+	unsigned int *keys;		/* capacity x keyWords quantized words */
+	int *freeSlot;
+	int numFree;
+	int lruHead, lruTail;
+	predictCacheStats stats;
+	CRITICAL_SECTION lock;
+};
+
+
+static unsigned int quantize(const predictCache *cache, float value)
+{
+	unsigned int word;
+
+	memcpy(&word,&value,sizeof(word));
+	if((word & 0x7fffffff) == 0) word = 0;	/* -0.0 and +0.0 share a key */
+	return word & cache->quantMask;
+}
+
+/* Key word w of a float or double vector */
+static unsigned int keyWord(const predictCache *cache, const void *features, int w)
+{
+	unsigned long long word;
+	double value;
+
+	if(!cache->doubleKey)
+		return quantize(cache,((const float *)features)[w]);
+	value = ((const double *)features)[w >> 1];
+	memcpy(&word,&value,sizeof(word));
+	if((word & 0x7fffffffffffffffULL) == 0) word = 0;
+	word &= cache->quantMask64;
+	return (w & 1) ? (unsigned int)(word >> 32) : (unsigned int)word;
+}
+
+static unsigned int hashKey(const predictCache *cache, const void *features)
+{
+	unsigned int h = 0x811c9dc5;
+	int i;
+
+	for(i=0;i<cache->keyWords;i++)
+		h = (h ^ keyWord(cache,features,i)) * 0x9e3779b1;
+	h ^= h >> 15;
+	return h;
+}
+
+static int keyEquals(const predictCache *cache, int slot, const void *features)
+{
+	const unsigned int *key = &cache->keys[slot*cache->keyWords];
+	int i;
+
+	for(i=0;i<cache->keyWords;i++)
+		if(key[i] != keyWord(cache,features,i))
+			return FALSE;
+	return TRUE;
+}
+
+static int findEntry(const predictCache *cache, unsigned int hash, const void *features)
+{
+	int slot = cache->bucket[hash & cache->bucketMask];
+
+	while(slot != PCACHE_NIL)
+	{
+		if(cache->entry[slot].hash == hash && keyEquals(cache,slot,features))
+			return slot;
+		slot = cache->entry[slot].chainNext;
+	}
+	return PCACHE_NIL;
+}
+
+static void lruUnlink(predictCache *cache, int slot)
+{
+	pcacheEntry *e = &cache->entry[slot];
+
+	if(e->lruPrev != PCACHE_NIL) cache->entry[e->lruPrev].lruNext = e->lruNext;
+	else cache->lruHead = e->lruNext;
+	if(e->lruNext != PCACHE_NIL) cache->entry[e->lruNext].lruPrev = e->lruPrev;
+	else cache->lruTail = e->lruPrev;
+}
+
+static void lruPushFront(predictCache *cache, int slot)
+{
+	pcacheEntry *e = &cache->entry[slot];
+
+	e->lruPrev = PCACHE_NIL;
+	e->lruNext = cache->lruHead;
+	if(cache->lruHead != PCACHE_NIL) cache->entry[cache->lruHead].lruPrev = slot;
+	else cache->lruTail = slot;
+	cache->lruHead = slot;
+}
+
+static void bucketUnlink(predictCache *cache, int slot)
+{
+	int *link = &cache->bucket[cache->entry[slot].hash & cache->bucketMask];
+
+	while(*link != slot)
+		link = &cache->entry[*link].chainNext;
+	*link = cache->entry[slot].chainNext;
+}
+
+static void releaseSlot(predictCache *cache, int slot)
+{
+	bucketUnlink(cache,slot);
+	cache->entry[slot].state = ENTRY_FREE;
+	cache->freeSlot[cache->numFree++] = slot;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      pcacheCreate
+* Arguments: capacity - maximum number of memoized vectors
+*            numFeatures - length of every feature vector
+*            quantBits - low fp32 mantissa bits ignored by the key, 0 (exact)
+*                        to 22 (sign, exponent and top mantissa bit); values
+*                        above 22 are clamped to 22
+* Returns:   new cache, NULL on allocation failure
+*
+***************************************************************************/
+static predictCache *createCache(int capacity, int numFeatures, int quantBits, int doubleKey)
+{
+	predictCache *cache;
+	int numBuckets = 1;
+
+	if(capacity <= 0 || numFeatures <= 0)
+		return NULL;
+	while(numBuckets < 2*capacity)
+		numBuckets <<= 1;
+
+	if(!(cache = (predictCache *)calloc(1,sizeof(predictCache))))
+		return NULL;
+	cache->capacity = capacity;
+	cache->numFeatures = numFeatures;
+	cache->doubleKey = doubleKey;
+	cache->keyWords = doubleKey ? 2*numFeatures : numFeatures;
+	if(quantBits > 22)
+		quantBits = 22;
+	cache->quantMask = quantBits > 0 ? ~((1u << quantBits) - 1) : 0xffffffff;
+	/* a double keeps as many mantissa bits as the fp32 key, 29 more dropped */
+	cache->quantMask64 = quantBits > 0 ? ~((1ULL << (quantBits+29)) - 1) : ~0ULL;
+	cache->bucketMask = numBuckets - 1;
+	cache->bucket = (int *)malloc(numBuckets*sizeof(int));
+	cache->entry = (pcacheEntry *)malloc(capacity*sizeof(pcacheEntry));
+	cache->keys = (unsigned int *)malloc(capacity*cache->keyWords*sizeof(unsigned int));
+	cache->freeSlot = (int *)malloc(capacity*sizeof(int));
+	if(!cache->bucket || !cache->entry || !cache->keys || !cache->freeSlot)
+	{
+		printf("ERROR allocating prediction cache of %d entries!!\n",capacity);
+		pcacheDestroy(cache);
+		return NULL;
+	}
+	InitializeCriticalSection(&cache->lock);
+	pcacheClear(cache);
+
+	return cache;
+}
+
+predictCache *pcacheCreate(int capacity, int numFeatures, int quantBits)
+{
+	return createCache(capacity,numFeatures,quantBits,FALSE);
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      pcacheCreateDouble
+* Arguments: as pcacheCreate
+* Returns:   new cache, NULL on allocation failure
+*
+* The cache is used through pcacheLookupDouble, pcacheFillDouble and
+* pcacheAbandonDouble.  quantBits 0 keys on the exact doubles; otherwise
+* each double keeps as many mantissa bits as the fp32 key would.
+*
+***************************************************************************/
+predictCache *pcacheCreateDouble(int capacity, int numFeatures, int quantBits)
+{
+	return createCache(capacity,numFeatures,quantBits,TRUE);
+}
+
+
+
+
+void pcacheDestroy(predictCache *cache)
+{
+	if(cache == NULL)
+		return;
+	if(cache->bucket && cache->entry && cache->keys && cache->freeSlot)
+		DeleteCriticalSection(&cache->lock);
+	free(cache->bucket);
+	free(cache->entry);
+	free(cache->keys);
+	free(cache->freeSlot);
+	free(cache);
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      pcacheClear
+* Arguments: cache
+* Returns:   ---
+*
+* Drops every entry and zeroes the counters.  Call whenever the model
+* behind the cache changes, and never while requests are in flight.
+*
+***************************************************************************/
+void pcacheClear(predictCache *cache)
+{
+	int i;
+
+	for(i=0;i<=(int)cache->bucketMask;i++)
+		cache->bucket[i] = PCACHE_NIL;
+	for(i=0;i<cache->capacity;i++)
+	{
+		cache->entry[i].state = ENTRY_FREE;
+		cache->freeSlot[i] = cache->capacity - 1 - i;
+	}
+	cache->numFree = cache->capacity;
+	cache->lruHead = cache->lruTail = PCACHE_NIL;
+	memset(&cache->stats,0,sizeof(cache->stats));
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      pcacheLookup
+* Arguments: cache, features - vector about to be classified
+*            label, time - receive the memoized result on a hit
+* Returns:   PCACHE_HIT, PCACHE_MISS or PCACHE_BYPASS
+*
+* On PCACHE_MISS the caller owns a new in-flight entry and must complete it
+* with pcacheFill (or pcacheAbandon if the prediction failed).  Lookups of
+* the same vector from other threads block until then and return a hit.
+*
+***************************************************************************/
+static int lookupKey(predictCache *cache, const void *features, int *label, double *time)
+{
+	unsigned int hash = hashKey(cache,features);
+	int waited = FALSE;
+	int slot;
+
+	EnterCriticalSection(&cache->lock);
+	cache->stats.lookups++;
+	while((slot = findEntry(cache,hash,features)) != PCACHE_NIL)
+	{
+		pcacheEntry *e = &cache->entry[slot];
+
+		if(e->state == ENTRY_READY)
+		{
+			lruUnlink(cache,slot);
+			lruPushFront(cache,slot);
+			*label = e->label;
+			*time = e->time;
+			cache->stats.hits++;
+			if(waited)
+				cache->stats.coalesced++;
+			LeaveCriticalSection(&cache->lock);
+			return PCACHE_HIT;
+		}
+
+		/* Identical request in flight, let its owner finish */
+		waited = TRUE;
+		LeaveCriticalSection(&cache->lock);
+		SwitchToThread();
+		EnterCriticalSection(&cache->lock);
+	}
+
+	if(cache->numFree > 0)
+		slot = cache->freeSlot[--cache->numFree];
+	else if(cache->lruTail != PCACHE_NIL)
+	{
+		slot = cache->lruTail;
+		lruUnlink(cache,slot);
+		bucketUnlink(cache,slot);
+		cache->stats.evictions++;
+	}
+	else
+	{
+		cache->stats.bypassed++;
+		LeaveCriticalSection(&cache->lock);
+		return PCACHE_BYPASS;
+	}
+
+	{
+		pcacheEntry *e = &cache->entry[slot];
+		unsigned int *key = &cache->keys[slot*cache->keyWords];
+		int i;
+
+		for(i=0;i<cache->keyWords;i++)
+			key[i] = keyWord(cache,features,i);
+		e->hash = hash;
+		e->state = ENTRY_PENDING;
+		e->chainNext = cache->bucket[hash & cache->bucketMask];
+		cache->bucket[hash & cache->bucketMask] = slot;
+	}
+	cache->stats.misses++;
+	LeaveCriticalSection(&cache->lock);
+
+	return PCACHE_MISS;
+}
+
+int pcacheLookup(predictCache *cache, const float *features, int *label, double *time)
+{
+	return lookupKey(cache,features,label,time);
+}
+
+int pcacheLookupDouble(predictCache *cache, const double *features, int *label, double *time)
+{
+	return lookupKey(cache,features,label,time);
+}
+
+
+
+
+static void fillKey(predictCache *cache, const void *features, int label, double time)
+{
+	unsigned int hash = hashKey(cache,features);
+	int slot;
+
+	EnterCriticalSection(&cache->lock);
+	slot = findEntry(cache,hash,features);
+	if(slot != PCACHE_NIL && cache->entry[slot].state == ENTRY_PENDING)
+	{
+		cache->entry[slot].label = label;
+		cache->entry[slot].time = time;
+		cache->entry[slot].state = ENTRY_READY;
+		lruPushFront(cache,slot);
+	}
+	LeaveCriticalSection(&cache->lock);
+}
+
+void pcacheFill(predictCache *cache, const float *features, int label, double time)
+{
+	fillKey(cache,features,label,time);
+}
+
+void pcacheFillDouble(predictCache *cache, const double *features, int label, double time)
+{
+	fillKey(cache,features,label,time);
+}
+
+
+
+
+static void abandonKey(predictCache *cache, const void *features)
+{
+	unsigned int hash = hashKey(cache,features);
+	int slot;
+
+	EnterCriticalSection(&cache->lock);
+	slot = findEntry(cache,hash,features);
+	if(slot != PCACHE_NIL && cache->entry[slot].state == ENTRY_PENDING)
+		releaseSlot(cache,slot);
+	LeaveCriticalSection(&cache->lock);
+}
+
+void pcacheAbandon(predictCache *cache, const float *features)
+{
+	abandonKey(cache,features);
+}
+
+void pcacheAbandonDouble(predictCache *cache, const double *features)
+{
+	abandonKey(cache,features);
+}
+
+
+
+
+void pcacheGetStats(predictCache *cache, predictCacheStats *stats)
+{
+	EnterCriticalSection(&cache->lock);
+	*stats = cache->stats;
+	LeaveCriticalSection(&cache->lock);
+}
+
+
+
+
+double pcacheHitRate(const predictCacheStats *stats)
+{
+	if(stats->lookups == 0)
+		return 0.0;
+	return (double)stats->hits/(double)stats->lookups;
+}
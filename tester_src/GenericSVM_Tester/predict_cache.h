@@ -0,0 +1,37 @@
+#ifndef _PREDICT_CACHE_H
+#define _PREDICT_CACHE_H
+
+/* Lookup Results */
+#define PCACHE_HIT		0	/* label/time hold the memoized result                   */
+#define PCACHE_MISS		1	/* caller owns the entry, must pcacheFill or pcacheAbandon */
+#define PCACHE_BYPASS	2	/* every slot is in flight, predict without the cache      */
+
+typedef struct predictCache predictCache;
+
+typedef struct
+{
+	unsigned long lookups;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long coalesced;	/* hits that waited on an identical in-flight request */
+	unsigned long evictions;
+	unsigned long bypassed;
+} predictCacheStats;
+
+
+/* Function Prototypes */
+predictCache *pcacheCreate(int capacity, int numFeatures, int quantBits);
+predictCache *pcacheCreateDouble(int capacity, int numFeatures, int quantBits);
+void pcacheDestroy(predictCache *cache);
+void pcacheClear(predictCache *cache);
+int pcacheLookup(predictCache *cache, const float *features, int *label, double *time);
+void pcacheFill(predictCache *cache, const float *features, int label, double time);
+void pcacheAbandon(predictCache *cache, const float *features);
+int pcacheLookupDouble(predictCache *cache, const double *features, int *label, double *time);
+void pcacheFillDouble(predictCache *cache, const double *features, int label, double time);
+void pcacheAbandonDouble(predictCache *cache, const double *features);
+void pcacheGetStats(predictCache *cache, predictCacheStats *stats);
+double pcacheHitRate(const predictCacheStats *stats);
+
+
+#endif /* _PREDICT_CACHE_H */
@@ -5,7 +5,25 @@
 #include <float.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "svm.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define SVM_CACHE_SSE2
+#include <emmintrin.h>
+#endif
 
 #undef DBG_COEFF   //Coefficient debug define
 #undef DBG_COEFF_FPCOMP
@@ -31,6 +49,11 @@ FILE* summaryout = NULL;
 int libsvm_version = LIBSVM_VERSION;
 typedef float Qfloat;
 typedef signed char schar;
+
+// kernel columns at least this long are filled on several threads
+#define KERNEL_PARALLEL_LEN 1024
+// feature indices below this are gathered from a dense buffer of doubles
+#define KERNEL_DENSE_MAX (1<<22)
 #ifndef min
 template <class T> static inline T min(T x,T y) { return (x<y)?x:y; }
 #endif
@@ -84,92 +107,214 @@ static void info(const char *fmt,...) {}
 // l is the number of total data items
 // size is the cache size limit in bytes
 //
+// The cache is one slab of equal slots, each large enough for a full
+// column, taken when the cache is built.  The LRU list is threaded
+// through the slots by index, and a column holds its slot until it is
+// evicted, so no memory is allocated or freed while solving.
+//
+// swap_index only records the swap.  A cached column catches up on the
+// swaps made since it was last touched when it is next requested, and all
+// of them are applied when the log is full.  A column that ends between
+// the two swapped rows is cut short at the first, not dropped.
+//
+// With SVM_CACHE_FP16 or SVM_CACHE_BF16 the slots hold 16-bit values, so
+// twice as many columns fit.  The Q matrix then encodes what it fills and
+// decodes the column into a buffer of Qfloat on every request.
+//
 class Cache
 {
 public:
-	Cache(int l,long int size);
+	Cache(int l,long int size,int precision = SVM_CACHE_FLOAT);
 	~Cache();
 
 	// request data [0,len)
 	// return some position p where [p,len) need to be filled
 	// (p >= len if nothing needs to be filled)
 	int get_data(const int index, Qfloat **data, int len);
+	int get_data(const int index, uint16_t **data, int len);	// 16-bit precisions
 	void swap_index(int i, int j);	
+	int get_precision() const { return precision; }
 private:
 	int l;
-	long int size;
+	int precision;
+	int elem;		// bytes per value
+	int nr_slot;
+	char *slab;		// nr_slot columns of l values
 	struct head_t
 	{
-		head_t *prev, *next;	// a circular list
-		Qfloat *data;
-		int len;		// data[0,len) is cached in this entry
+		int slot;	// -1 if not cached
+		int len;	// data[0,len) is cached in this entry
+		int synced;	// swaps log[0,synced) have been applied
+	};
+	struct slot_t
+	{
+		int prev, next;	// a circular list, nr_slot is the list head
+		int owner;	// column held, -1 if free
 	};
 
 	head_t *head;
-	head_t lru_head;
-	void lru_delete(head_t *h);
-	void lru_insert(head_t *h);
+	slot_t *slot;
+	int nr_free;
+	int *free_slot;
+
+	int *log_i, *log_j;	// pending swaps, log_i[k] < log_j[k]
+	int log_len, log_cap;
+
+	svm_cache_stats stats;
+
+	void lru_delete(int s);
+	void lru_insert(int s);
+	void catch_up(head_t *h);
+	void flush_log();
+	char *get_slot(const int index, int *len);
 };
 
-Cache::Cache(int l_,long int size_):l(l_),size(size_)
+// totals of every Cache since the last svm_get_cache_stats with reset
+static svm_cache_stats cache_stats_total;
+static int cache_precision = SVM_CACHE_FLOAT;
+
+Cache::Cache(int l_,long int size_,int precision_):l(l_),precision(precision_)
 {
-	head = (head_t *)calloc(l,sizeof(head_t));	// initialized to 0
-	size /= sizeof(Qfloat);
-	size -= l * sizeof(head_t) / sizeof(Qfloat);
-	size = max(size, 2 * (long int) l);	// cache must be large enough for two columns
-	lru_head.next = lru_head.prev = &lru_head;
+	elem = precision == SVM_CACHE_FLOAT ? sizeof(Qfloat) : sizeof(uint16_t);
+	long int columns = (size_ - l * (long int)sizeof(head_t)) / ((long int)elem * l);
+	nr_slot = (int)max(2L, min(columns, (long int)l));	// cache must be large enough for two columns
+	slab = Malloc(char,(size_t)nr_slot*l*elem);
+
+	head = Malloc(head_t,l);
+	for(int i=0;i<l;i++)
+	{
+		head[i].slot = -1;
+		head[i].len = 0;
+		head[i].synced = 0;
+	}
+	slot = Malloc(slot_t,nr_slot+1);
+	free_slot = Malloc(int,nr_slot);
+	for(int s=0;s<nr_slot;s++)
+	{
+		slot[s].owner = -1;
+		free_slot[s] = nr_slot-1-s;
+	}
+	nr_free = nr_slot;
+	slot[nr_slot].next = slot[nr_slot].prev = nr_slot;
+
+	log_cap = max(l,1024);
+	log_i = Malloc(int,log_cap);
+	log_j = Malloc(int,log_cap);
+	log_len = 0;
+
+	stats.hits = stats.misses = stats.evictions = 0;
 }
 
 Cache::~Cache()
 {
-	for(head_t *h = lru_head.next; h != &lru_head; h=h->next)
-		free(h->data);
+#pragma omp critical(svm_cache_stats)
+	{
+		cache_stats_total.hits += stats.hits;
+		cache_stats_total.misses += stats.misses;
+		cache_stats_total.evictions += stats.evictions;
+	}
+	free(slab);
 	free(head);
+	free(slot);
+	free(free_slot);
+	free(log_i);
+	free(log_j);
 }
 
-void Cache::lru_delete(head_t *h)
+void Cache::lru_delete(int s)
 {
 	// delete from current location
-	h->prev->next = h->next;
-	h->next->prev = h->prev;
+	slot[slot[s].prev].next = slot[s].next;
+	slot[slot[s].next].prev = slot[s].prev;
 }
 
-void Cache::lru_insert(head_t *h)
+void Cache::lru_insert(int s)
 {
 	// insert to last position
-	h->next = &lru_head;
-	h->prev = lru_head.prev;
-	h->prev->next = h;
-	h->next->prev = h;
+	slot[s].next = nr_slot;
+	slot[s].prev = slot[nr_slot].prev;
+	slot[slot[s].prev].next = s;
+	slot[nr_slot].prev = s;
 }
 
-int Cache::get_data(const int index, Qfloat **data, int len)
+void Cache::catch_up(head_t *h)
 {
-	head_t *h = &head[index];
-	if(h->len) lru_delete(h);
-	int more = len - h->len;
+	char *data = slab + (size_t)h->slot*l*elem;
+	for(int k=h->synced;k<log_len;k++)
+	{
+		if(h->len > log_j[k])
+		{
+			if(elem == sizeof(Qfloat))
+				swap(((Qfloat *)data)[log_i[k]],((Qfloat *)data)[log_j[k]]);
+			else
+				swap(((uint16_t *)data)[log_i[k]],((uint16_t *)data)[log_j[k]]);
+		}
+		else if(h->len > log_i[k])
+			h->len = log_i[k];
+	}
+	h->synced = log_len;
+}
+
+void Cache::flush_log()
+{
+	for(int s=slot[nr_slot].next;s!=nr_slot;s=slot[s].next)
+	{
+		catch_up(&head[slot[s].owner]);
+		head[slot[s].owner].synced = 0;
+	}
+	log_len = 0;
+}
 
-	if(more > 0)
+// the slot of column index, *len becomes the position to fill from
+char *Cache::get_slot(const int index, int *len)
+{
+	head_t *h = &head[index];
+	if(h->slot >= 0)
 	{
-		// free old space
-		while(size < more)
+		catch_up(h);
+		lru_delete(h->slot);
+	}
+	else
+	{
+		// take a free slot or the least recently used one
+		int s;
+		if(nr_free > 0)
+			s = free_slot[--nr_free];
+		else
 		{
-			head_t *old = lru_head.next;
-			lru_delete(old);
-			free(old->data);
-			size += old->len;
-			old->data = 0;
+			s = slot[nr_slot].next;
+			lru_delete(s);
+			head_t *old = &head[slot[s].owner];
+			old->slot = -1;
 			old->len = 0;
+			++stats.evictions;
 		}
+		slot[s].owner = index;
+		h->slot = s;
+		h->len = 0;
+		h->synced = log_len;
+	}
+	lru_insert(h->slot);
 
-		// allocate new space
-		h->data = (Qfloat *)realloc(h->data,sizeof(Qfloat)*len);
-		size -= more;
-		swap(h->len,len);
+	if(h->len >= *len)
+		++stats.hits;
+	else
+	{
+		++stats.misses;
+		swap(h->len,*len);
 	}
+	return slab + (size_t)h->slot*l*elem;
+}
 
-	lru_insert(h);
-	*data = h->data;
+int Cache::get_data(const int index, Qfloat **data, int len)
+{
+	*data = (Qfloat *)get_slot(index,&len);
+	return len;
+}
+
+int Cache::get_data(const int index, uint16_t **data, int len)
+{
+	*data = (uint16_t *)get_slot(index,&len);
 	return len;
 }
 
@@ -177,31 +322,202 @@ void Cache::swap_index(int i, int j)
 {
 	if(i==j) return;
 
-	if(head[i].len) lru_delete(&head[i]);
-	if(head[j].len) lru_delete(&head[j]);
-	swap(head[i].data,head[j].data);
-	swap(head[i].len,head[j].len);
-	if(head[i].len) lru_insert(&head[i]);
-	if(head[j].len) lru_insert(&head[j]);
+	swap(head[i],head[j]);
+	if(head[i].slot >= 0) slot[head[i].slot].owner = i;
+	if(head[j].slot >= 0) slot[head[j].slot].owner = j;
 
 	if(i>j) swap(i,j);
-	for(head_t *h = lru_head.next; h!=&lru_head; h=h->next)
+	if(log_len == log_cap)
+		flush_log();
+	log_i[log_len] = i;
+	log_j[log_len] = j;
+	++log_len;
+}
+
+int svm_set_cache_precision(int precision)
+{
+	if(precision != SVM_CACHE_FLOAT && precision != SVM_CACHE_FP16 && precision != SVM_CACHE_BF16)
+		return -1;
+	cache_precision = precision;
+	return 0;
+}
+
+//
+// 16-bit cache values
+//
+// bf16 is the upper half of a float, fp16 is IEEE half precision.  Both
+// are rounded to nearest even.  fp16 saturates at 65504, so it suits
+// kernels whose values stay well inside that, such as RBF.
+//
+static inline uint16_t float_to_bf16(Qfloat f)
+{
+	uint32_t u;
+	memcpy(&u,&f,sizeof(u));
+	u += 0x7fff + ((u >> 16) & 1);
+	return (uint16_t)(u >> 16);
+}
+
+static inline Qfloat bf16_to_float(uint16_t h)
+{
+	uint32_t u = (uint32_t)h << 16;
+	Qfloat f;
+	memcpy(&f,&u,sizeof(f));
+	return f;
+}
+
+static inline uint16_t float_to_fp16(Qfloat f)
+{
+	uint32_t u;
+	memcpy(&u,&f,sizeof(u));
+	uint16_t sign = (uint16_t)((u >> 16) & 0x8000);
+	u &= 0x7fffffff;
+
+	if(u >= 0x477ff000)		// rounds past 65504
+		return sign | 0x7bff;
+	if(u < 0x38800000)		// subnormal: let the float add round it
+	{
+		Qfloat a;
+		memcpy(&a,&u,sizeof(a));
+		a += 0.5f;
+		memcpy(&u,&a,sizeof(u));
+		return sign | (uint16_t)(u - 0x3f000000);
+	}
+	u += ((uint32_t)(15-127) << 23) + 0xfff + ((u >> 13) & 1);
+	return sign | (uint16_t)(u >> 13);
+}
+
+static inline Qfloat fp16_to_float(uint16_t h)
+{
+	const uint32_t magic_bits = (254-15) << 23;	// 2^112
+	Qfloat magic, f;
+	uint32_t u = (uint32_t)(h & 0x7fff) << 13;
+	memcpy(&magic,&magic_bits,sizeof(magic));
+	memcpy(&f,&u,sizeof(f));
+	f *= magic;
+	memcpy(&u,&f,sizeof(u));
+	if((h & 0x7fff) >= 0x7c00)	// inf or nan
+		u |= 255 << 23;
+	u |= (uint32_t)(h & 0x8000) << 16;
+	memcpy(&f,&u,sizeof(f));
+	return f;
+}
+
+static void cache_encode(int precision, const Qfloat *in, uint16_t *out, int n)
+{
+	int k;
+	if(precision == SVM_CACHE_BF16)
+		for(k=0;k<n;k++)
+			out[k] = float_to_bf16(in[k]);
+	else
+		for(k=0;k<n;k++)
+			out[k] = float_to_fp16(in[k]);
+}
+
+// the decode runs on every request, so SSE2 widens 8 values at a time
+static void cache_decode(int precision, const uint16_t *in, Qfloat *out, int n)
+{
+	int k = 0;
+#ifdef SVM_CACHE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	if(precision == SVM_CACHE_BF16)
 	{
-		if(h->len > i)
+		for(;k+8<=n;k+=8)
 		{
-			if(h->len > j)
-				swap(h->data[i],h->data[j]);
-			else
+			__m128i h = _mm_loadu_si128((const __m128i *)(in+k));
+			_mm_storeu_si128((__m128i *)(out+k),_mm_unpacklo_epi16(zero,h));
+			_mm_storeu_si128((__m128i *)(out+k+4),_mm_unpackhi_epi16(zero,h));
+		}
+	}
+	else
+	{
+		const __m128i mask_nosign = _mm_set1_epi32(0x7fff);
+		const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254-15) << 23));
+		const __m128i was_infnan = _mm_set1_epi32(0x7bff);
+		const __m128i exp_infnan = _mm_set1_epi32(255 << 23);
+		for(;k+8<=n;k+=8)
+		{
+			__m128i h = _mm_loadu_si128((const __m128i *)(in+k));
+			for(int half=0;half<2;half++)
 			{
-				// give up
-				lru_delete(h);
-				free(h->data);
-				size += h->len;
-				h->data = 0;
-				h->len = 0;
+				__m128i v = half ? _mm_unpackhi_epi16(h,zero) : _mm_unpacklo_epi16(h,zero);
+				__m128i expmant = _mm_and_si128(v,mask_nosign);
+				__m128i sign = _mm_slli_epi32(_mm_xor_si128(v,expmant),16);
+				__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant,13)),magic);
+				__m128i infnan = _mm_and_si128(_mm_cmpgt_epi32(expmant,was_infnan),exp_infnan);
+				__m128i f = _mm_or_si128(_mm_castps_si128(scaled),_mm_or_si128(sign,infnan));
+				_mm_storeu_si128((__m128i *)(out+k+4*half),f);
 			}
 		}
 	}
+#endif
+	if(precision == SVM_CACHE_BF16)
+		for(;k<n;k++)
+			out[k] = bf16_to_float(in[k]);
+	else
+		for(;k<n;k++)
+			out[k] = fp16_to_float(in[k]);
+}
+
+void svm_get_cache_stats(svm_cache_stats *stats, int reset)
+{
+#pragma omp critical(svm_cache_stats)
+	{
+		*stats = cache_stats_total;
+		if(reset)
+			cache_stats_total.hits = cache_stats_total.misses = cache_stats_total.evictions = 0;
+	}
+}
+
+//
+// Problem views
+//
+// svm_train, the cross validations and the solvers read a problem through
+// an svm_view.  Its rows are two ranges: rows [0,split) come from x[0] and
+// y[0], the rest from x[1] and y[1].  A one-vs-one pair is two class
+// ranges of the grouped data, and a fold is the rows on either side of
+// the held-out ones, so neither needs arrays of its own.  A NULL y labels
+// its range +1 for the first and -1 for the second.  When the sub-problem
+// shares a Kernel_Segments, pos gives each row's number in it.
+//
+struct svm_view
+{
+	int l;
+	int split;
+	svm_node * const *x[2];
+	const double *y[2];
+	const int *pos[2];	// NULL without a Kernel_Segments
+
+	svm_node *row(int i) const { return i < split ? x[0][i] : x[1][i-split]; }
+	int position(int i) const { return i < split ? pos[0][i] : pos[1][i-split]; }
+	double label(int i) const
+	{
+		if(i < split)
+			return y[0] ? y[0][i] : +1;
+		return y[1] ? y[1][i-split] : -1;
+	}
+};
+
+static void view_ranges(svm_view *view, svm_node * const *x0, const double *y0, int l0,
+			svm_node * const *x1, const double *y1, int l1)
+{
+	view->l = l0+l1;
+	view->split = l0;
+	view->x[0] = x0;
+	view->y[0] = y0;
+	view->x[1] = x1;
+	view->y[1] = y1;
+	view->pos[0] = view->pos[1] = NULL;
+}
+
+static void view_positions(svm_view *view, const int *pos0, const int *pos1)
+{
+	view->pos[0] = pos0;
+	view->pos[1] = pos1;
+}
+
+static void view_problem(svm_view *view, const svm_problem *prob)
+{
+	view_ranges(view,prob->x,prob->y,prob->l,NULL,NULL,0);
 }
 
 //
@@ -222,6 +538,7 @@ public:
 class Kernel: public QMatrix {
 public:
 	Kernel(int l, svm_node * const * x, const svm_parameter& param);
+	Kernel(const svm_view& prob, const svm_parameter& param);
 	virtual ~Kernel();
 
 	static double k_function(const svm_node *x, const svm_node *y,
@@ -236,10 +553,15 @@ public:
 protected:
 
 	double (Kernel::*kernel_function)(int i, int j) const;
+	void fill_column(int i, const schar *y, Qfloat *data, int start, int len,
+			 bool cross_only = false) const;
 
 private:
 	const svm_node **x;
 	double *x_square;
+	double *dense;		// x[i] scattered by feature index for fill_column, NULL if not used
+
+	void init(int l);
 
 	// svm_parameter
 	const int kernel_type;
@@ -273,6 +595,22 @@ private:
 Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 :kernel_type(param.kernel_type), degree(param.degree),
  gamma(param.gamma), coef0(param.coef0)
+{
+	clone(x,x_,l);
+	init(l);
+}
+
+Kernel::Kernel(const svm_view& prob, const svm_parameter& param)
+:kernel_type(param.kernel_type), degree(param.degree),
+ gamma(param.gamma), coef0(param.coef0)
+{
+	x = new const svm_node *[prob.l];
+	for(int i=0;i<prob.l;i++)
+		x[i] = prob.row(i);
+	init(prob.l);
+}
+
+void Kernel::init(int l)
 {
 	switch(kernel_type)
 	{
@@ -293,8 +631,6 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			break;
 	}
 
-	clone(x,x_,l);
-
 	if(kernel_type == RBF)
 	{
 		x_square = new double[l];
@@ -303,12 +639,169 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 	}
 	else
 		x_square = 0;
+
+	// a zeroed buffer covering every feature index, unless the
+	// indices are negative or too sparse to be worth one
+	dense = 0;
+	if(kernel_type != PRECOMPUTED)
+	{
+		int max_index = 0;
+		bool usable = true;
+		for(int i=0;i<l && usable;i++)
+			for(const svm_node *p=x[i];p->index!=-1;p++)
+			{
+				if(p->index < 0 || p->index >= KERNEL_DENSE_MAX)
+				{
+					usable = false;
+					break;
+				}
+				if(p->index > max_index)
+					max_index = p->index;
+			}
+		if(usable)
+		{
+			dense = new double[max_index+1];
+			for(int k=0;k<=max_index;k++)
+				dense[k] = 0;
+		}
+	}
 }
 
 Kernel::~Kernel()
 {
 	delete[] x;
 	delete[] x_square;
+	delete[] dense;
+}
+
+//
+// Kernel column fill
+//
+// Fills data[0..len-start) with y[i]*y[j]*K(i,j) for j in [start,len), or
+// K(i,j) when y is NULL.  cross_only skips the j with y[j] == y[i].
+// x[i] is scattered into dense once and each x[j] is gathered against it,
+// in place of a sparse merge per j.  The products are summed in the same
+// index order as dot, so the column is the same as the merge gives.
+// Columns of KERNEL_PARALLEL_LEN or more are split across OpenMP threads.
+//
+void Kernel::fill_column(int i, const schar *y, Qfloat *data, int start, int len,
+			 bool cross_only) const
+{
+	int j;
+	if(dense == 0)
+	{
+		for(j=start;j<len;j++)
+		{
+			if(cross_only && y[j] == y[i])
+				continue;
+			double s = y ? y[i]*y[j] : 1;
+			data[j-start] = (Qfloat)(s*(this->*kernel_function)(i,j));
+		}
+		return;
+	}
+
+	const svm_node *px;
+	for(px=x[i];px->index!=-1;px++)
+		dense[px->index] = px->value;
+
+#pragma omp parallel for schedule(static) if(len-start >= KERNEL_PARALLEL_LEN)
+	for(j=start;j<len;j++)
+	{
+		if(cross_only && y[j] == y[i])
+			continue;
+		double sum = 0;
+		for(const svm_node *py=x[j];py->index!=-1;py++)
+			sum += dense[py->index] * py->value;
+
+		double k;
+		switch(kernel_type)
+		{
+			case LINEAR:
+				k = sum;
+				break;
+			case POLY:
+				k = powi(gamma*sum+coef0,degree);
+				break;
+			case RBF:
+				k = exp(-gamma*(x_square[i]+x_square[j]-2*sum));
+				break;
+			default:	// SIGMOID
+				k = tanh(gamma*sum+coef0);
+				break;
+		}
+		double s = y ? y[i]*y[j] : 1;
+		data[j-start] = (Qfloat)(s*k);
+	}
+
+	for(px=x[i];px->index!=-1;px++)
+		dense[px->index] = 0;
+}
+
+//
+// Shared within-class kernel values
+//
+// Each one-vs-one pair of a classifier builds its own Kernel, so the
+// values between two points of the same class used to be computed again
+// in each of the k-1 pairs that class is in.  Kernel_Segments is built
+// once by svm_train on the class-grouped data.  For each point it holds
+// the kernel values against every point of the same class.  SVC_Q takes
+// the same-class part of a missed column from here and computes only the
+// cross-class part.  Rows are made on first use until size bytes are
+// used; beyond that the pairs compute the values themselves.  Rows are
+// made under a lock, as the pairs may run on several threads.
+//
+class Kernel_Segments: public Kernel
+{
+public:
+	Kernel_Segments(int l, svm_node * const * x, const svm_parameter& param,
+			const int *class_of, const int *start, const int *count, double size);
+	~Kernel_Segments();
+
+	const Qfloat *get_row(int a);	// NULL if over the size limit
+	int class_start(int a) const { return start[class_of[a]]; }
+
+	Qfloat *get_Q(int, int) const { return NULL; }	// not used
+	double *get_QD() const { return NULL; }
+private:
+	int l;
+	const int *class_of;
+	const int *start;
+	const int *count;
+	Qfloat **row;
+	double size;	// bytes still free
+};
+
+Kernel_Segments::Kernel_Segments(int l_, svm_node * const * x_, const svm_parameter& param,
+				 const int *class_of_, const int *start_, const int *count_, double size_)
+:Kernel(l_, x_, param), l(l_), class_of(class_of_), start(start_), count(count_), size(size_)
+{
+	row = Malloc(Qfloat *,l);
+	for(int i=0;i<l;i++)
+		row[i] = NULL;
+}
+
+Kernel_Segments::~Kernel_Segments()
+{
+	for(int i=0;i<l;i++)
+		free(row[i]);
+	free(row);
+}
+
+const Qfloat *Kernel_Segments::get_row(int a)
+{
+	const Qfloat *r;
+#pragma omp critical(svm_kernel_segments)
+	{
+		int c = class_of[a];
+		if(row[a] == NULL && size >= (double)sizeof(Qfloat)*count[c])
+		{
+			row[a] = Malloc(Qfloat,count[c]);
+			fill_column(a,NULL,row[a],start[c],start[c]+count[c]);
+			size -= (double)sizeof(Qfloat)*count[c];
+		}
+		r = row[a];
+	}
+	return r;
 }
 
 double Kernel::dot(const svm_node *px, const svm_node *py)
@@ -1295,28 +1788,70 @@ double Solver_NU::calculate_rho()
 class SVC_Q: public Kernel
 { 
 public:
-	SVC_Q(const svm_problem& prob, const svm_parameter& param, const schar *y_)
-	:Kernel(prob.l, prob.x, param)
+	SVC_Q(const svm_view& prob, const svm_parameter& param, const schar *y_,
+	      Kernel_Segments *segments_ = NULL)
+	:Kernel(prob, param), segments(segments_), orig(NULL)
 	{
 		clone(y,y_,prob.l);
-		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)));
+		if(segments)
+		{
+			orig = new int[prob.l];
+			for(int i=0;i<prob.l;i++)
+				orig[i] = prob.position(i);
+		}
+		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)),cache_precision);
 		QD = new double[prob.l];
 		for(int i=0;i<prob.l;i++)
 			QD[i] = (this->*kernel_function)(i,i);
+		buffer[0] = buffer[1] = NULL;
+		if(cache_precision != SVM_CACHE_FLOAT)
+		{
+			buffer[0] = new Qfloat[prob.l];
+			buffer[1] = new Qfloat[prob.l];
+		}
+		next_buffer = 0;
 	}
 	
 	Qfloat *get_Q(int i, int len) const
 	{
 		Qfloat *data;
-		int start, j;
-		if((start = cache->get_data(i,&data,len)) < len)
+		int start;
+		if(buffer[0] == NULL)
 		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
+			if((start = cache->get_data(i,&data,len)) < len)
+				fill(i,data,start,len);
+			return data;
 		}
+
+		// 16-bit cache, decoded into one of two buffers
+		uint16_t *cached;
+		data = buffer[next_buffer];
+		next_buffer = 1 - next_buffer;
+		if((start = cache->get_data(i,&cached,len)) < len)
+		{
+			fill(i,data,start,len);
+			cache_encode(cache->get_precision(),data+start,cached+start,len-start);
+		}
+		cache_decode(cache->get_precision(),cached,data,len);
 		return data;
 	}
 
+	void fill(int i, Qfloat *data, int start, int len) const
+	{
+		const Qfloat *row = segments ? segments->get_row(orig[i]) : NULL;
+		if(row == NULL)
+			fill_column(i,y,data+start,start,len);
+		else
+		{
+			// same-class values come from the shared rows
+			fill_column(i,y,data+start,start,len,true);
+			row -= segments->class_start(orig[i]);
+			for(int j=start;j<len;j++)
+				if(y[j] == y[i])
+					data[j] = row[orig[j]];
+		}
+	}
+
 	double *get_QD() const
 	{
 		return QD;
@@ -1328,6 +1863,7 @@ public:
 		Kernel::swap_index(i,j);
 		swap(y[i],y[j]);
 		swap(QD[i],QD[j]);
+		if(orig) swap(orig[i],orig[j]);
 	}
 
 	~SVC_Q()
@@ -1335,34 +1871,60 @@ public:
 		delete[] y;
 		delete cache;
 		delete[] QD;
+		delete[] orig;
+		delete[] buffer[0];
+		delete[] buffer[1];
 	}
 private:
 	schar *y;
 	Cache *cache;
 	double *QD;
+	Kernel_Segments *segments;
+	int *orig;	// index of each row in the problem segments was built on
+	mutable int next_buffer;
+	Qfloat *buffer[2];	// NULL with a float cache
 };
 
 class ONE_CLASS_Q: public Kernel
 {
 public:
-	ONE_CLASS_Q(const svm_problem& prob, const svm_parameter& param)
-	:Kernel(prob.l, prob.x, param)
+	ONE_CLASS_Q(const svm_view& prob, const svm_parameter& param)
+	:Kernel(prob, param)
 	{
-		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)));
+		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)),cache_precision);
 		QD = new double[prob.l];
 		for(int i=0;i<prob.l;i++)
 			QD[i] = (this->*kernel_function)(i,i);
+		buffer[0] = buffer[1] = NULL;
+		if(cache_precision != SVM_CACHE_FLOAT)
+		{
+			buffer[0] = new Qfloat[prob.l];
+			buffer[1] = new Qfloat[prob.l];
+		}
+		next_buffer = 0;
 	}
 	
 	Qfloat *get_Q(int i, int len) const
 	{
 		Qfloat *data;
-		int start, j;
-		if((start = cache->get_data(i,&data,len)) < len)
+		int start;
+		if(buffer[0] == NULL)
 		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(i,j);
+			if((start = cache->get_data(i,&data,len)) < len)
+				fill_column(i,NULL,data+start,start,len);
+			return data;
 		}
+
+		// 16-bit cache, decoded into one of two buffers
+		uint16_t *cached;
+		data = buffer[next_buffer];
+		next_buffer = 1 - next_buffer;
+		if((start = cache->get_data(i,&cached,len)) < len)
+		{
+			fill_column(i,NULL,data+start,start,len);
+			cache_encode(cache->get_precision(),data+start,cached+start,len-start);
+		}
+		cache_decode(cache->get_precision(),cached,data,len);
 		return data;
 	}
 
@@ -1382,20 +1944,24 @@ public:
 	{
 		delete cache;
 		delete[] QD;
+		delete[] buffer[0];
+		delete[] buffer[1];
 	}
 private:
 	Cache *cache;
 	double *QD;
+	mutable int next_buffer;
+	Qfloat *buffer[2];	// NULL with a float cache
 };
 
 class SVR_Q: public Kernel
 { 
 public:
-	SVR_Q(const svm_problem& prob, const svm_parameter& param)
-	:Kernel(prob.l, prob.x, param)
+	SVR_Q(const svm_view& prob, const svm_parameter& param)
+	:Kernel(prob, param)
 	{
 		l = prob.l;
-		cache = new Cache(l,(long int)(param.cache_size*(1<<20)));
+		cache = new Cache(l,(long int)(param.cache_size*(1<<20)),cache_precision);
 		QD = new double[2*l];
 		sign = new schar[2*l];
 		index = new int[2*l];
@@ -1411,6 +1977,7 @@ public:
 		buffer[0] = new Qfloat[2*l];
 		buffer[1] = new Qfloat[2*l];
 		next_buffer = 0;
+		column = cache_precision != SVM_CACHE_FLOAT ? new Qfloat[l] : NULL;
 	}
 
 	void swap_index(int i, int j) const
@@ -1424,10 +1991,22 @@ public:
 	{
 		Qfloat *data;
 		int j, real_i = index[i];
-		if(cache->get_data(real_i,&data,l) < l)
+		int start;
+		if(column == NULL)
+		{
+			if((start = cache->get_data(real_i,&data,l)) < l)
+				fill_column(real_i,NULL,data+start,start,l);
+		}
+		else
 		{
-			for(j=0;j<l;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(real_i,j);
+			uint16_t *cached;
+			data = column;
+			if((start = cache->get_data(real_i,&cached,l)) < l)
+			{
+				fill_column(real_i,NULL,data+start,start,l);
+				cache_encode(cache->get_precision(),data+start,cached+start,l-start);
+			}
+			cache_decode(cache->get_precision(),cached,data,l);
 		}
 
 		// reorder and copy
@@ -1451,6 +2030,7 @@ public:
 		delete[] index;
 		delete[] buffer[0];
 		delete[] buffer[1];
+		delete[] column;
 		delete[] QD;
 	}
 private:
@@ -1460,6 +2040,7 @@ private:
 	int *index;
 	mutable int next_buffer;
 	Qfloat *buffer[2];
+	Qfloat *column;		// a decoded 16-bit column, NULL with a float cache
 	double *QD;
 };
 
@@ -1467,8 +2048,9 @@ private:
 // construct and solve various formulations
 //
 static void solve_c_svc(
-	const svm_problem *prob, const svm_parameter* param,
-	double *alpha, Solver::SolutionInfo* si, double Cp, double Cn)
+	const svm_view *prob, const svm_parameter* param,
+	double *alpha, Solver::SolutionInfo* si, double Cp, double Cn,
+	Kernel_Segments *segments, const double *alpha0)
 {
 	int l = prob->l;
 	double *minus_ones = new double[l];
@@ -1480,11 +2062,31 @@ static void solve_c_svc(
 	{
 		alpha[i] = 0;
 		minus_ones[i] = -1;
-		if(prob->y[i] > 0) y[i] = +1; else y[i] = -1;
+		if(prob->label(i) > 0) y[i] = +1; else y[i] = -1;
+	}
+
+	// a warm start is clipped to the box, then the larger side is
+	// scaled down so that y'alpha = 0 still holds
+	if(alpha0)
+	{
+		double sum_p = 0, sum_n = 0;
+		for(i=0;i<l;i++)
+		{
+			alpha[i] = max(0.0,min(alpha0[i],y[i] > 0 ? Cp : Cn));
+			if(y[i] > 0) sum_p += alpha[i]; else sum_n += alpha[i];
+		}
+		if(sum_p != sum_n)
+		{
+			schar side = sum_p > sum_n ? +1 : -1;
+			double ratio = side > 0 ? sum_n/sum_p : sum_p/sum_n;
+			for(i=0;i<l;i++)
+				if(y[i] == side)
+					alpha[i] *= ratio;
+		}
 	}
 
 	Solver s;
-	s.Solve(l, SVC_Q(*prob,*param,y), minus_ones, y,
+	s.Solve(l, SVC_Q(*prob,*param,y,segments), minus_ones, y,
 		alpha, Cp, Cn, param->eps, si, param->shrinking);
 
 	double sum_alpha=0;
@@ -1502,8 +2104,9 @@ static void solve_c_svc(
 }
 
 static void solve_nu_svc(
-	const svm_problem *prob, const svm_parameter *param,
-	double *alpha, Solver::SolutionInfo* si)
+	const svm_view *prob, const svm_parameter *param,
+	double *alpha, Solver::SolutionInfo* si,
+	Kernel_Segments *segments)
 {
 	int i;
 	int l = prob->l;
@@ -1512,7 +2115,7 @@ static void solve_nu_svc(
 	schar *y = new schar[l];
 
 	for(i=0;i<l;i++)
-		if(prob->y[i]>0)
+		if(prob->label(i)>0)
 			y[i] = +1;
 		else
 			y[i] = -1;
@@ -1538,7 +2141,7 @@ static void solve_nu_svc(
 		zeros[i] = 0;
 
 	Solver_NU s;
-	s.Solve(l, SVC_Q(*prob,*param,y), zeros, y,
+	s.Solve(l, SVC_Q(*prob,*param,y,segments), zeros, y,
 		alpha, 1.0, 1.0, param->eps, si,  param->shrinking);
 	double r = si->r;
 
@@ -1557,7 +2160,7 @@ static void solve_nu_svc(
 }
 
 static void solve_one_class(
-	const svm_problem *prob, const svm_parameter *param,
+	const svm_view *prob, const svm_parameter *param,
 	double *alpha, Solver::SolutionInfo* si)
 {
 	int l = prob->l;
@@ -1589,7 +2192,7 @@ static void solve_one_class(
 }
 
 static void solve_epsilon_svr(
-	const svm_problem *prob, const svm_parameter *param,
+	const svm_view *prob, const svm_parameter *param,
 	double *alpha, Solver::SolutionInfo* si)
 {
 	int l = prob->l;
@@ -1601,11 +2204,11 @@ static void solve_epsilon_svr(
 	for(i=0;i<l;i++)
 	{
 		alpha2[i] = 0;
-		linear_term[i] = param->p - prob->y[i];
+		linear_term[i] = param->p - prob->label(i);
 		y[i] = 1;
 
 		alpha2[i+l] = 0;
-		linear_term[i+l] = param->p + prob->y[i];
+		linear_term[i+l] = param->p + prob->label(i);
 		y[i+l] = -1;
 	}
 
@@ -1627,7 +2230,7 @@ static void solve_epsilon_svr(
 }
 
 static void solve_nu_svr(
-	const svm_problem *prob, const svm_parameter *param,
+	const svm_view *prob, const svm_parameter *param,
 	double *alpha, Solver::SolutionInfo* si)
 {
 	int l = prob->l;
@@ -1643,10 +2246,10 @@ static void solve_nu_svr(
 		alpha2[i] = alpha2[i+l] = min(sum,C);
 		sum -= alpha2[i];
 
-		linear_term[i] = - prob->y[i];
+		linear_term[i] = - prob->label(i);
 		y[i] = 1;
 
-		linear_term[i+l] = prob->y[i];
+		linear_term[i+l] = prob->label(i);
 		y[i+l] = -1;
 	}
 
@@ -1674,18 +2277,18 @@ struct decision_function
 };
 
 static decision_function svm_train_one(
-	const svm_problem *prob, const svm_parameter *param,
-	double Cp, double Cn)
+	const svm_view *prob, const svm_parameter *param,
+	double Cp, double Cn, Kernel_Segments *segments = NULL, const double *alpha0 = NULL)
 {
 	double *alpha = Malloc(double,prob->l);
 	Solver::SolutionInfo si;
 	switch(param->svm_type)
 	{
 		case C_SVC:
-			solve_c_svc(prob,param,alpha,&si,Cp,Cn);
+			solve_c_svc(prob,param,alpha,&si,Cp,Cn,segments,alpha0);
 			break;
 		case NU_SVC:
-			solve_nu_svc(prob,param,alpha,&si);
+			solve_nu_svc(prob,param,alpha,&si,segments);
 			break;
 		case ONE_CLASS:
 			solve_one_class(prob,param,alpha,&si);
@@ -1709,7 +2312,7 @@ static decision_function svm_train_one(
 		if(fabs(alpha[i]) > 0)
 		{
 			++nSV;
-			if(prob->y[i] > 0)
+			if(prob->label(i) > 0)
 			{
 				if(fabs(alpha[i]) >= si.upper_bound_p)
 					++nBSV;
@@ -1917,96 +2520,151 @@ static void multiclass_probability(int k, double **r, double *p)
 	free(Qp);
 }
 
-// Cross-validation decision values for probability estimates
-static void svm_binary_svc_probability(
-	const svm_problem *prob, const svm_parameter *param,
-	double Cp, double Cn, double& probA, double& probB)
+// Random fold order for svm_binary_svc_probability
+static void svm_binary_svc_shuffle(int l, int *perm)
 {
 	int i;
-	int nr_fold = 5;
-	int *perm = Malloc(int,prob->l);
-	double *dec_values = Malloc(double,prob->l);
-
-	// random shuffle
-	for(i=0;i<prob->l;i++) perm[i]=i;
-	for(i=0;i<prob->l;i++)
+	for(i=0;i<l;i++) perm[i]=i;
+	for(i=0;i<l;i++)
 	{
-		int j = i+rand()%(prob->l-i);
+		int j = i+rand()%(l-i);
 		swap(perm[i],perm[j]);
 	}
-	for(i=0;i<nr_fold;i++)
-	{
-		int begin = i*prob->l/nr_fold;
-		int end = (i+1)*prob->l/nr_fold;
-		int j,k;
-		struct svm_problem subprob;
+}
 
-		subprob.l = prob->l-(end-begin);
-		subprob.x = Malloc(struct svm_node*,subprob.l);
-		subprob.y = Malloc(double,subprob.l);
-			
-		k=0;
-		for(j=0;j<begin;j++)
-		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
-		}
-		for(j=end;j<prob->l;j++)
-		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
-		}
-		int p_count=0,n_count=0;
-		for(j=0;j<k;j++)
-			if(subprob.y[j]>0)
-				p_count++;
-			else
-				n_count++;
+struct svm_warm_start;
+static svm_model *svm_train_view(const svm_view *prob, const svm_parameter *param,
+				 Kernel_Segments *segments = NULL, const svm_warm_start *warm = NULL);
+static void svm_cross_validation_view(const svm_view *prob, const svm_parameter *param, int nr_fold, double *target);
 
-		if(p_count==0 && n_count==0)
-			for(j=begin;j<end;j++)
-				dec_values[perm[j]] = 0;
-		else if(p_count > 0 && n_count == 0)
-			for(j=begin;j<end;j++)
-				dec_values[perm[j]] = 1;
-		else if(p_count == 0 && n_count > 0)
-			for(j=begin;j<end;j++)
-				dec_values[perm[j]] = -1;
-		else
-		{
-			svm_parameter subparam = *param;
-			subparam.probability=0;
-			subparam.C=1.0;
-			subparam.nr_weight=2;
-			subparam.weight_label = Malloc(int,2);
-			subparam.weight = Malloc(double,2);
-			subparam.weight_label[0]=+1;
-			subparam.weight_label[1]=-1;
-			subparam.weight[0]=Cp;
-			subparam.weight[1]=Cn;
-			struct svm_model *submodel = svm_train(&subprob,&subparam);
-			for(j=begin;j<end;j++)
-			{
-				svm_predict_values(submodel,prob->x[perm[j]],&(dec_values[perm[j]])); 
-				// ensure +1 -1 order; reason not using CV subroutine
-				dec_values[perm[j]] *= submodel->label[0];
-			}		
-			svm_free_and_destroy_model(&submodel);
-			svm_destroy_param(&subparam);
-		}
-		free(subprob.x);
-		free(subprob.y);
-	}		
-	sigmoid_train(prob->l,dec_values,prob->y,probA,probB);
-	free(dec_values);
-	free(perm);
-}
+// Cross-validation decision values for probability estimates.  The rows
+// are copied once in fold order, and each fold trains on the ranges on
+// either side of its held-out rows.  The folds are independent, so
+// svm_train may run them as separate jobs between init and done.
+#define PLATT_NR_FOLD 5
+
+struct svm_binary_svc_cv
+{
+	int l;
+	int *perm;
+	svm_node **x;		// rows in fold order
+	double *y;
+	int *pos;		// rows in the Kernel_Segments, NULL if none
+	double *dec_values;	// in row order
+};
+
+// the fold order is drawn here, serially
+static void svm_binary_svc_cv_init(svm_binary_svc_cv *cv, const svm_view *prob, bool positions)
+{
+	int l = prob->l;
+	cv->l = l;
+	cv->perm = Malloc(int,l);
+	cv->x = Malloc(svm_node *,l);
+	cv->y = Malloc(double,l);
+	cv->pos = positions ? Malloc(int,l) : NULL;
+	cv->dec_values = Malloc(double,l);
+
+	// random shuffle
+	svm_binary_svc_shuffle(l,cv->perm);
+	for(int i=0;i<l;i++)
+	{
+		cv->x[i] = prob->row(cv->perm[i]);
+		cv->y[i] = prob->label(cv->perm[i]);
+		if(positions)
+			cv->pos[i] = prob->position(cv->perm[i]);
+	}
+}
+
+// rows trained for fold i
+static int svm_binary_svc_cv_size(int l, int i)
+{
+	return l-((i+1)*l/PLATT_NR_FOLD-i*l/PLATT_NR_FOLD);
+}
+
+static void svm_binary_svc_cv_fold(
+	svm_binary_svc_cv *cv, int i, const svm_parameter *param,
+	double Cp, double Cn, Kernel_Segments *segments)
+{
+	int l = cv->l;
+	int *perm = cv->perm;
+	double *dec_values = cv->dec_values;
+	int begin = i*l/PLATT_NR_FOLD;
+	int end = (i+1)*l/PLATT_NR_FOLD;
+	int j;
+	svm_view subprob;
+	view_ranges(&subprob,cv->x,cv->y,begin,cv->x+end,cv->y+end,l-end);
+	if(cv->pos)
+		view_positions(&subprob,cv->pos,cv->pos+end);
+
+	int p_count=0,n_count=0;
+	for(j=0;j<subprob.l;j++)
+		if(subprob.label(j)>0)
+			p_count++;
+		else
+			n_count++;
+
+	if(p_count==0 && n_count==0)
+		for(j=begin;j<end;j++)
+			dec_values[perm[j]] = 0;
+	else if(p_count > 0 && n_count == 0)
+		for(j=begin;j<end;j++)
+			dec_values[perm[j]] = 1;
+	else if(p_count == 0 && n_count > 0)
+		for(j=begin;j<end;j++)
+			dec_values[perm[j]] = -1;
+	else
+	{
+		svm_parameter subparam = *param;
+		subparam.probability=0;
+		subparam.C=1.0;
+		subparam.nr_weight=2;
+		subparam.weight_label = Malloc(int,2);
+		subparam.weight = Malloc(double,2);
+		subparam.weight_label[0]=+1;
+		subparam.weight_label[1]=-1;
+		subparam.weight[0]=Cp;
+		subparam.weight[1]=Cn;
+		struct svm_model *submodel = svm_train_view(&subprob,&subparam,cv->pos ? segments : NULL);
+		for(j=begin;j<end;j++)
+		{
+			svm_predict_values(submodel,cv->x[j],&(dec_values[perm[j]])); 
+			// ensure +1 -1 order; reason not using CV subroutine
+			dec_values[perm[j]] *= submodel->label[0];
+		}		
+		svm_free_and_destroy_model(&submodel);
+		svm_destroy_param(&subparam);
+	}
+}
+
+static void svm_binary_svc_cv_done(svm_binary_svc_cv *cv, double& probA, double& probB)
+{
+	// labels back in row order for sigmoid_train
+	double *labels = Malloc(double,cv->l);
+	for(int i=0;i<cv->l;i++)
+		labels[cv->perm[i]] = cv->y[i];
+	sigmoid_train(cv->l,cv->dec_values,labels,probA,probB);
+	free(labels);
+	free(cv->perm);
+	free(cv->x);
+	free(cv->y);
+	free(cv->pos);
+	free(cv->dec_values);
+}
+
+static void svm_binary_svc_probability(
+	const svm_view *prob, const svm_parameter *param,
+	double Cp, double Cn, double& probA, double& probB, Kernel_Segments *segments)
+{
+	svm_binary_svc_cv cv;
+	svm_binary_svc_cv_init(&cv,prob,segments != NULL);
+	for(int i=0;i<PLATT_NR_FOLD;i++)
+		svm_binary_svc_cv_fold(&cv,i,param,Cp,Cn,segments);
+	svm_binary_svc_cv_done(&cv,probA,probB);
+}
 
 // Return parameter of a Laplace distribution 
 static double svm_svr_probability(
-	const svm_problem *prob, const svm_parameter *param)
+	const svm_view *prob, const svm_parameter *param)
 {
 	int i;
 	int nr_fold = 5;
@@ -2015,10 +2673,10 @@ static double svm_svr_probability(
 
 	svm_parameter newparam = *param;
 	newparam.probability = 0;
-	svm_cross_validation(prob,&newparam,nr_fold,ymv);
+	svm_cross_validation_view(prob,&newparam,nr_fold,ymv);
 	for(i=0;i<prob->l;i++)
 	{
-		ymv[i]=prob->y[i]-ymv[i];
+		ymv[i]=prob->label(i)-ymv[i];
 		mae += fabs(ymv[i]);
 	}		
 	mae /= prob->l;
@@ -2039,7 +2697,7 @@ static double svm_svr_probability(
 
 // label: label name, start: begin of each class, count: #data of classes, perm: indices to the original data
 // perm, length l, must be allocated before calling this subroutine
-static void svm_group_classes(const svm_problem *prob, int *nr_class_ret, int **label_ret, int **start_ret, int **count_ret, int *perm)
+static void svm_group_classes(const svm_view *prob, int *nr_class_ret, int **label_ret, int **start_ret, int **count_ret, int *perm)
 {
 	int l = prob->l;
 	int max_nr_class = 16;
@@ -2051,7 +2709,7 @@ static void svm_group_classes(const svm_problem *prob, int *nr_class_ret, int **
 
 	for(i=0;i<l;i++)
 	{
-		int this_label = (int)prob->y[i];
+		int this_label = (int)prob->label(i);
 		int j;
 		for(j=0;j<nr_class;j++)
 		{
@@ -2096,14 +2754,281 @@ static void svm_group_classes(const svm_problem *prob, int *nr_class_ret, int **
 	free(data_label);
 }
 
+//
+// Parallel one-against-one training
+//
+// svm_train solves the k*(k-1)/2 binary problems of a classifier on up to
+// train_threads OpenMP threads.  The largest problems are handed out first
+// and a thread takes the next one as soon as it is free.  Every result has
+// its own slot, and the SV marking is done afterwards in pair order.  With
+// probability estimates each pair's Platt folds are jobs of their own,
+// next to its final training, and the sigmoids are fitted once they are
+// all done.  The fold orders are drawn up front in the same order as the
+// serial loop draws them, so the model does not depend on the thread
+// count.  The fold models share the pairs' Kernel_Segments.  A pair asks
+// for no more kernel cache than its whole Q matrix, and train_cache_budget
+// caps the sum of the caches of the pairs being solved at once.  A pair
+// that does not fit waits for one to finish.  The cache size does not
+// change the solution.
+//
+// svm_cross_validation runs its folds the same way, each fold with its own
+// cache grant.  The split is drawn before any fold starts.  Folds are only
+// run concurrently without probability estimates, whose training draws
+// from rand().  svm_train called inside a parallel fold or pair stays on
+// one thread and does not ask for a second grant.  The folds of a
+// classifier share one Kernel_Segments over all the rows, so the store is
+// train_shared_cache in total rather than per fold.
+//
+static int train_threads = 1;
+static double train_cache_budget = 0;	// MB, <= 0 for no limit
+static double train_cache_in_use = 0;
+static int train_cache_holders = 0;		// grants not yet released
+static double train_shared_cache = 0;	// MB for Kernel_Segments, 0 for none
+
+struct svm_pair_job
+{
+	int i, j;	// classes
+	int p;		// index of the decision function
+	int fold;	// Platt fold, -1 for the pair itself
+	int l;		// rows trained
+};
+
+static int compare_pair_job(const void *a, const void *b)
+{
+	const svm_pair_job *ja = (const svm_pair_job *)a;
+	const svm_pair_job *jb = (const svm_pair_job *)b;
+	if(ja->l != jb->l)
+		return jb->l - ja->l;
+	return ja->p - jb->p;
+}
+
+static void train_sleep_ms(int ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	usleep(ms*1000);
+#endif
+}
+
+static double train_cache_acquire(double request)
+{
+	if(train_cache_budget > 0 && request > train_cache_budget)
+		request = train_cache_budget;
+	while(1)
+	{
+		bool granted = false;
+#pragma omp critical(svm_train_cache)
+		{
+			if(train_cache_budget <= 0 || train_cache_holders == 0 ||
+			   train_cache_in_use + request <= train_cache_budget)
+			{
+				train_cache_in_use += request;
+				train_cache_holders++;
+				granted = true;
+			}
+		}
+		if(granted)
+			return request;
+		train_sleep_ms(1);
+	}
+}
+
+static void train_cache_release(double size)
+{
+#pragma omp critical(svm_train_cache)
+	{
+		// with no holders left, drop whatever rounding the sums left behind
+		if(--train_cache_holders == 0)
+			train_cache_in_use = 0;
+		else
+			train_cache_in_use -= size;
+	}
+}
+
+static bool train_nested()
+{
+#ifdef _OPENMP
+	return omp_in_parallel() != 0;
+#else
+	return false;
+#endif
+}
+
+// cache that holds all of Q for an l-row problem, in MB
+static double train_cache_need(int l)
+{
+	return ((double)l*l*sizeof(Qfloat)+(double)l*64)/(1<<20);
+}
+
+int svm_set_train_threads(int nr_threads, double cache_budget_mb)
+{
+	if(nr_threads < 1)
+		nr_threads = 1;
+#ifndef _OPENMP
+	nr_threads = 1;
+#endif
+	train_threads = nr_threads;
+	train_cache_budget = cache_budget_mb;
+	return train_threads;
+}
+
+void svm_set_shared_cache(double size_mb)
+{
+	train_shared_cache = size_mb > 0 ? size_mb : 0;
+}
+
+//
+// Warm start
+//
+// svm_train_warm starts each C-SVC pair from the coefficients a prior
+// model gave the same rows, zero for rows it did not have, instead of from
+// alpha = 0.  Solver::Solve builds the gradient from whatever alpha it is
+// given, so only the starting point changes and the solution meets the
+// same stopping tolerance.  Rows are matched to the prior SVs by the
+// caller or by their features, and a match is dropped if the label
+// differs.  A pair with a class the prior lacks, the Platt folds and the
+// other svm types start cold.
+//
+struct svm_warm_start
+{
+	const svm_model *model;
+	const int *sv;		// prior SV of each row of the problem, -1 if none
+};
+
+// the prior coefficients of pair (i,j) as alphas, NULL if the prior lacks either class
+static double *svm_warm_alpha(const svm_model *prior, const int *sv, const int *prior_class,
+			      const int *start, const int *count, int i, int j)
+{
+	int pi = prior_class[i], pj = prior_class[j];
+	if(pi < 0 || pj < 0)
+		return NULL;
+	const double *coef_i = prior->sv_coef[pj > pi ? pj-1 : pj];	// class pi against pj
+	const double *coef_j = prior->sv_coef[pi > pj ? pi-1 : pi];
+	double *alpha0 = Malloc(double,count[i]+count[j]);
+	int k;
+	for(k=0;k<count[i];k++)
+	{
+		int s = sv[start[i]+k];
+		alpha0[k] = s >= 0 ? fabs(coef_i[s]) : 0;
+	}
+	for(k=0;k<count[j];k++)
+	{
+		int s = sv[start[j]+k];
+		alpha0[count[i]+k] = s >= 0 ? fabs(coef_j[s]) : 0;
+	}
+	return alpha0;
+}
+
+static unsigned int svm_node_hash(const svm_node *x)
+{
+	unsigned int h = 2166136261u;
+	for(;x->index != -1;x++)
+	{
+		unsigned int v[3];
+		memcpy(v,&x->value,sizeof(double));
+		v[2] = (unsigned int)x->index;
+		for(int k=0;k<3;k++)
+			h = (h^v[k])*16777619u;
+	}
+	return h;
+}
+
+static bool svm_node_equal(const svm_node *a, const svm_node *b)
+{
+	for(;a->index != -1;a++,b++)
+		if(a->index != b->index || a->value != b->value)
+			return false;
+	return b->index == -1;
+}
+
+// sv[r] = an unclaimed SV of prior with the features of row r, -1 if none
+static void svm_match_sv(const svm_model *prior, const svm_problem *prob, int *sv)
+{
+	int size = 1;
+	while(size < 2*prior->l)
+		size *= 2;
+	int *table = Malloc(int,size);
+	bool *used = Malloc(bool,prior->l);
+	int i, h;
+	for(h=0;h<size;h++)
+		table[h] = -1;
+	for(i=0;i<prior->l;i++)
+	{
+		for(h=svm_node_hash(prior->SV[i])&(size-1);table[h] != -1;h=(h+1)&(size-1))
+			;
+		table[h] = i;
+		used[i] = false;
+	}
+	for(i=0;i<prob->l;i++)
+	{
+		sv[i] = -1;
+		for(h=svm_node_hash(prob->x[i])&(size-1);table[h] != -1;h=(h+1)&(size-1))
+			if(!used[table[h]] && svm_node_equal(prob->x[i],prior->SV[table[h]]))
+			{
+				sv[i] = table[h];
+				used[table[h]] = true;
+				break;
+			}
+	}
+	free(table);
+	free(used);
+}
+
 //
 // Interface functions
 //
 svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+{
+	svm_view view;
+	view_problem(&view,prob);
+	return svm_train_view(&view,param);
+}
+
+svm_model *svm_train_warm(const svm_problem *prob, const svm_parameter *param,
+			  const svm_model *prior, const int *sv_index)
+{
+	svm_view view;
+	view_problem(&view,prob);
+	if(prior == NULL || prior->l <= 0 || param->svm_type != C_SVC ||
+	   prior->param.svm_type != C_SVC || prior->nSV == NULL)
+		return svm_train_view(&view,param);
+
+	int i;
+	int *sv = Malloc(int,prob->l);
+	if(sv_index)
+		for(i=0;i<prob->l;i++)
+			sv[i] = sv_index[i] >= 0 && sv_index[i] < prior->l ? sv_index[i] : -1;
+	else
+		svm_match_sv(prior,prob,sv);
+
+	// keep the matches with the label of the prior SV
+	int *sv_label = Malloc(int,prior->l);
+	int k = 0;
+	for(i=0;i<prior->nr_class;i++)
+		for(int j=0;j<prior->nSV[i];j++)
+			sv_label[k++] = prior->label[i];
+	for(i=0;i<prob->l;i++)
+		if(sv[i] >= 0 && sv_label[sv[i]] != (int)prob->y[i])
+			sv[i] = -1;
+	free(sv_label);
+
+	svm_warm_start warm;
+	warm.model = prior;
+	warm.sv = sv;
+	svm_model *model = svm_train_view(&view,param,NULL,&warm);
+	free(sv);
+	return model;
+}
+
+static svm_model *svm_train_view(const svm_view *prob, const svm_parameter *param,
+				 Kernel_Segments *segments, const svm_warm_start *warm)
 {
 	svm_model *model = Malloc(svm_model,1);
 	model->param = *param;
 	model->free_sv = 0;	// XXX
+	model->mapped_file = NULL;
+	model->arena = NULL;
 
 	if(param->svm_type == ONE_CLASS ||
 	   param->svm_type == EPSILON_SVR ||
@@ -2139,7 +3064,7 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		for(i=0;i<prob->l;i++)
 			if(fabs(f.alpha[i]) > 0)
 			{
-				model->SV[j] = prob->x[i];
+				model->SV[j] = prob->row(i);
 				model->sv_coef[0][j] = f.alpha[i];
 				++j;
 			}		
@@ -2161,7 +3086,7 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		svm_node **x = Malloc(svm_node *,l);
 		int i;
 		for(i=0;i<l;i++)
-			x[i] = prob->x[perm[i]];
+			x[i] = prob->row(perm[i]);
 
 		// calculate weighted C
 
@@ -2194,42 +3119,151 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 			probB=Malloc(double,nr_class*(nr_class-1)/2);
 		}
 
-		int p = 0;
+		int nr_pair = nr_class*(nr_class-1)/2;
+		int threads = train_nested() ? 1 : train_threads;
+		int nr_fold = param->probability && threads > 1 ? PLATT_NR_FOLD : 0;
+		int nr_job = nr_pair*(nr_fold+1);
+		threads = min(threads,nr_job);
+		svm_pair_job *job = Malloc(svm_pair_job,nr_job);
+		int p = 0, q = 0;
 		for(i=0;i<nr_class;i++)
 			for(int j=i+1;j<nr_class;j++)
 			{
-				svm_problem sub_prob;
-				int si = start[i], sj = start[j];
-				int ci = count[i], cj = count[j];
-				sub_prob.l = ci+cj;
-				sub_prob.x = Malloc(svm_node *,sub_prob.l);
-				sub_prob.y = Malloc(double,sub_prob.l);
-				int k;
-				for(k=0;k<ci;k++)
+				for(int k=-1;k<nr_fold;k++)
 				{
-					sub_prob.x[k] = x[si+k];
-					sub_prob.y[k] = +1;
+					job[q].i = i;
+					job[q].j = j;
+					job[q].p = p;
+					job[q].fold = k;
+					job[q].l = count[i]+count[j];
+					if(k >= 0)
+						job[q].l = svm_binary_svc_cv_size(job[q].l,k);
+					++q;
 				}
-				for(k=0;k<cj;k++)
+				++p;
+			}
+
+		// same-class kernel values, shared when a class is in several pairs;
+		// a Platt fold trains with the one of the pair it belongs to
+		Kernel_Segments *own_segments = NULL;
+		int *class_of = NULL;
+		int *pos = NULL;
+		if(segments)
+		{
+			pos = Malloc(int,l);
+			for(i=0;i<l;i++)
+				pos[i] = prob->position(perm[i]);
+		}
+		else if(nr_class > 2 && train_shared_cache > 0)
+		{
+			class_of = Malloc(int,l);
+			for(i=0;i<nr_class;i++)
+				for(int k=0;k<count[i];k++)
+					class_of[start[i]+k] = i;
+			own_segments = new Kernel_Segments(l,x,*param,class_of,start,count,train_shared_cache*(1<<20));
+			segments = own_segments;
+			pos = Malloc(int,l);
+			for(i=0;i<l;i++)
+				pos[i] = i;
+		}
+
+		// prior SV of each grouped row and prior class of each class
+		int *warm_sv = NULL;
+		int *warm_class = NULL;
+		if(warm)
+		{
+			warm_sv = Malloc(int,l);
+			for(i=0;i<l;i++)
+				warm_sv[i] = warm->sv[perm[i]];
+			warm_class = Malloc(int,nr_class);
+			for(i=0;i<nr_class;i++)
+			{
+				warm_class[i] = -1;
+				for(int j=0;j<warm->model->nr_class;j++)
+					if(warm->model->label[j] == label[i])
+						warm_class[i] = j;
+			}
+		}
+
+		// fold orders in the order the serial loop would draw them
+		svm_binary_svc_cv *cv = NULL;
+		if(nr_fold)
+		{
+			cv = Malloc(svm_binary_svc_cv,nr_pair);
+			p = 0;
+			for(i=0;i<nr_class;i++)
+				for(int j=i+1;j<nr_class;j++)
 				{
-					sub_prob.x[ci+k] = x[sj+k];
-					sub_prob.y[ci+k] = -1;
+					svm_view sub_prob;
+					view_ranges(&sub_prob,x+start[i],NULL,count[i],x+start[j],NULL,count[j]);
+					if(pos)
+						view_positions(&sub_prob,pos+start[i],pos+start[j]);
+					svm_binary_svc_cv_init(&cv[p++],&sub_prob,pos != NULL);
 				}
+		}
+		if(threads > 1)
+			qsort(job,nr_job,sizeof(svm_pair_job),compare_pair_job);
 
-				if(param->probability)
-					svm_binary_svc_probability(&sub_prob,param,weighted_C[i],weighted_C[j],probA[p],probB[p]);
+#pragma omp parallel for schedule(dynamic,1) num_threads(threads) if(threads > 1)
+		for(q=0;q<nr_job;q++)
+		{
+			int i = job[q].i, j = job[q].j, p = job[q].p;
+			svm_view sub_prob;	// class i as +1, class j as -1
+			view_ranges(&sub_prob,x+start[i],NULL,count[i],x+start[j],NULL,count[j]);
+			if(pos)
+				view_positions(&sub_prob,pos+start[i],pos+start[j]);
+
+			svm_parameter pair_param = *param;
+			double cache_mb = 0;
+			if(threads > 1)
+			{
+				cache_mb = train_cache_acquire(min(param->cache_size,train_cache_need(job[q].l)));
+				pair_param.cache_size = cache_mb;
+			}
 
-				f[p] = svm_train_one(&sub_prob,param,weighted_C[i],weighted_C[j]);
-				for(k=0;k<ci;k++)
-					if(!nonzero[si+k] && fabs(f[p].alpha[k]) > 0)
-						nonzero[si+k] = true;
-				for(k=0;k<cj;k++)
-					if(!nonzero[sj+k] && fabs(f[p].alpha[ci+k]) > 0)
-						nonzero[sj+k] = true;
-				free(sub_prob.x);
-				free(sub_prob.y);
-				++p;
+			if(job[q].fold >= 0)
+				svm_binary_svc_cv_fold(&cv[p],job[q].fold,&pair_param,weighted_C[i],weighted_C[j],segments);
+			else
+			{
+				if(param->probability && !cv)
+					svm_binary_svc_probability(&sub_prob,&pair_param,weighted_C[i],weighted_C[j],
+								   probA[p],probB[p],segments);
+				double *alpha0 = NULL;
+				if(warm)
+					alpha0 = svm_warm_alpha(warm->model,warm_sv,warm_class,start,count,i,j);
+				f[p] = svm_train_one(&sub_prob,&pair_param,weighted_C[i],weighted_C[j],segments,alpha0);
+				free(alpha0);
 			}
+			if(threads > 1)
+				train_cache_release(cache_mb);
+		}
+		if(cv)
+		{
+			for(p=0;p<nr_pair;p++)
+				svm_binary_svc_cv_done(&cv[p],probA[p],probB[p]);
+			free(cv);
+		}
+		delete own_segments;
+		free(class_of);
+		free(pos);
+		free(warm_sv);
+		free(warm_class);
+
+		for(q=0;q<nr_job;q++)
+		{
+			if(job[q].fold >= 0)
+				continue;
+			int si = start[job[q].i], sj = start[job[q].j];
+			int ci = count[job[q].i], cj = count[job[q].j];
+			int k;
+			for(k=0;k<ci;k++)
+				if(!nonzero[si+k] && fabs(f[job[q].p].alpha[k]) > 0)
+					nonzero[si+k] = true;
+			for(k=0;k<cj;k++)
+				if(!nonzero[sj+k] && fabs(f[job[q].p].alpha[ci+k]) > 0)
+					nonzero[sj+k] = true;
+		}
+		free(job);
 
 		// build output
 
@@ -2337,23 +3371,51 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 
 // Stratified cross validation
 void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target)
+{
+	svm_view view;
+	view_problem(&view,prob);
+	svm_cross_validation_view(&view,param,nr_fold,target);
+}
+
+static void svm_cross_validation_view(const svm_view *prob, const svm_parameter *param, int nr_fold, double *target)
 {
 	int i;
 	int *fold_start = Malloc(int,nr_fold+1);
 	int l = prob->l;
 	int *perm = Malloc(int,l);
 	int nr_class;
+	int *start = NULL;
+	int *count = NULL;
+	Kernel_Segments *segments = NULL;
+	int *class_of = NULL;
+	int *group_pos = NULL;	// row number in segments of each row
 
 	// stratified cv may not give leave-one-out rate
 	// Each class to l folds -> some folds may have zero elements
 	if((param->svm_type == C_SVC ||
 	    param->svm_type == NU_SVC) && nr_fold < l)
 	{
-		int *start = NULL;
 		int *label = NULL;
-		int *count = NULL;
 		svm_group_classes(prob,&nr_class,&label,&start,&count,perm);
 
+		// the same-class kernel values every fold's svm_train would build
+		if(nr_class > 2 && train_shared_cache > 0)
+		{
+			svm_node **group_x = Malloc(svm_node *,l);
+			class_of = Malloc(int,l);
+			group_pos = Malloc(int,l);
+			for(i=0;i<nr_class;i++)
+				for(int k=0;k<count[i];k++)
+					class_of[start[i]+k] = i;
+			for(i=0;i<l;i++)
+			{
+				group_x[i] = prob->row(perm[i]);
+				group_pos[perm[i]] = i;
+			}
+			segments = new Kernel_Segments(l,group_x,*param,class_of,start,count,train_shared_cache*(1<<20));
+			free(group_x);
+		}
+
 		// random shuffle and then data grouped by fold using the array perm
 		int *fold_count = Malloc(int,nr_fold);
 		int c;
@@ -2389,9 +3451,7 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		fold_start[0]=0;
 		for (i=1;i<=nr_fold;i++)
 			fold_start[i] = fold_start[i-1]+fold_count[i-1];
-		free(start);	
 		free(label);
-		free(count);	
 		free(index);
 		free(fold_count);
 	}
@@ -2407,46 +3467,66 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 			fold_start[i]=i*l/nr_fold;
 	}
 
+	// the rows in fold order, each fold's training set is a view of two ranges
+	svm_node **x = Malloc(svm_node *,l);
+	double *y = Malloc(double,l);
+	int *pos = NULL;
+	for(i=0;i<l;i++)
+	{
+		x[i] = prob->row(perm[i]);
+		y[i] = prob->label(perm[i]);
+	}
+	if(segments)
+	{
+		pos = Malloc(int,l);
+		for(i=0;i<l;i++)
+			pos[i] = group_pos[perm[i]];
+	}
+	int threads = 1;
+	if(!param->probability && !train_nested())
+		threads = min(train_threads,nr_fold);
+#pragma omp parallel for schedule(dynamic,1) num_threads(threads) if(threads > 1)
 	for(i=0;i<nr_fold;i++)
 	{
 		int begin = fold_start[i];
 		int end = fold_start[i+1];
-		int j,k;
-		struct svm_problem subprob;
-
-		subprob.l = l-(end-begin);
-		subprob.x = Malloc(struct svm_node*,subprob.l);
-		subprob.y = Malloc(double,subprob.l);
-			
-		k=0;
-		for(j=0;j<begin;j++)
-		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
-		}
-		for(j=end;j<l;j++)
+		int j;
+		svm_view subprob;
+		view_ranges(&subprob,x,y,begin,x+end,y+end,l-end);
+		if(pos)
+			view_positions(&subprob,pos,pos+end);
+
+		svm_parameter fold_param = *param;
+		double cache_mb = 0;
+		if(threads > 1)
 		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
+			cache_mb = train_cache_acquire(min(param->cache_size,train_cache_need(subprob.l)));
+			fold_param.cache_size = cache_mb;
 		}
-		struct svm_model *submodel = svm_train(&subprob,param);
+		struct svm_model *submodel = svm_train_view(&subprob,&fold_param,segments);
+		if(threads > 1)
+			train_cache_release(cache_mb);
 		if(param->probability && 
 		   (param->svm_type == C_SVC || param->svm_type == NU_SVC))
 		{
 			double *prob_estimates=Malloc(double,svm_get_nr_class(submodel));
 			for(j=begin;j<end;j++)
-				target[perm[j]] = svm_predict_probability(submodel,prob->x[perm[j]],prob_estimates);
+				target[perm[j]] = svm_predict_probability(submodel,x[j],prob_estimates);
 			free(prob_estimates);			
 		}
 		else
 			for(j=begin;j<end;j++)
-				target[perm[j]] = svm_predict(submodel,prob->x[perm[j]]);
+				target[perm[j]] = svm_predict(submodel,x[j]);
 		svm_free_and_destroy_model(&submodel);
-		free(subprob.x);
-		free(subprob.y);
 	}		
+	delete segments;
+	free(class_of);
+	free(group_pos);
+	free(start);
+	free(count);
+	free(pos);
+	free(x);
+	free(y);
 	free(fold_start);
 	free(perm);	
 }
@@ -2481,6 +3561,11 @@ double svm_get_svr_probability(const svm_model *model)
 	}
 }
 
+double svm_k_function(const svm_node *x, const svm_node *y, const svm_parameter *param)
+{
+	return Kernel::k_function(x,y,*param);
+}
+
 #ifdef DBG_COEFF
 FILE* myout = NULL;
 #endif
@@ -2744,69 +3829,369 @@ double svm_predict_probability(
 		return svm_predict(model, x);
 }
 
-static const char *svm_type_table[] =
-{
-	"c_svc","nu_svc","one_class","epsilon_svr","nu_svr",NULL
-};
+//
+// Batched probability estimates
+//
+// The workspace holds everything svm_predict_probability allocates per
+// call.  Samples are processed in chunks of PROB_BATCH_CHUNK; the pairwise
+// coupling matrices of a chunk are stored with the sample index innermost
+// so every step of multiclass_probability runs over the whole chunk in one
+// loop.  Each sample sees the same operations in the same order as the
+// single-sample path, so the estimates are identical.
+//
+#define PROB_BATCH_CHUNK 32
 
-static const char *kernel_type_table[]=
+struct svm_probability_workspace
 {
-	"linear","polynomial","rbf","sigmoid","precomputed",NULL
+	int nr_class;
+	int l;
+	double *kvalue;		// l
+	int *start;			// nr_class
+	double *dec_values;	// chunk x pairs
+	double *Q;			// nr_class x nr_class x chunk
+	double *Qp;			// nr_class x chunk
+	double *p;			// nr_class x chunk
+	double *pQp;		// chunk
+	double *diff;		// chunk
+	int *slot;			// chunk, sample held by each column
 };
 
-int svm_save_model(const char *model_file_name, const svm_model *model)
+struct svm_probability_workspace *svm_create_probability_workspace(const svm_model *model)
 {
-	FILE *fp = fopen(model_file_name,"w");
-	if(fp==NULL) return -1;
+	int k = model->nr_class;
+	int S = PROB_BATCH_CHUNK;
+	svm_probability_workspace *ws = Malloc(svm_probability_workspace,1);
+
+	ws->nr_class = k;
+	ws->l = model->l;
+	ws->kvalue = Malloc(double,max(model->l,1));
+	ws->start = Malloc(int,k);
+	ws->dec_values = Malloc(double,S*max(k*(k-1)/2,1));
+	ws->Q = Malloc(double,k*k*S);
+	ws->Qp = Malloc(double,k*S);
+	ws->p = Malloc(double,k*S);
+	ws->pQp = Malloc(double,S);
+	ws->diff = Malloc(double,S);
+	ws->slot = Malloc(int,S);
+	return ws;
+}
 
-	const svm_parameter& param = model->param;
+void svm_free_probability_workspace(struct svm_probability_workspace **ws_ptr_ptr)
+{
+	svm_probability_workspace *ws = *ws_ptr_ptr;
+	if(ws == NULL)
+		return;
+	free(ws->kvalue);
+	free(ws->start);
+	free(ws->dec_values);
+	free(ws->Q);
+	free(ws->Qp);
+	free(ws->p);
+	free(ws->pQp);
+	free(ws->diff);
+	free(ws->slot);
+	free(ws);
+	*ws_ptr_ptr = NULL;
+}
 
-	fprintf(fp,"svm_type %s\n", svm_type_table[param.svm_type]);
-	fprintf(fp,"kernel_type %s\n", kernel_type_table[param.kernel_type]);
+// svm_predict_values for classification without its per-call allocations,
+// decision value p goes to dec_values[p*stride]
+static void classification_decision_values(const svm_model *model, const svm_node *x,
+										   double *dec_values, int stride, double *kvalue, const int *start)
+{
+	int nr_class = model->nr_class;
+	int i, k;
 
-	if(param.kernel_type == POLY)
-		fprintf(fp,"degree %d\n", param.degree);
+	for(i=0;i<model->l;i++)
+		kvalue[i] = Kernel::k_function(x,model->SV[i],model->param);
 
-	if(param.kernel_type == POLY || param.kernel_type == RBF || param.kernel_type == SIGMOID)
-		fprintf(fp,"gamma %g\n", param.gamma);
+	int p=0;
+	for(i=0;i<nr_class;i++)
+		for(int j=i+1;j<nr_class;j++)
+		{
+			double sum = 0;
+			int si = start[i];
+			int sj = start[j];
+			int ci = model->nSV[i];
+			int cj = model->nSV[j];
+			double *coef1 = model->sv_coef[j-1];
+			double *coef2 = model->sv_coef[i];
+
+			for(k=0;k<ci;k++)
+				sum += coef1[si+k] * kvalue[si+k];
+			for(k=0;k<cj;k++)
+				sum += coef2[sj+k] * kvalue[sj+k];
+			sum -= model->rho[p];
+			dec_values[p*stride] = sum;
+			p++;
+		}
+}
 
-	if(param.kernel_type == POLY || param.kernel_type == SIGMOID)
-		fprintf(fp,"coef0 %g\n", param.coef0);
+// index of pair (i,j), i<j, in the one-vs-one order
+static inline int pair_index(int k, int i, int j)
+{
+	return i*k - i*(i+1)/2 + (j-i-1);
+}
 
-	int nr_class = model->nr_class;
-	int l = model->l;
-	fprintf(fp, "nr_class %d\n", nr_class);
-	fprintf(fp, "total_sv %d\n",l);
-	
-	{
-		fprintf(fp, "rho");
-		for(int i=0;i<nr_class*(nr_class-1)/2;i++)
-			fprintf(fp," %g",model->rho[i]);
-		fprintf(fp, "\n");
-	}
-	
-	if(model->label)
+// multiclass_probability for n samples; r holds r[i][j] (i<j) of sample s
+// at r[pair*S+s], estimates go to p_out[s*k..]
+static void multiclass_probability_batch(int k, int n, const double *r, double *p_out, svm_probability_workspace *ws)
+{
+	const int S = PROB_BATCH_CHUNK;
+	double *Q = ws->Q, *Qp = ws->Qp, *p = ws->p, *pQp = ws->pQp, *diff = ws->diff;
+	int *slot = ws->slot;
+	int t, j, s, iter, max_iter = max(100,k);
+	int active = n;
+	double eps = 0.005/k;
+
+	for(s=0;s<n;s++)
+		slot[s] = s;
+	for(t=0;t<k;t++)
 	{
-		fprintf(fp, "label");
-		for(int i=0;i<nr_class;i++)
-			fprintf(fp," %d",model->label[i]);
-		fprintf(fp, "\n");
+		double *Qtt = &Q[(t*k+t)*S];
+		for(s=0;s<n;s++)
+		{
+			p[t*S+s] = 1.0/k;
+			Qtt[s] = 0;
+		}
+		for(j=0;j<t;j++)
+		{
+			const double *rjt = &r[pair_index(k,j,t)*S];
+			const double *Qjt = &Q[(j*k+t)*S];
+			double *Qtj = &Q[(t*k+j)*S];
+			for(s=0;s<n;s++)
+			{
+				Qtt[s] += rjt[s]*rjt[s];
+				Qtj[s] = Qjt[s];
+			}
+		}
+		for(j=t+1;j<k;j++)
+		{
+			const double *rtj = &r[pair_index(k,t,j)*S];
+			double *Qtj = &Q[(t*k+j)*S];
+			for(s=0;s<n;s++)
+			{
+				double rjt = 1-rtj[s];
+				Qtt[s] += rjt*rjt;
+				Qtj[s] = -rjt*rtj[s];
+			}
+		}
 	}
 
-	if(model->probA) // regression has probA only
-	{
-		fprintf(fp, "probA");
-		for(int i=0;i<nr_class*(nr_class-1)/2;i++)
-			fprintf(fp," %g",model->probA[i]);
-		fprintf(fp, "\n");
-	}
-	if(model->probB)
+	for(iter=0;iter<max_iter && active>0;iter++)
 	{
-		fprintf(fp, "probB");
-		for(int i=0;i<nr_class*(nr_class-1)/2;i++)
-			fprintf(fp," %g",model->probB[i]);
-		fprintf(fp, "\n");
-	}
+		// stopping condition, recalculate QP,pQP for numerical accuracy
+		for(s=0;s<active;s++)
+			pQp[s] = 0;
+		for(t=0;t<k;t++)
+		{
+			double *Qpt = &Qp[t*S];
+			for(s=0;s<active;s++)
+				Qpt[s] = 0;
+			for(j=0;j<k;j++)
+			{
+				const double *Qtj = &Q[(t*k+j)*S];
+				const double *pj = &p[j*S];
+				for(s=0;s<active;s++)
+					Qpt[s] += Qtj[s]*pj[s];
+			}
+			for(s=0;s<active;s++)
+				pQp[s] += p[t*S+s]*Qpt[s];
+		}
+
+		// retire converged samples, the last active column takes their place
+		for(s=active-1;s>=0;s--)
+		{
+			double max_error = 0;
+			for(t=0;t<k;t++)
+			{
+				double error = fabs(Qp[t*S+s]-pQp[s]);
+				if(error > max_error)
+					max_error = error;
+			}
+			if(max_error >= eps)
+				continue;
+
+			for(t=0;t<k;t++)
+				p_out[slot[s]*k+t] = p[t*S+s];
+			active--;
+			if(s != active)
+			{
+				for(t=0;t<k;t++)
+				{
+					p[t*S+s] = p[t*S+active];
+					Qp[t*S+s] = Qp[t*S+active];
+				}
+				for(t=0;t<k*k;t++)
+					Q[t*S+s] = Q[t*S+active];
+				pQp[s] = pQp[active];
+				slot[s] = slot[active];
+			}
+		}
+
+		for(t=0;t<k;t++)
+		{
+			const double *Qtt = &Q[(t*k+t)*S];
+			double *Qpt = &Qp[t*S];
+			double *pt = &p[t*S];
+			for(s=0;s<active;s++)
+			{
+				diff[s] = (-Qpt[s]+pQp[s])/Qtt[s];
+				pt[s] += diff[s];
+				pQp[s] = (pQp[s]+diff[s]*(diff[s]*Qtt[s]+2*Qpt[s]))/(1+diff[s])/(1+diff[s]);
+			}
+			for(j=0;j<k;j++)
+			{
+				const double *Qtj = &Q[(t*k+j)*S];
+				double *Qpj = &Qp[j*S];
+				double *pj = &p[j*S];
+				for(s=0;s<active;s++)
+				{
+					Qpj[s] = (Qpj[s]+diff[s]*Qtj[s])/(1+diff[s]);
+					pj[s] /= (1+diff[s]);
+				}
+			}
+		}
+	}
+	for(s=0;s<active;s++)
+	{
+		info("Exceeds max_iter in multiclass_prob\n");
+		for(t=0;t<k;t++)
+			p_out[slot[s]*k+t] = p[t*S+s];
+	}
+}
+
+int svm_predict_probability_batch(const svm_model *model, const svm_node *const *x, int n,
+								  double *prob_estimates, double *labels, struct svm_probability_workspace *ws)
+{
+	int i, s, q;
+	int nr_class = model->nr_class;
+
+	if(!((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
+		 model->probA!=NULL && model->probB!=NULL))
+	{
+		for(s=0;s<n;s++)
+			labels[s] = svm_predict(model,x[s]);
+		return 0;
+	}
+
+	svm_probability_workspace *own = NULL;
+	if(ws == NULL)
+		ws = own = svm_create_probability_workspace(model);
+	else if(ws->nr_class != nr_class || ws->l < model->l)
+	{
+		fprintf(stderr,"probability workspace does not match the model\n");
+		return -1;
+	}
+
+	int nr_pair = nr_class*(nr_class-1)/2;
+	double min_prob=1e-7;
+	ws->start[0] = 0;
+	for(i=1;i<nr_class;i++)
+		ws->start[i] = ws->start[i-1]+model->nSV[i-1];
+
+	for(int base=0;base<n;base+=PROB_BATCH_CHUNK)
+	{
+		int m = min(n-base,PROB_BATCH_CHUNK);
+		double *r = ws->dec_values;
+
+		for(s=0;s<m;s++)
+			classification_decision_values(model,x[base+s],r+s,PROB_BATCH_CHUNK,ws->kvalue,ws->start);
+
+		// sigmoid_predict over every pair of the chunk, one exp per value
+		for(q=0;q<nr_pair;q++)
+		{
+			double A = model->probA[q], B = model->probB[q];
+			double *rq = &r[q*PROB_BATCH_CHUNK];
+			for(s=0;s<m;s++)
+			{
+				double fApB = rq[s]*A+B;
+				double e = exp(-fabs(fApB));
+				double prob = (fApB >= 0) ? e/(1.0+e) : 1.0/(1+e);
+				rq[s] = min(max(prob,min_prob),1-min_prob);
+			}
+		}
+
+		double *p_out = &prob_estimates[(size_t)base*nr_class];
+		multiclass_probability_batch(nr_class,m,r,p_out,ws);
+
+		for(s=0;s<m;s++)
+		{
+			int prob_max_idx = 0;
+			for(i=1;i<nr_class;i++)
+				if(p_out[s*nr_class+i] > p_out[s*nr_class+prob_max_idx])
+					prob_max_idx = i;
+			labels[base+s] = model->label[prob_max_idx];
+		}
+	}
+
+	svm_free_probability_workspace(&own);
+	return 0;
+}
+
+static const char *svm_type_table[] =
+{
+	"c_svc","nu_svc","one_class","epsilon_svr","nu_svr",NULL
+};
+
+static const char *kernel_type_table[]=
+{
+	"linear","polynomial","rbf","sigmoid","precomputed",NULL
+};
+
+int svm_save_model(const char *model_file_name, const svm_model *model)
+{
+	FILE *fp = fopen(model_file_name,"w");
+	if(fp==NULL) return -1;
+
+	const svm_parameter& param = model->param;
+
+	fprintf(fp,"svm_type %s\n", svm_type_table[param.svm_type]);
+	fprintf(fp,"kernel_type %s\n", kernel_type_table[param.kernel_type]);
+
+	if(param.kernel_type == POLY)
+		fprintf(fp,"degree %d\n", param.degree);
+
+	if(param.kernel_type == POLY || param.kernel_type == RBF || param.kernel_type == SIGMOID)
+		fprintf(fp,"gamma %g\n", param.gamma);
+
+	if(param.kernel_type == POLY || param.kernel_type == SIGMOID)
+		fprintf(fp,"coef0 %g\n", param.coef0);
+
+	int nr_class = model->nr_class;
+	int l = model->l;
+	fprintf(fp, "nr_class %d\n", nr_class);
+	fprintf(fp, "total_sv %d\n",l);
+	
+	{
+		fprintf(fp, "rho");
+		for(int i=0;i<nr_class*(nr_class-1)/2;i++)
+			fprintf(fp," %g",model->rho[i]);
+		fprintf(fp, "\n");
+	}
+	
+	if(model->label)
+	{
+		fprintf(fp, "label");
+		for(int i=0;i<nr_class;i++)
+			fprintf(fp," %d",model->label[i]);
+		fprintf(fp, "\n");
+	}
+
+	if(model->probA) // regression has probA only
+	{
+		fprintf(fp, "probA");
+		for(int i=0;i<nr_class*(nr_class-1)/2;i++)
+			fprintf(fp," %g",model->probA[i]);
+		fprintf(fp, "\n");
+	}
+	if(model->probB)
+	{
+		fprintf(fp, "probB");
+		for(int i=0;i<nr_class*(nr_class-1)/2;i++)
+			fprintf(fp," %g",model->probB[i]);
+		fprintf(fp, "\n");
+	}
 
 	if(model->nSV)
 	{
@@ -2844,29 +4229,375 @@ int svm_save_model(const char *model_file_name, const svm_model *model)
 static char *line = NULL;
 static int max_line_len;
 
-static char* readline(FILE *input)
+//
+// Model file mapping
+//
+// The model file is mapped read-only (or read into one buffer when it
+// cannot be mapped) and parsed in place.  Text parsing relies on a zero
+// byte after the data; a mapping provides one through the zero-filled
+// tail of its last page, otherwise the file is read into a buffer.
+//
+struct svm_mapped_file
 {
-	int len;
+	char *data;
+	size_t size;
+	int is_mapped;		// 0 if data is a malloc'ed copy
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
 
-	if(fgets(line,max_line_len,input) == NULL)
-		return NULL;
+static size_t system_page_size()
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return si.dwPageSize;
+#else
+	return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
 
-	while(strrchr(line,'\n') == NULL)
+static void unmap_file(svm_mapped_file *mf)
+{
+	if(mf->is_mapped)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(mf->data);
+		CloseHandle(mf->mapping);
+		CloseHandle(mf->file);
+#else
+		munmap(mf->data,mf->size);
+#endif
+	}
+	else
+		free(mf->data);
+	mf->data = NULL;
+	mf->is_mapped = 0;
+}
+
+static int map_file(const char *file_name, svm_mapped_file *mf, bool need_terminator)
+{
+	mf->data = NULL;
+	mf->size = 0;
+	mf->is_mapped = 0;
+#ifdef _WIN32
+	mf->file = CreateFileA(file_name,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+	if(mf->file == INVALID_HANDLE_VALUE)
+		return -1;
+	LARGE_INTEGER file_size;
+	if(GetFileSizeEx(mf->file,&file_size) && file_size.QuadPart > 0)
 	{
-		max_line_len *= 2;
-		line = (char *) realloc(line,max_line_len);
-		len = (int) strlen(line);
-		if(fgets(line+len,max_line_len-len,input) == NULL)
+		mf->size = (size_t)file_size.QuadPart;
+		mf->mapping = CreateFileMappingA(mf->file,NULL,PAGE_READONLY,0,0,NULL);
+		if(mf->mapping != NULL)
+		{
+			mf->data = (char *)MapViewOfFile(mf->mapping,FILE_MAP_READ,0,0,0);
+			if(mf->data == NULL)
+				CloseHandle(mf->mapping);
+		}
+	}
+	if(mf->data == NULL)
+		CloseHandle(mf->file);
+#else
+	int fd = open(file_name,O_RDONLY);
+	if(fd < 0)
+		return -1;
+	struct stat st;
+	if(fstat(fd,&st) == 0 && st.st_size > 0)
+	{
+		mf->size = (size_t)st.st_size;
+		void *addr = mmap(NULL,mf->size,PROT_READ,MAP_PRIVATE,fd,0);
+		if(addr != MAP_FAILED)
+			mf->data = (char *)addr;
+	}
+	close(fd);
+#endif
+	if(mf->data != NULL)
+	{
+		mf->is_mapped = 1;
+		if(!need_terminator || mf->size % system_page_size() != 0)
+			return 0;
+		unmap_file(mf);
+	}
+
+	// fall back to a private, terminated copy
+	FILE *fp = fopen(file_name,"rb");
+	if(fp == NULL)
+		return -1;
+	fseek(fp,0,SEEK_END);
+	mf->size = (size_t)ftell(fp);
+	fseek(fp,0,SEEK_SET);
+	mf->data = Malloc(char,mf->size+1);
+	if(mf->data == NULL || fread(mf->data,1,mf->size,fp) != mf->size)
+	{
+		free(mf->data);
+		mf->data = NULL;
+		fclose(fp);
+		return -1;
+	}
+	mf->data[mf->size] = '\0';
+	fclose(fp);
+	return 0;
+}
+
+static const char *scan_token(const char *p, const char *end, char *tok, int max_len)
+{
+	int n = 0;
+	while(p < end && isspace((unsigned char)*p)) ++p;
+	while(p < end && !isspace((unsigned char)*p) && n < max_len)
+		tok[n++] = *p++;
+	tok[n] = '\0';
+	return p;
+}
+
+static const char *scan_int(const char *p, int *value)
+{
+	char *endptr;
+	long v = strtol(p,&endptr,10);
+	if(endptr != p) *value = (int)v;
+	return endptr;
+}
+
+static const char *scan_double(const char *p, double *value)
+{
+	char *endptr;
+	double v = strtod(p,&endptr);
+	if(endptr != p) *value = v;
+	return endptr;
+}
+
+// parse one "coef ... coef idx:val idx:val ..." line into x, return #nodes
+static int parse_sv_line(const char *p, int m, double **sv_coef, int i, svm_node *x)
+{
+	char *endptr;
+	int k, n = 0;
+
+	for(k=0;k<m;k++)
+	{
+		sv_coef[k][i] = strtod(p,&endptr);
+		p = endptr;
+	}
+	while(1)
+	{
+		while(*p == ' ' || *p == '\t') ++p;
+		if(*p == '\r' || *p == '\n' || *p == '\0')
+			break;
+		long index = strtol(p,&endptr,10);
+		if(endptr == p || *endptr != ':')
 			break;
+		p = endptr + 1;
+		x[n].index = (int)index;
+		x[n].value = strtod(p,&endptr);
+		p = endptr;
+		++n;
 	}
-	return line;
+	x[n].index = -1;
+	return n;
+}
+
+//
+// Model arena
+//
+// svm_load_model places everything a model owns (rho, label, probA/B, nSV,
+// sv_coef, SV and the nodes) in one block, so a model is released with a
+// single free and its SVs and coefficients share as few pages as possible.
+// With svm_set_huge_pages(1) the block is taken from large pages when the
+// OS grants them, and from normal pages otherwise.  The arena header sits
+// at the start of its own block.
+//
+#define ARENA_ALIGN 64
+
+struct svm_model_arena
+{
+	size_t size;
+	size_t used;
+	int is_mapped;		// 0: malloc, 1: VirtualAlloc / mmap
+};
+
+static int use_huge_pages = 0;
+
+int svm_set_huge_pages(int enable)
+{
+	use_huge_pages = enable;
+	if(!enable)
+		return 0;
+#ifdef _WIN32
+	// large pages need SeLockMemoryPrivilege enabled in the process token
+	HANDLE token;
+	TOKEN_PRIVILEGES tp;
+	BOOL granted = FALSE;
+	if(OpenProcessToken(GetCurrentProcess(),TOKEN_ADJUST_PRIVILEGES|TOKEN_QUERY,&token))
+	{
+		tp.PrivilegeCount = 1;
+		tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		if(LookupPrivilegeValueA(NULL,"SeLockMemoryPrivilege",&tp.Privileges[0].Luid) &&
+		   AdjustTokenPrivileges(token,FALSE,&tp,0,NULL,NULL) && GetLastError() == ERROR_SUCCESS)
+			granted = TRUE;
+		CloseHandle(token);
+	}
+	if(!granted || GetLargePageMinimum() == 0)
+		return -1;
+#endif
+	return 0;
+}
+
+static svm_model_arena *arena_create(size_t size)
+{
+	svm_model_arena *a = NULL;
+	int is_mapped = 0;
+
+	size += ARENA_ALIGN;	// header
+	if(use_huge_pages)
+	{
+#ifdef _WIN32
+		SIZE_T large = GetLargePageMinimum();
+		if(large > 0)
+		{
+			size = (size + large-1) / large * large;
+			a = (svm_model_arena *)VirtualAlloc(NULL,size,MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES,PAGE_READWRITE);
+		}
+		if(a == NULL)
+			a = (svm_model_arena *)VirtualAlloc(NULL,size,MEM_RESERVE|MEM_COMMIT,PAGE_READWRITE);
+#else
+		const size_t huge = 2*1024*1024;
+		size = (size + huge-1) / huge * huge;
+		void *addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		addr = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+#endif
+		if(addr == MAP_FAILED)
+		{
+			addr = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+#ifdef MADV_HUGEPAGE
+			if(addr != MAP_FAILED)
+				madvise(addr,size,MADV_HUGEPAGE);
+#endif
+		}
+		if(addr != MAP_FAILED)
+			a = (svm_model_arena *)addr;
+#endif
+		if(a != NULL)
+			is_mapped = 1;
+	}
+	if(a == NULL)
+		a = (svm_model_arena *)malloc(size);
+	if(a == NULL)
+		return NULL;
+	a->size = size;
+	a->used = ARENA_ALIGN;
+	a->is_mapped = is_mapped;
+	return a;
+}
+
+static void *arena_alloc(svm_model_arena *a, size_t bytes)
+{
+	void *p = (char *)a + a->used;
+	a->used += (bytes + ARENA_ALIGN-1) / ARENA_ALIGN * ARENA_ALIGN;
+	return p;
+}
+
+static size_t arena_bytes(size_t bytes)
+{
+	return (bytes + ARENA_ALIGN-1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+static void arena_release(svm_model_arena *a)
+{
+	if(!a->is_mapped)
+		free(a);
+	else
+	{
+#ifdef _WIN32
+		VirtualFree(a,0,MEM_RELEASE);
+#else
+		munmap(a,a->size);
+#endif
+	}
+}
+
+// copy a header array into the arena and free the parsed one
+template <class T> static T *arena_move(svm_model_arena *a, T *src, int n)
+{
+	if(src == NULL)
+		return NULL;
+	T *dst = (T *)arena_alloc(a,sizeof(T)*n);
+	memcpy(dst,src,sizeof(T)*n);
+	free(src);
+	return dst;
+}
+
+template <class T> static T *arena_copy(svm_model_arena *a, const T *src, int n)
+{
+	if(src == NULL)
+		return NULL;
+	T *dst = (T *)arena_alloc(a,sizeof(T)*n);
+	memcpy(dst,src,sizeof(T)*n);
+	return dst;
+}
+
+// Deep copy of a model into a new arena.  Pages are placed by whoever
+// touches them first, so a copy made by a thread pinned to a NUMA node
+// ends up local to that node.
+svm_model *svm_copy_model(const svm_model *model)
+{
+	int nr_class = model->nr_class;
+	int nr_pair = nr_class*(nr_class-1)/2;
+	int m = nr_class - 1;
+	int l = model->l;
+	size_t nodes = 0;
+	int i;
+
+	for(i=0;i<l;i++)
+	{
+		const svm_node *p = model->SV[i];
+		while(p->index != -1) ++p;
+		nodes += p - model->SV[i] + 1;
+	}
+	size_t size = arena_bytes(sizeof(double)*nr_pair)*3 + arena_bytes(sizeof(int)*nr_class)*2 +
+				  arena_bytes(sizeof(double *)*m) + arena_bytes(sizeof(double)*l)*m +
+				  arena_bytes(sizeof(svm_node *)*l) + arena_bytes(sizeof(svm_node)*nodes);
+	svm_model_arena *arena = arena_create(size);
+	if(arena == NULL)
+		return NULL;
+
+	svm_model *copy = Malloc(svm_model,1);
+	copy->param = model->param;
+	copy->param.nr_weight = 0;
+	copy->param.weight_label = NULL;
+	copy->param.weight = NULL;
+	copy->nr_class = nr_class;
+	copy->l = l;
+	copy->rho = arena_copy(arena,model->rho,nr_pair);
+	copy->probA = arena_copy(arena,model->probA,nr_pair);
+	copy->probB = arena_copy(arena,model->probB,nr_pair);
+	copy->label = arena_copy(arena,model->label,nr_class);
+	copy->nSV = arena_copy(arena,model->nSV,nr_class);
+	copy->sv_coef = (double **)arena_alloc(arena,sizeof(double *)*m);
+	for(i=0;i<m;i++)
+		copy->sv_coef[i] = arena_copy(arena,model->sv_coef[i],l);
+	copy->SV = (svm_node **)arena_alloc(arena,sizeof(svm_node *)*l);
+	svm_node *x_space = (svm_node *)arena_alloc(arena,sizeof(svm_node)*nodes);
+	for(i=0;i<l;i++)
+	{
+		const svm_node *p = model->SV[i];
+		copy->SV[i] = x_space;
+		do *x_space++ = *p; while((p++)->index != -1);
+	}
+	copy->free_sv = 1;
+	copy->mapped_file = NULL;
+	copy->arena = arena;
+	return copy;
 }
 
 svm_model *svm_load_model(const char *model_file_name)
 {
-	FILE *fp = fopen(model_file_name,"rb");
-	if(fp==NULL) return NULL;
-	
+	svm_mapped_file mf;
+	if(map_file(model_file_name,&mf,true) != 0) return NULL;
+	const char *p = mf.data;
+	const char *end = mf.data + mf.size;
+
 	// read parameters
 
 	svm_model *model = Malloc(svm_model,1);
@@ -2880,11 +4611,11 @@ svm_model *svm_load_model(const char *model_file_name)
 	char cmd[81];
 	while(1)
 	{
-		fscanf(fp,"%80s",cmd);
+		p = scan_token(p,end,cmd,80);
 
 		if(strcmp(cmd,"svm_type")==0)
 		{
-			fscanf(fp,"%80s",cmd);
+			p = scan_token(p,end,cmd,80);
 			int i;
 			for(i=0;svm_type_table[i];i++)
 			{
@@ -2901,12 +4632,13 @@ svm_model *svm_load_model(const char *model_file_name)
 				free(model->label);
 				free(model->nSV);
 				free(model);
+				unmap_file(&mf);
 				return NULL;
 			}
 		}
 		else if(strcmp(cmd,"kernel_type")==0)
-		{		
-			fscanf(fp,"%80s",cmd);
+		{
+			p = scan_token(p,end,cmd,80);
 			int i;
 			for(i=0;kernel_type_table[i];i++)
 			{
@@ -2923,61 +4655,60 @@ svm_model *svm_load_model(const char *model_file_name)
 				free(model->label);
 				free(model->nSV);
 				free(model);
+				unmap_file(&mf);
 				return NULL;
 			}
 		}
 		else if(strcmp(cmd,"degree")==0)
-			fscanf(fp,"%d",&param.degree);
+			p = scan_int(p,&param.degree);
 		else if(strcmp(cmd,"gamma")==0)
-			fscanf(fp,"%lf",&param.gamma);
+			p = scan_double(p,&param.gamma);
 		else if(strcmp(cmd,"coef0")==0)
-			fscanf(fp,"%lf",&param.coef0);
+			p = scan_double(p,&param.coef0);
 		else if(strcmp(cmd,"nr_class")==0)
-			fscanf(fp,"%d",&model->nr_class);
+			p = scan_int(p,&model->nr_class);
 		else if(strcmp(cmd,"total_sv")==0)
-			fscanf(fp,"%d",&model->l);
+			p = scan_int(p,&model->l);
 		else if(strcmp(cmd,"rho")==0)
 		{
 			int n = model->nr_class * (model->nr_class-1)/2;
 			model->rho = Malloc(double,n);
 			for(int i=0;i<n;i++)
-				fscanf(fp,"%lf",&model->rho[i]);
+				p = scan_double(p,&model->rho[i]);
 		}
 		else if(strcmp(cmd,"label")==0)
 		{
 			int n = model->nr_class;
 			model->label = Malloc(int,n);
 			for(int i=0;i<n;i++)
-				fscanf(fp,"%d",&model->label[i]);
+				p = scan_int(p,&model->label[i]);
 		}
 		else if(strcmp(cmd,"probA")==0)
 		{
 			int n = model->nr_class * (model->nr_class-1)/2;
 			model->probA = Malloc(double,n);
 			for(int i=0;i<n;i++)
-				fscanf(fp,"%lf",&model->probA[i]);
+				p = scan_double(p,&model->probA[i]);
 		}
 		else if(strcmp(cmd,"probB")==0)
 		{
 			int n = model->nr_class * (model->nr_class-1)/2;
 			model->probB = Malloc(double,n);
 			for(int i=0;i<n;i++)
-				fscanf(fp,"%lf",&model->probB[i]);
+				p = scan_double(p,&model->probB[i]);
 		}
 		else if(strcmp(cmd,"nr_sv")==0)
 		{
 			int n = model->nr_class;
 			model->nSV = Malloc(int,n);
 			for(int i=0;i<n;i++)
-				fscanf(fp,"%d",&model->nSV[i]);
+				p = scan_int(p,&model->nSV[i]);
 		}
 		else if(strcmp(cmd,"SV")==0)
 		{
-			while(1)
-			{
-				int c = getc(fp);
-				if(c==EOF || c=='\n') break;	
-			}
+			while(p < end && *p != '\n')
+				++p;
+			if(p < end) ++p;
 			break;
 		}
 		else
@@ -2987,83 +4718,409 @@ svm_model *svm_load_model(const char *model_file_name)
 			free(model->label);
 			free(model->nSV);
 			free(model);
+			unmap_file(&mf);
 			return NULL;
 		}
 	}
 
-	// read sv_coef and SV
-
-	int elements = 0;
-	long pos = ftell(fp);
+	// one scan over the SV section: line starts and the number of nodes
+	// each line needs (one per ':' plus the -1 terminator)
 
-	max_line_len = 1024;
-	line = Malloc(char,max_line_len);
-	char *p,*endptr,*idx,*val;
+	int m = model->nr_class - 1;
+	int l = model->l;
+	const char **sv_line = Malloc(const char *,l+1);
+	int *sv_start = Malloc(int,l+1);
+	int i;
 
-	while(readline(fp)!=NULL)
+	sv_start[0] = 0;
+	for(i=0;i<l && p<end;i++)
 	{
-		p = strtok(line,":");
-		while(1)
+		int colons = 0;
+		sv_line[i] = p;
+		while(p < end && *p != '\n')
 		{
-			p = strtok(NULL,":");
-			if(p == NULL)
-				break;
-			++elements;
+			if(*p == ':') ++colons;
+			++p;
 		}
+		if(p < end) ++p;
+		sv_start[i+1] = sv_start[i] + colons + 1;
+	}
+	if(i < l)
+	{
+		fprintf(stderr,"model file has %d of %d support vectors\n",i,l);
+		free(sv_line);
+		free(sv_start);
+		free(model->rho);
+		free(model->label);
+		free(model->probA);
+		free(model->probB);
+		free(model->nSV);
+		free(model);
+		unmap_file(&mf);
+		return NULL;
 	}
-	elements += model->l;
-
-	fseek(fp,pos,SEEK_SET);
 
-	int m = model->nr_class - 1;
-	int l = model->l;
-	model->sv_coef = Malloc(double *,m);
-	int i;
+	int nr_class = model->nr_class;
+	int nr_pair = nr_class*(nr_class-1)/2;
+	size_t size = arena_bytes(sizeof(double)*nr_pair)*3 + arena_bytes(sizeof(int)*nr_class)*2 +
+				  arena_bytes(sizeof(double *)*m) + arena_bytes(sizeof(double)*l)*m +
+				  arena_bytes(sizeof(svm_node *)*l) + arena_bytes(sizeof(svm_node)*sv_start[l]);
+	svm_model_arena *arena = arena_create(size);
+	if(arena == NULL)
+	{
+		fprintf(stderr,"cannot allocate %lu bytes for the model\n",(unsigned long)size);
+		free(sv_line);
+		free(sv_start);
+		free(model->rho);
+		free(model->label);
+		free(model->probA);
+		free(model->probB);
+		free(model->nSV);
+		free(model);
+		unmap_file(&mf);
+		return NULL;
+	}
+	model->rho = arena_move(arena,model->rho,nr_pair);
+	model->probA = arena_move(arena,model->probA,nr_pair);
+	model->probB = arena_move(arena,model->probB,nr_pair);
+	model->label = arena_move(arena,model->label,nr_class);
+	model->nSV = arena_move(arena,model->nSV,nr_class);
+	model->sv_coef = (double **)arena_alloc(arena,sizeof(double *)*m);
 	for(i=0;i<m;i++)
-		model->sv_coef[i] = Malloc(double,l);
-	model->SV = Malloc(svm_node*,l);
-	svm_node *x_space = NULL;
-	if(l>0) x_space = Malloc(svm_node,elements);
+		model->sv_coef[i] = (double *)arena_alloc(arena,sizeof(double)*l);
+	model->SV = (svm_node **)arena_alloc(arena,sizeof(svm_node *)*l);
+	svm_node *x_space = (svm_node *)arena_alloc(arena,sizeof(svm_node)*sv_start[l]);
 
-	int j=0;
+	// the lines are independent now that every SV knows its slot
+#pragma omp parallel for schedule(static) if(l > 1000)
 	for(i=0;i<l;i++)
 	{
-		readline(fp);
-		model->SV[i] = &x_space[j];
+		model->SV[i] = &x_space[sv_start[i]];
+		parse_sv_line(sv_line[i],m,model->sv_coef,i,model->SV[i]);
+	}
+	free(sv_line);
+	free(sv_start);
+	unmap_file(&mf);
 
-		p = strtok(line, " \t");
-		model->sv_coef[0][i] = strtod(p,&endptr);
-		for(int k=1;k<m;k++)
+	model->free_sv = 1;	// XXX
+	model->mapped_file = NULL;
+	model->arena = arena;
+	return model;
+}
+
+//
+// Binary model format
+//
+// Sections follow a fixed header, each starting on a SVM_BINARY_ALIGN
+// boundary, in the in-memory layout svm_model uses.  svm_load_model_binary
+// maps the file and points the model arrays straight into the mapping, so
+// loading costs a header check plus the two pointer tables (sv_coef, SV),
+// and processes loading the same file share one page-cache copy.  Values
+// are stored exactly, unlike the %g text format.  The file is only
+// readable on machines with the byte order and svm_node size it was
+// written with.
+//
+#define SVM_BINARY_MAGIC	"LIBSVMB"
+#define SVM_BINARY_VERSION	1
+#define SVM_BINARY_ALIGN	64
+#define SVM_BINARY_BYTE_ORDER	0x01020304u
+
+struct svm_binary_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t byte_order;
+	uint32_t node_size;
+	int32_t svm_type;
+	int32_t kernel_type;
+	int32_t degree;
+	int32_t nr_class;
+	int32_t l;
+	int32_t has_label;
+	int32_t has_nSV;
+	int32_t has_probA;
+	int32_t has_probB;
+	int32_t reserved;
+	double gamma;
+	double coef0;
+	uint64_t rho_offset;		// double[k*(k-1)/2]
+	uint64_t probA_offset;		// double[k*(k-1)/2], if has_probA
+	uint64_t probB_offset;		// double[k*(k-1)/2], if has_probB
+	uint64_t label_offset;		// int32[k], if has_label
+	uint64_t nSV_offset;		// int32[k], if has_nSV
+	uint64_t sv_coef_offset;	// double[k-1][l]
+	uint64_t sv_start_offset;	// uint64[l+1], first node of each SV
+	uint64_t node_offset;		// svm_node[nr_node]
+	uint64_t nr_node;
+	uint64_t file_size;
+};
+
+static uint64_t binary_align(uint64_t offset)
+{
+	return (offset + SVM_BINARY_ALIGN - 1) & ~(uint64_t)(SVM_BINARY_ALIGN - 1);
+}
+
+static bool binary_pad(FILE *fp, uint64_t *pos, uint64_t offset)
+{
+	static const char zero[SVM_BINARY_ALIGN] = {0};
+	size_t n = (size_t)(offset - *pos);
+	*pos = offset;
+	return n == 0 || fwrite(zero,1,n,fp) == n;
+}
+
+// precomputed-kernel SVs only keep their 0:serial_number node, as in the text format
+static int binary_sv_length(const svm_model *model, const svm_node *p)
+{
+	int n = 0;
+	if(model->param.kernel_type == PRECOMPUTED)
+		return 1;
+	while(p[n].index != -1) ++n;
+	return n;
+}
+
+int svm_save_model_binary(const char *model_file_name, const svm_model *model)
+{
+	int nr_class = model->nr_class;
+	int l = model->l;
+	int n_pair = nr_class*(nr_class-1)/2;
+	int i;
+	svm_binary_header h;
+
+	memset(&h,0,sizeof(h));
+	memcpy(h.magic,SVM_BINARY_MAGIC,sizeof(h.magic));
+	h.version = SVM_BINARY_VERSION;
+	h.header_size = sizeof(svm_binary_header);
+	h.byte_order = SVM_BINARY_BYTE_ORDER;
+	h.node_size = sizeof(svm_node);
+	h.svm_type = model->param.svm_type;
+	h.kernel_type = model->param.kernel_type;
+	// like the text format, only keep the kernel parameters the kernel uses
+	const svm_parameter& param = model->param;
+	if(param.kernel_type == POLY)
+		h.degree = param.degree;
+	if(param.kernel_type == POLY || param.kernel_type == RBF || param.kernel_type == SIGMOID)
+		h.gamma = param.gamma;
+	if(param.kernel_type == POLY || param.kernel_type == SIGMOID)
+		h.coef0 = param.coef0;
+	h.nr_class = nr_class;
+	h.l = l;
+	h.has_label = model->label != NULL;
+	h.has_nSV = model->nSV != NULL;
+	h.has_probA = model->probA != NULL;
+	h.has_probB = model->probB != NULL;
+
+	h.nr_node = 0;
+	for(i=0;i<l;i++)
+		h.nr_node += binary_sv_length(model,model->SV[i]) + 1;
+
+	uint64_t offset = binary_align(sizeof(h));
+	h.rho_offset = offset;		offset = binary_align(offset + n_pair*sizeof(double));
+	h.probA_offset = offset;	if(h.has_probA) offset = binary_align(offset + n_pair*sizeof(double));
+	h.probB_offset = offset;	if(h.has_probB) offset = binary_align(offset + n_pair*sizeof(double));
+	h.label_offset = offset;	if(h.has_label) offset = binary_align(offset + nr_class*sizeof(int32_t));
+	h.nSV_offset = offset;		if(h.has_nSV) offset = binary_align(offset + nr_class*sizeof(int32_t));
+	h.sv_coef_offset = offset;	offset = binary_align(offset + (uint64_t)(nr_class-1)*l*sizeof(double));
+	h.sv_start_offset = offset;	offset = binary_align(offset + (uint64_t)(l+1)*sizeof(uint64_t));
+	h.node_offset = offset;		offset += h.nr_node*sizeof(svm_node);
+	h.file_size = offset;
+
+	FILE *fp = fopen(model_file_name,"wb");
+	if(fp==NULL) return -1;
+
+	uint64_t pos = sizeof(h);
+	bool ok = fwrite(&h,sizeof(h),1,fp) == 1;
+
+	ok = ok && binary_pad(fp,&pos,h.rho_offset) && fwrite(model->rho,sizeof(double),n_pair,fp) == (size_t)n_pair;
+	pos += n_pair*sizeof(double);
+	if(h.has_probA)
+	{
+		ok = ok && binary_pad(fp,&pos,h.probA_offset) && fwrite(model->probA,sizeof(double),n_pair,fp) == (size_t)n_pair;
+		pos += n_pair*sizeof(double);
+	}
+	if(h.has_probB)
+	{
+		ok = ok && binary_pad(fp,&pos,h.probB_offset) && fwrite(model->probB,sizeof(double),n_pair,fp) == (size_t)n_pair;
+		pos += n_pair*sizeof(double);
+	}
+	if(h.has_label)
+	{
+		ok = ok && binary_pad(fp,&pos,h.label_offset);
+		for(i=0;i<nr_class && ok;i++)
 		{
-			p = strtok(NULL, " \t");
-			model->sv_coef[k][i] = strtod(p,&endptr);
+			int32_t v = model->label[i];
+			ok = fwrite(&v,sizeof(v),1,fp) == 1;
 		}
-
-		while(1)
+		pos += nr_class*sizeof(int32_t);
+	}
+	if(h.has_nSV)
+	{
+		ok = ok && binary_pad(fp,&pos,h.nSV_offset);
+		for(i=0;i<nr_class && ok;i++)
 		{
-			idx = strtok(NULL, ":");
-			val = strtok(NULL, " \t");
+			int32_t v = model->nSV[i];
+			ok = fwrite(&v,sizeof(v),1,fp) == 1;
+		}
+		pos += nr_class*sizeof(int32_t);
+	}
 
-			if(val == NULL)
-				break;
-			x_space[j].index = (int) strtol(idx,&endptr,10);
-			x_space[j].value = strtod(val,&endptr);
+	ok = ok && binary_pad(fp,&pos,h.sv_coef_offset);
+	for(i=0;i<nr_class-1 && ok;i++)
+		ok = fwrite(model->sv_coef[i],sizeof(double),l,fp) == (size_t)l;
+	pos += (uint64_t)(nr_class-1)*l*sizeof(double);
 
-			++j;
+	ok = ok && binary_pad(fp,&pos,h.sv_start_offset);
+	uint64_t start = 0;
+	for(i=0;i<=l && ok;i++)
+	{
+		ok = fwrite(&start,sizeof(start),1,fp) == 1;
+		if(i<l) start += binary_sv_length(model,model->SV[i]) + 1;
+	}
+	pos += (uint64_t)(l+1)*sizeof(uint64_t);
+
+	// nodes go out one at a time so the struct padding is written as zeros
+	ok = ok && binary_pad(fp,&pos,h.node_offset);
+	for(i=0;i<l && ok;i++)
+	{
+		const svm_node *p = model->SV[i];
+		int n = binary_sv_length(model,p);
+		for(int j=0;j<=n && ok;j++)
+		{
+			svm_node node;
+			memset(&node,0,sizeof(node));
+			node.index = j<n ? p[j].index : -1;
+			node.value = j<n ? p[j].value : 0;
+			ok = fwrite(&node,sizeof(node),1,fp) == 1;
 		}
-		x_space[j++].index = -1;
 	}
-	free(line);
 
-	if (ferror(fp) != 0 || fclose(fp) != 0)
+	if(!ok)
+	{
+		fclose(fp);
+		return -1;
+	}
+	if (ferror(fp) != 0 || fclose(fp) != 0) return -1;
+	return 0;
+}
+
+// returns NULL if the mapped image is a usable model, else the reason
+static const char *check_binary_model(const svm_mapped_file *mf)
+{
+	const svm_binary_header *h = (const svm_binary_header *)mf->data;
+
+	if(mf->size < sizeof(svm_binary_header) || memcmp(h->magic,SVM_BINARY_MAGIC,sizeof(h->magic)) != 0)
+		return "not a binary model file";
+	if(h->version != SVM_BINARY_VERSION || h->header_size != sizeof(svm_binary_header))
+		return "unsupported binary model version";
+	if(h->byte_order != SVM_BINARY_BYTE_ORDER || h->node_size != sizeof(svm_node))
+		return "binary model was written on an incompatible machine";
+	if(h->file_size != mf->size)
+		return "binary model file is truncated";
+	if(h->nr_class < 2 || h->l < 0 || h->svm_type < C_SVC || h->svm_type > NU_SVR ||
+	   h->kernel_type < LINEAR || h->kernel_type > PRECOMPUTED)
+		return "bad binary model header";
+
+	uint64_t n_pair = (uint64_t)h->nr_class*(h->nr_class-1)/2;
+	struct { uint64_t offset, size; int present; } section[] =
+	{
+		{ h->rho_offset, n_pair*sizeof(double), 1 },
+		{ h->probA_offset, n_pair*sizeof(double), h->has_probA },
+		{ h->probB_offset, n_pair*sizeof(double), h->has_probB },
+		{ h->label_offset, h->nr_class*sizeof(int32_t), h->has_label },
+		{ h->nSV_offset, h->nr_class*sizeof(int32_t), h->has_nSV },
+		{ h->sv_coef_offset, (uint64_t)(h->nr_class-1)*h->l*sizeof(double), 1 },
+		{ h->sv_start_offset, (uint64_t)(h->l+1)*sizeof(uint64_t), 1 },
+		{ h->node_offset, h->nr_node*sizeof(svm_node), 1 },
+	};
+	for(size_t s=0;s<sizeof(section)/sizeof(section[0]);s++)
+		if(section[s].present && (section[s].offset % sizeof(double) != 0 ||
+		   section[s].offset > mf->size || section[s].size > mf->size - section[s].offset))
+			return "bad binary model section";
+
+	// every SV must end in its own -1 node, so prediction cannot run off the end
+	const uint64_t *sv_start = (const uint64_t *)(mf->data + h->sv_start_offset);
+	const svm_node *node = (const svm_node *)(mf->data + h->node_offset);
+	if(sv_start[0] != 0 || sv_start[h->l] != h->nr_node)
+		return "bad binary model SV table";
+	for(int i=0;i<h->l;i++)
+		if(sv_start[i+1] <= sv_start[i] || sv_start[i+1] > h->nr_node || node[sv_start[i+1]-1].index != -1)
+			return "bad binary model SV table";
+	return NULL;
+}
+
+svm_model *svm_load_model_binary(const char *model_file_name)
+{
+	svm_mapped_file *mf = Malloc(svm_mapped_file,1);
+	if(map_file(model_file_name,mf,false) != 0)
+	{
+		free(mf);
+		return NULL;
+	}
+
+	const char *error = check_binary_model(mf);
+	if(error != NULL)
+	{
+		fprintf(stderr,"%s: %s\n",model_file_name,error);
+		unmap_file(mf);
+		free(mf);
 		return NULL;
+	}
 
-	model->free_sv = 1;	// XXX
+	// the arrays below point into the read-only mapping and must not be written
+	char *base = mf->data;
+	const svm_binary_header *h = (const svm_binary_header *)base;
+	svm_model *model = Malloc(svm_model,1);
+	memset(&model->param,0,sizeof(model->param));
+	model->param.svm_type = h->svm_type;
+	model->param.kernel_type = h->kernel_type;
+	model->param.degree = h->degree;
+	model->param.gamma = h->gamma;
+	model->param.coef0 = h->coef0;
+	model->nr_class = h->nr_class;
+	model->l = h->l;
+	model->rho = (double *)(base + h->rho_offset);
+	model->probA = h->has_probA ? (double *)(base + h->probA_offset) : NULL;
+	model->probB = h->has_probB ? (double *)(base + h->probB_offset) : NULL;
+	model->label = h->has_label ? (int *)(base + h->label_offset) : NULL;
+	model->nSV = h->has_nSV ? (int *)(base + h->nSV_offset) : NULL;
+
+	int m = model->nr_class - 1;
+	int l = model->l;
+	double *sv_coef = (double *)(base + h->sv_coef_offset);
+	const uint64_t *sv_start = (const uint64_t *)(base + h->sv_start_offset);
+	svm_node *node = (svm_node *)(base + h->node_offset);
+
+	model->sv_coef = Malloc(double *,m);
+	for(int i=0;i<m;i++)
+		model->sv_coef[i] = sv_coef + (size_t)i*l;
+	model->SV = Malloc(svm_node*,l);
+	for(int i=0;i<l;i++)
+		model->SV[i] = node + sv_start[i];
+
+	model->free_sv = 0;
+	model->mapped_file = mf;
+	model->arena = NULL;
 	return model;
 }
 
 void svm_free_model_content(svm_model* model_ptr)
 {
+	if(model_ptr->arena != NULL)
+	{
+		arena_release(model_ptr->arena);
+		model_ptr->arena = NULL;
+		return;
+	}
+	if(model_ptr->mapped_file != NULL)
+	{
+		// only the pointer tables were allocated, the rest is in the mapping
+		free(model_ptr->SV);
+		free(model_ptr->sv_coef);
+		unmap_file(model_ptr->mapped_file);
+		free(model_ptr->mapped_file);
+		model_ptr->mapped_file = NULL;
+		return;
+	}
 	if(model_ptr->free_sv && model_ptr->l > 0)
 		free((void *)(model_ptr->SV[0]));
 	for(int i=0;i<model_ptr->nr_class-1;i++)
@@ -3484,5 +5541,7 @@ svm_model *embedded_load_model(char *model_param_data, char *model_sv_data, char
 	}
 
 	model->free_sv = 1;	// XXX
+	model->mapped_file = NULL;
+	model->arena = NULL;
 	return model;
 }
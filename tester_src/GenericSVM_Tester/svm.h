@@ -68,23 +68,60 @@ struct svm_model
 	/* XXX */
 	int free_sv;		/* 1 if svm_model is created by svm_load_model*/
 				/* 0 if svm_model is created by svm_train */
+	struct svm_mapped_file *mapped_file;	/* non-NULL if created by svm_load_model_binary, */
+				/* the arrays then point into this read-only mapping */
+	struct svm_model_arena *arena;	/* non-NULL if created by svm_load_model, all arrays */
+				/* and SVs then live in this one block */
 };
 
 struct svm_model *svm_train(const struct svm_problem *prob, const struct svm_parameter *param);
+struct svm_model *svm_train_warm(const struct svm_problem *prob, const struct svm_parameter *param,
+				 const struct svm_model *prior, const int *sv_index);	/* C-SVC pairs start from */
+				/* prior's coefficients; sv_index[r] is the prior SV of row r or -1, NULL to match by features */
 void svm_cross_validation(const struct svm_problem *prob, const struct svm_parameter *param, int nr_fold, double *target);
+int svm_set_train_threads(int nr_threads, double cache_budget_mb);	/* one-vs-one pairs on up to nr_threads threads, */
+				/* their kernel caches capped at cache_budget_mb in total (<= 0: no cap) */
+void svm_set_shared_cache(double size_mb);	/* same-class kernel values shared by the one-vs-one pairs, */
+				/* up to size_mb (0: not shared) */
+
+/* kernel cache activity of every svm_train since the last call with reset != 0 */
+struct svm_cache_stats
+{
+	unsigned long hits;		/* column requests served entirely from the cache */
+	unsigned long misses;		/* requests that computed all or part of a column */
+	unsigned long evictions;	/* columns dropped to make room for another */
+};
+void svm_get_cache_stats(struct svm_cache_stats *stats, int reset);
+
+enum { SVM_CACHE_FLOAT, SVM_CACHE_FP16, SVM_CACHE_BF16 };	/* kernel cache precision */
+int svm_set_cache_precision(int precision);	/* 16-bit caches hold twice the columns, -1 if unknown */
 
 int svm_save_model(const char *model_file_name, const struct svm_model *model);
 struct svm_model *svm_load_model(const char *model_file_name);
+int svm_save_model_binary(const char *model_file_name, const struct svm_model *model);
+struct svm_model *svm_load_model_binary(const char *model_file_name);
+struct svm_model *svm_copy_model(const struct svm_model *model);	/* deep copy into a single arena */
+int svm_set_huge_pages(int enable);	/* back model arenas with large pages, -1 if the OS will not grant them */
 
 int svm_get_svm_type(const struct svm_model *model);
 int svm_get_nr_class(const struct svm_model *model);
 void svm_get_labels(const struct svm_model *model, int *label);
 double svm_get_svr_probability(const struct svm_model *model);
+double svm_k_function(const struct svm_node *x, const struct svm_node *y, const struct svm_parameter *param);
 
 double svm_predict_values(const struct svm_model *model, const struct svm_node *x, double* dec_values);
 double svm_predict(const struct svm_model *model, const struct svm_node *x);
 double svm_predict_probability(const struct svm_model *model, const struct svm_node *x, double* prob_estimates);
 
+/* batched svm_predict_probability: prob_estimates is n x nr_class, labels n, */
+/* ws may be NULL (allocated per call) or reused for any model of the same    */
+/* nr_class and no more SVs than it was created for */
+struct svm_probability_workspace;
+struct svm_probability_workspace *svm_create_probability_workspace(const struct svm_model *model);
+void svm_free_probability_workspace(struct svm_probability_workspace **ws_ptr_ptr);
+int svm_predict_probability_batch(const struct svm_model *model, const struct svm_node *const *x, int n,
+				  double *prob_estimates, double *labels, struct svm_probability_workspace *ws);
+
 void svm_free_model_content(struct svm_model *model_ptr);
 void svm_free_and_destroy_model(struct svm_model **model_ptr_ptr);
 void svm_destroy_param(struct svm_parameter *param);
@@ -0,0 +1,314 @@
+#include <math.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "svm_adaptive.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define SVM_ADAPTIVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define Malloc(type,n) (type *)malloc((n)*sizeof(type))
+
+// fp32 SV rows are padded with zeros to a multiple of 8 features
+#define ADAPTIVE_ROW_ALIGN 8
+
+// unit roundoff of fp32 and the relative slack allowed between two double
+// evaluations of the same kernel (libm exp/tanh/pow and summation order)
+#define FP32_UNIT_ROUNDOFF	(1.0/16777216.0)
+#define KERNEL_REL_SLACK	1e-12
+
+struct svm_adaptive_model
+{
+	const struct svm_model *model;
+	int nr_feature;		/* features 1..nr_feature are stored */
+	int dim;			/* nr_feature rounded up to ADAPTIVE_ROW_ALIGN */
+	float *sv;			/* l rows of dim elements */
+	double *sv_sq;		/* squared 2-norm of each SV (all of its features) */
+	double *sv_norm;
+	int *start;			/* first SV of each class */
+};
+
+#ifdef SVM_ADAPTIVE_SSE2
+static float row_dot(const float *row, const float *x, int dim)
+{
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	for(int i=0;i<dim;i+=8)
+	{
+		acc0 = _mm_add_ps(acc0,_mm_mul_ps(_mm_loadu_ps(x+i),_mm_loadu_ps(row+i)));
+		acc1 = _mm_add_ps(acc1,_mm_mul_ps(_mm_loadu_ps(x+i+4),_mm_loadu_ps(row+i+4)));
+	}
+	acc0 = _mm_add_ps(acc0,acc1);
+	acc0 = _mm_add_ps(acc0,_mm_movehl_ps(acc0,acc0));
+	acc0 = _mm_add_ss(acc0,_mm_shuffle_ps(acc0,acc0,1));
+	return _mm_cvtss_f32(acc0);
+}
+#else
+static float row_dot(const float *row, const float *x, int dim)
+{
+	float sum = 0;
+	for(int i=0;i<dim;i++)
+		sum += x[i]*row[i];
+	return sum;
+}
+#endif
+
+static double powi(double base, int times)
+{
+	double tmp = base, ret = 1.0;
+
+	for(int t=times; t>0; t/=2)
+	{
+		if(t%2==1) ret*=tmp;
+		tmp = tmp * tmp;
+	}
+	return ret;
+}
+
+struct svm_adaptive_model *svm_adaptive_create(const struct svm_model *model)
+{
+	int l = model->l;
+	int i;
+
+	if(model->param.kernel_type == PRECOMPUTED)
+	{
+		fprintf(stderr,"adaptive prediction does not support precomputed kernels\n");
+		return NULL;
+	}
+
+	svm_adaptive_model *am = Malloc(svm_adaptive_model,1);
+	am->model = model;
+	am->nr_feature = 0;
+	for(i=0;i<l;i++)
+		for(const svm_node *p=model->SV[i];p->index != -1;p++)
+			if(p->index > am->nr_feature)
+				am->nr_feature = p->index;
+	am->dim = (am->nr_feature + ADAPTIVE_ROW_ALIGN-1) / ADAPTIVE_ROW_ALIGN * ADAPTIVE_ROW_ALIGN;
+
+	am->sv = Malloc(float,(size_t)l*am->dim + 1);
+	am->sv_sq = Malloc(double,l);
+	am->sv_norm = Malloc(double,l);
+	am->start = Malloc(int,model->nr_class);
+	if(am->sv == NULL || am->sv_sq == NULL || am->sv_norm == NULL || am->start == NULL)
+	{
+		fprintf(stderr,"out of memory building the adaptive model\n");
+		svm_adaptive_free(&am);
+		return NULL;
+	}
+	memset(am->sv,0,((size_t)l*am->dim + 1)*sizeof(float));
+
+	for(i=0;i<l;i++)
+	{
+		float *row = am->sv + (size_t)i*am->dim;
+		double sq = 0;
+		for(const svm_node *p=model->SV[i];p->index != -1;p++)
+		{
+			if(p->index >= 1)
+				row[p->index-1] = (float)p->value;
+			sq += p->value*p->value;
+		}
+		am->sv_sq[i] = sq;
+		am->sv_norm[i] = sqrt(sq);
+	}
+
+	am->start[0] = 0;
+	for(i=1;i<model->nr_class;i++)
+		am->start[i] = am->start[i-1] + model->nSV[i-1];
+
+	return am;
+}
+
+void svm_adaptive_free(struct svm_adaptive_model **amodel_ptr_ptr)
+{
+	svm_adaptive_model *am = *amodel_ptr_ptr;
+	if(am == NULL)
+		return;
+	free(am->sv);
+	free(am->sv_sq);
+	free(am->sv_norm);
+	free(am->start);
+	free(am);
+	*amodel_ptr_ptr = NULL;
+}
+
+//
+// Kernel values from fp32 dot products.  Converting x and the SV to fp32
+// and summing dim products in any order is off by at most
+// (dim+3)*u*sum|x_i*s_i| <= (dim+3)*u*|x|*|s| (plus underflow), and that
+// bound is carried through the kernel function by its derivative.  RBF
+// uses |x-s|^2 = |x|^2 + |s|^2 - 2x.s with the norms in double.
+//
+static void fp32_kernel_values(const svm_adaptive_model *am, const svm_node *x,
+							   double *kvalue, double *kerr)
+{
+	const svm_parameter& param = am->model->param;
+	int l = am->model->l;
+	int dim = am->dim;
+	float *xf = Malloc(float,dim + 1);
+	double xx = 0;
+	int i;
+
+	memset(xf,0,(dim + 1)*sizeof(float));
+	for(const svm_node *p=x;p->index != -1;p++)
+	{
+		if(p->index >= 1 && p->index <= am->nr_feature)
+			xf[p->index-1] = (float)p->value;
+		xx += p->value*p->value;
+	}
+	double xnorm = sqrt(xx);
+	double rel = (dim + 3) * FP32_UNIT_ROUNDOFF * 1.01;
+	double underflow = dim * (double)FLT_MIN;
+
+	for(i=0;i<l;i++)
+	{
+		double dot = row_dot(am->sv + (size_t)i*dim,xf,dim);
+		double e = rel*xnorm*am->sv_norm[i] + underflow*(1 + xnorm + am->sv_norm[i]);
+		double k, err;
+
+		switch(param.kernel_type)
+		{
+			case LINEAR:
+				k = dot;
+				err = e;
+				break;
+			case POLY:
+			{
+				double t = param.gamma*dot + param.coef0;
+				double et = fabs(param.gamma)*e;
+				k = powi(t,param.degree);
+				err = param.degree*powi(fabs(t)+et,param.degree-1)*et;
+				break;
+			}
+			case RBF:
+			{
+				double d2 = xx + am->sv_sq[i] - 2*dot;
+				double ed = 2*e + 4*DBL_EPSILON*(xx + am->sv_sq[i]);
+				double dmin;
+				if(d2 < 0) d2 = 0;
+				dmin = d2 - ed;
+				if(dmin < 0) dmin = 0;
+				k = exp(-param.gamma*d2);
+				err = param.gamma*exp(-param.gamma*dmin)*ed;
+				break;
+			}
+			default:	// SIGMOID
+				k = tanh(param.gamma*dot + param.coef0);
+				err = fabs(param.gamma)*e;
+				break;
+		}
+		kvalue[i] = k;
+		kerr[i] = err + KERNEL_REL_SLACK*fabs(k);
+	}
+	free(xf);
+}
+
+double svm_adaptive_predict_values(const struct svm_adaptive_model *am, const struct svm_node *x,
+								   double *dec_values, int *nr_recomputed)
+{
+	const svm_model *model = am->model;
+	int svm_type = model->param.svm_type;
+
+	if(nr_recomputed != NULL)
+		*nr_recomputed = 0;
+	if(svm_type == ONE_CLASS || svm_type == EPSILON_SVR || svm_type == NU_SVR)
+		return svm_predict_values(model,x,dec_values);
+
+	int nr_class = model->nr_class;
+	int l = model->l;
+	double *kvalue = Malloc(double,l);
+	double *kerr = Malloc(double,l);
+	char *exact = Malloc(char,l);
+	int *vote = Malloc(int,nr_class);
+	int i, j, k;
+	int recomputed = 0;
+
+	fp32_kernel_values(am,x,kvalue,kerr);
+	memset(exact,0,l);
+	for(i=0;i<nr_class;i++)
+		vote[i] = 0;
+
+	int p=0;
+	for(i=0;i<nr_class;i++)
+		for(j=i+1;j<nr_class;j++)
+		{
+			int si = am->start[i];
+			int sj = am->start[j];
+			int ci = model->nSV[i];
+			int cj = model->nSV[j];
+			double *coef1 = model->sv_coef[j-1];
+			double *coef2 = model->sv_coef[i];
+			double sum = 0, bound = 0, mag = fabs(model->rho[p]);
+
+			for(k=si;k<si+ci;k++)
+			{
+				sum += coef1[k] * kvalue[k];
+				bound += fabs(coef1[k]) * kerr[k];
+				mag += fabs(coef1[k] * kvalue[k]);
+			}
+			for(k=sj;k<sj+cj;k++)
+			{
+				sum += coef2[k] * kvalue[k];
+				bound += fabs(coef2[k]) * kerr[k];
+				mag += fabs(coef2[k] * kvalue[k]);
+			}
+			// both this sum and svm_predict_values' round in double
+			bound += 2*(ci + cj + 2)*DBL_EPSILON*mag;
+			sum -= model->rho[p];
+
+			if(fabs(sum) <= bound)
+			{
+				// too close to call, repeat the pair exactly as svm_predict_values does
+				for(k=si;k<si+ci;k++)
+					if(!exact[k]) { kvalue[k] = svm_k_function(x,model->SV[k],&model->param); exact[k] = 1; }
+				for(k=sj;k<sj+cj;k++)
+					if(!exact[k]) { kvalue[k] = svm_k_function(x,model->SV[k],&model->param); exact[k] = 1; }
+				sum = 0;
+				for(k=0;k<ci;k++)
+					sum += coef1[si+k] * kvalue[si+k];
+				for(k=0;k<cj;k++)
+					sum += coef2[sj+k] * kvalue[sj+k];
+				sum -= model->rho[p];
+				recomputed++;
+			}
+			dec_values[p] = sum;
+
+			if(dec_values[p] > 0)
+				++vote[i];
+			else
+				++vote[j];
+			p++;
+		}
+
+	int vote_max_idx = 0;
+	for(i=1;i<nr_class;i++)
+		if(vote[i] > vote[vote_max_idx])
+			vote_max_idx = i;
+
+	free(kvalue);
+	free(kerr);
+	free(exact);
+	free(vote);
+	if(nr_recomputed != NULL)
+		*nr_recomputed = recomputed;
+	return model->label[vote_max_idx];
+}
+
+double svm_adaptive_predict(const struct svm_adaptive_model *am, const struct svm_node *x, int *nr_recomputed)
+{
+	const svm_model *model = am->model;
+	double *dec_values;
+	double pred_result;
+	int nr_class = model->nr_class;
+
+	if(model->param.svm_type == ONE_CLASS ||
+	   model->param.svm_type == EPSILON_SVR ||
+	   model->param.svm_type == NU_SVR)
+		dec_values = Malloc(double,1);
+	else
+		dec_values = Malloc(double,nr_class*(nr_class-1)/2);
+	pred_result = svm_adaptive_predict_values(am,x,dec_values,nr_recomputed);
+	free(dec_values);
+	return pred_result;
+}
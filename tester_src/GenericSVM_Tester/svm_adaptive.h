@@ -0,0 +1,37 @@
+#ifndef _SVM_ADAPTIVE_H
+#define _SVM_ADAPTIVE_H
+
+#include "svm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// svm_adaptive_model
+//
+// fp32 copy of a classification model's SVs used to evaluate all kernel
+// values with SIMD.  Every kernel value carries a rounding error bound;
+// a pair whose decision value lies within its bound of zero is evaluated
+// again in double from the source model, in svm_predict_values order.
+// Labels are therefore identical to svm_predict.  Decision values of the
+// pairs decided in fp32 are approximate.
+//
+// The source model must outlive the adaptive model.  Regression and
+// one-class models are passed straight to svm_predict_values.
+//
+struct svm_adaptive_model;
+
+struct svm_adaptive_model *svm_adaptive_create(const struct svm_model *model);
+void svm_adaptive_free(struct svm_adaptive_model **amodel_ptr_ptr);
+
+double svm_adaptive_predict_values(const struct svm_adaptive_model *amodel, const struct svm_node *x,
+								   double *dec_values, int *nr_recomputed);
+double svm_adaptive_predict(const struct svm_adaptive_model *amodel, const struct svm_node *x,
+							int *nr_recomputed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SVM_ADAPTIVE_H */
@@ -0,0 +1,331 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "svm_csr.h"
+
+#define Malloc(type,n) (type *)malloc((n)*sizeof(type))
+
+struct svm_csr_model
+{
+	struct svm_parameter param;
+	int nr_class;
+	int l;
+	int dim;			/* largest SV feature index + 1 */
+	int wide_index;		/* col is uint32_t rather than uint16_t */
+	int float_values;	/* val is float rather than double */
+	uint32_t *row;		/* l+1 offsets into col/val */
+	void *col;
+	void *val;
+	double *row_sq;		/* |s|^2 of each row, RBF only */
+	double **sv_coef;
+	double *rho;
+	int *label;
+	int *nSV;
+};
+
+template <class I, class V>
+static void fill_rows(const svm_model *model, I *col, V *val)
+{
+	size_t n = 0;
+	for(int i=0;i<model->l;i++)
+		for(const svm_node *p=model->SV[i];p->index != -1;p++)
+		{
+			col[n] = (I)p->index;
+			val[n] = (V)p->value;
+			n++;
+		}
+}
+
+// x.s for row [begin,end) against the dense image of x, four at a time
+template <class I, class V>
+static double row_dot(const I *col, const V *val, uint32_t begin, uint32_t end, const double *dense)
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	uint32_t k = begin;
+	for(;k+4<=end;k+=4)
+	{
+		s0 += val[k]*dense[col[k]];
+		s1 += val[k+1]*dense[col[k+1]];
+		s2 += val[k+2]*dense[col[k+2]];
+		s3 += val[k+3]*dense[col[k+3]];
+	}
+	for(;k<end;k++)
+		s0 += val[k]*dense[col[k]];
+	return (s0+s1)+(s2+s3);
+}
+
+template <class I, class V>
+static void all_dots(const svm_csr_model *cm, const double *dense, double *dot)
+{
+	const I *col = (const I *)cm->col;
+	const V *val = (const V *)cm->val;
+	for(int i=0;i<cm->l;i++)
+		dot[i] = row_dot(col,val,cm->row[i],cm->row[i+1],dense);
+}
+
+static double powi(double base, int times)
+{
+	double tmp = base, ret = 1.0;
+
+	for(int t=times; t>0; t/=2)
+	{
+		if(t%2==1) ret*=tmp;
+		tmp = tmp * tmp;
+	}
+	return ret;
+}
+
+struct svm_csr_model *svm_csr_from_model(const struct svm_model *model, int float_values)
+{
+	int l = model->l;
+	int m = model->nr_class - 1;
+	int i, max_index = 0;
+	size_t nnz = 0;
+
+	if(model->param.kernel_type == PRECOMPUTED)
+	{
+		fprintf(stderr,"CSR models do not support precomputed kernels\n");
+		return NULL;
+	}
+
+	svm_csr_model *cm = Malloc(svm_csr_model,1);
+	memset(cm,0,sizeof(*cm));
+	cm->param = model->param;
+	cm->nr_class = model->nr_class;
+	cm->l = l;
+	cm->float_values = float_values;
+
+	for(i=0;i<l;i++)
+		for(const svm_node *p=model->SV[i];p->index != -1;p++)
+		{
+			if(p->index > max_index) max_index = p->index;
+			nnz++;
+		}
+	cm->dim = max_index + 1;
+	cm->wide_index = (max_index > 0xffff);
+
+	cm->row = Malloc(uint32_t,l+1);
+	cm->col = malloc((nnz+1)*(cm->wide_index ? sizeof(uint32_t) : sizeof(uint16_t)));
+	cm->val = malloc((nnz+1)*(float_values ? sizeof(float) : sizeof(double)));
+	cm->row_sq = Malloc(double,l+1);
+	cm->sv_coef = Malloc(double *,m);
+	cm->rho = Malloc(double,model->nr_class*(model->nr_class-1)/2+1);
+	cm->label = Malloc(int,model->nr_class);
+	cm->nSV = Malloc(int,model->nr_class);
+	if(cm->row == NULL || cm->col == NULL || cm->val == NULL || cm->row_sq == NULL || cm->sv_coef == NULL)
+	{
+		fprintf(stderr,"out of memory building the CSR model\n");
+		svm_csr_free(&cm);
+		return NULL;
+	}
+
+	cm->row[0] = 0;
+	for(i=0;i<l;i++)
+	{
+		const svm_node *p = model->SV[i];
+		double sq = 0;
+		uint32_t n = 0;
+		for(;p->index != -1;p++,n++)
+		{
+			double v = float_values ? (double)(float)p->value : p->value;
+			sq += v*v;
+		}
+		cm->row[i+1] = cm->row[i] + n;
+		cm->row_sq[i] = sq;
+	}
+	if(cm->wide_index)
+	{
+		if(float_values) fill_rows(model,(uint32_t *)cm->col,(float *)cm->val);
+		else fill_rows(model,(uint32_t *)cm->col,(double *)cm->val);
+	}
+	else
+	{
+		if(float_values) fill_rows(model,(uint16_t *)cm->col,(float *)cm->val);
+		else fill_rows(model,(uint16_t *)cm->col,(double *)cm->val);
+	}
+
+	for(i=0;i<m;i++)
+	{
+		cm->sv_coef[i] = Malloc(double,l+1);
+		memcpy(cm->sv_coef[i],model->sv_coef[i],l*sizeof(double));
+	}
+	memcpy(cm->rho,model->rho,model->nr_class*(model->nr_class-1)/2*sizeof(double));
+	if(model->label != NULL)
+		memcpy(cm->label,model->label,model->nr_class*sizeof(int));
+	if(model->nSV != NULL)
+		memcpy(cm->nSV,model->nSV,model->nr_class*sizeof(int));
+	return cm;
+}
+
+void svm_csr_free(struct svm_csr_model **cmodel_ptr_ptr)
+{
+	svm_csr_model *cm = *cmodel_ptr_ptr;
+	if(cm == NULL)
+		return;
+	if(cm->sv_coef != NULL)
+		for(int i=0;i<cm->nr_class-1;i++)
+			free(cm->sv_coef[i]);
+	free(cm->sv_coef);
+	free(cm->row);
+	free(cm->col);
+	free(cm->val);
+	free(cm->row_sq);
+	free(cm->rho);
+	free(cm->label);
+	free(cm->nSV);
+	free(cm);
+	*cmodel_ptr_ptr = NULL;
+}
+
+size_t svm_csr_model_bytes(const struct svm_csr_model *cm)
+{
+	size_t nnz = cm->row[cm->l];
+	size_t bytes = sizeof(*cm);
+	bytes += (cm->l+1)*sizeof(uint32_t);
+	bytes += nnz*(cm->wide_index ? sizeof(uint32_t) : sizeof(uint16_t));
+	bytes += nnz*(cm->float_values ? sizeof(float) : sizeof(double));
+	if(cm->param.kernel_type == RBF)
+		bytes += cm->l*sizeof(double);
+	bytes += (size_t)(cm->nr_class-1)*cm->l*sizeof(double);
+	return bytes;
+}
+
+// kvalue[i] = K(x, row i)
+static void csr_kernel_values(const svm_csr_model *cm, const svm_node *x, double *kvalue)
+{
+	const svm_parameter& param = cm->param;
+	double *dense = (double *)calloc(cm->dim,sizeof(double));
+	double xx = 0;
+	int i;
+
+	for(const svm_node *p=x;p->index != -1;p++)
+	{
+		if(p->index >= 0 && p->index < cm->dim)
+			dense[p->index] = p->value;
+		xx += p->value*p->value;
+	}
+
+	if(cm->wide_index)
+	{
+		if(cm->float_values) all_dots<uint32_t,float>(cm,dense,kvalue);
+		else all_dots<uint32_t,double>(cm,dense,kvalue);
+	}
+	else
+	{
+		if(cm->float_values) all_dots<uint16_t,float>(cm,dense,kvalue);
+		else all_dots<uint16_t,double>(cm,dense,kvalue);
+	}
+	free(dense);
+
+	for(i=0;i<cm->l;i++)
+	{
+		double dot = kvalue[i];
+		switch(param.kernel_type)
+		{
+			case LINEAR:
+				break;
+			case POLY:
+				kvalue[i] = powi(param.gamma*dot+param.coef0,param.degree);
+				break;
+			case RBF:
+			{
+				double d2 = xx + cm->row_sq[i] - 2*dot;
+				kvalue[i] = exp(-param.gamma*(d2 > 0 ? d2 : 0));
+				break;
+			}
+			default:
+				kvalue[i] = tanh(param.gamma*dot+param.coef0);
+				break;
+		}
+	}
+}
+
+double svm_csr_predict_values(const struct svm_csr_model *cm, const struct svm_node *x, double *dec_values)
+{
+	int l = cm->l;
+	double *kvalue = Malloc(double,l+1);
+	int i;
+
+	csr_kernel_values(cm,x,kvalue);
+
+	if(cm->param.svm_type == ONE_CLASS ||
+	   cm->param.svm_type == EPSILON_SVR ||
+	   cm->param.svm_type == NU_SVR)
+	{
+		double *sv_coef = cm->sv_coef[0];
+		double sum = 0;
+		for(i=0;i<l;i++)
+			sum += sv_coef[i] * kvalue[i];
+		sum -= cm->rho[0];
+		*dec_values = sum;
+		free(kvalue);
+		if(cm->param.svm_type == ONE_CLASS)
+			return (sum>0)?1:-1;
+		return sum;
+	}
+
+	int nr_class = cm->nr_class;
+	int *start = Malloc(int,nr_class);
+	int *vote = Malloc(int,nr_class);
+	start[0] = 0;
+	for(i=1;i<nr_class;i++)
+		start[i] = start[i-1]+cm->nSV[i-1];
+	for(i=0;i<nr_class;i++)
+		vote[i] = 0;
+
+	int p=0;
+	for(i=0;i<nr_class;i++)
+		for(int j=i+1;j<nr_class;j++)
+		{
+			double sum = 0;
+			int si = start[i];
+			int sj = start[j];
+			int ci = cm->nSV[i];
+			int cj = cm->nSV[j];
+			double *coef1 = cm->sv_coef[j-1];
+			double *coef2 = cm->sv_coef[i];
+			int k;
+
+			for(k=0;k<ci;k++)
+				sum += coef1[si+k] * kvalue[si+k];
+			for(k=0;k<cj;k++)
+				sum += coef2[sj+k] * kvalue[sj+k];
+			sum -= cm->rho[p];
+			dec_values[p] = sum;
+
+			if(dec_values[p] > 0)
+				++vote[i];
+			else
+				++vote[j];
+			p++;
+		}
+
+	int vote_max_idx = 0;
+	for(i=1;i<nr_class;i++)
+		if(vote[i] > vote[vote_max_idx])
+			vote_max_idx = i;
+
+	free(kvalue);
+	free(start);
+	free(vote);
+	return cm->label[vote_max_idx];
+}
+
+double svm_csr_predict(const struct svm_csr_model *cm, const struct svm_node *x)
+{
+	int nr_class = cm->nr_class;
+	double *dec_values;
+	double pred_result;
+
+	if(cm->param.svm_type == ONE_CLASS ||
+	   cm->param.svm_type == EPSILON_SVR ||
+	   cm->param.svm_type == NU_SVR)
+		dec_values = Malloc(double,1);
+	else
+		dec_values = Malloc(double,nr_class*(nr_class-1)/2);
+	pred_result = svm_csr_predict_values(cm,x,dec_values);
+	free(dec_values);
+	return pred_result;
+}
@@ -0,0 +1,35 @@
+#ifndef _SVM_CSR_H
+#define _SVM_CSR_H
+
+#include <stddef.h>
+#include "svm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// svm_csr_model
+//
+// Compressed sparse row copy of a model: one contiguous array of column
+// indices (uint16 when every feature index fits, uint32 otherwise), one of
+// values (float or double) and l+1 row offsets, in place of an svm_node
+// array per SV.  Prediction scatters x into a dense buffer once and walks
+// each row against it.  RBF uses |x|^2 + |s|^2 - 2x.s with |s|^2 stored
+// per row.  It does not reference the svm_model it was built from.
+//
+struct svm_csr_model;
+
+struct svm_csr_model *svm_csr_from_model(const struct svm_model *model, int float_values);
+void svm_csr_free(struct svm_csr_model **cmodel_ptr_ptr);
+
+double svm_csr_predict_values(const struct svm_csr_model *cmodel, const struct svm_node *x, double *dec_values);
+double svm_csr_predict(const struct svm_csr_model *cmodel, const struct svm_node *x);
+
+size_t svm_csr_model_bytes(const struct svm_csr_model *cmodel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SVM_CSR_H */
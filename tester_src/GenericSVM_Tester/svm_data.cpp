@@ -0,0 +1,141 @@
+// svm_data.cpp : Reads libsvm format data files for the model tools.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "svm_data.h"
+
+
+static char *readLine(FILE *input, char **line, int *maxLen)
+{
+	int len;
+
+	if(fgets(*line,*maxLen,input) == NULL)
+		return NULL;
+
+	while(strrchr(*line,'\n') == NULL)
+	{
+		*maxLen *= 2;
+		*line = (char *)realloc(*line,*maxLen);
+		len = (int)strlen(*line);
+		if(fgets(*line+len,*maxLen-len,input) == NULL)
+			break;
+	}
+	return *line;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      readProblem
+* Arguments: fname - libsvm format data file ("label idx:val idx:val ...")
+*            prob - receives the samples
+*            xSpace - receives the node storage, release with freeProblem
+*            maxIndex - receives the largest feature index seen (may be NULL)
+* Returns:   0 on success, -1 on error
+*
+***************************************************************************/
+int readProblem(const char *fname, struct svm_problem *prob, struct svm_node **xSpace, int *maxIndex)
+{
+	FILE *fp;
+	char *line, *p, *endptr;
+	int maxLen = 1024;
+	int elements = 0, i, j, lineNum;
+	int maxIdx = 0;
+
+	if(!(fp = fopen(fname,"r")))
+	{
+		printf("ERROR opening data file %s!\n",fname);
+		return -1;
+	}
+	line = (char *)malloc(maxLen);
+
+	/* Count samples and nodes */
+	prob->l = 0;
+	while(readLine(fp,&line,&maxLen) != NULL)
+	{
+		if(strtok(line," \t\n\r") == NULL)
+			continue;
+		while(strtok(NULL," \t\n\r") != NULL)
+			elements++;
+		elements++;		/* -1 terminator */
+		prob->l++;
+	}
+	rewind(fp);
+
+	prob->y = (double *)malloc(prob->l*sizeof(double));
+	prob->x = (struct svm_node **)malloc(prob->l*sizeof(struct svm_node *));
+	*xSpace = (struct svm_node *)malloc((elements > 0 ? elements : 1)*sizeof(struct svm_node));
+	if(!prob->y || !prob->x || !*xSpace)
+	{
+		printf("ERROR allocating memory for %d samples!!\n",prob->l);
+		freeProblem(prob,*xSpace);
+		free(line);
+		fclose(fp);
+		return -1;
+	}
+
+	j = 0;
+	i = 0;
+	lineNum = 0;
+	while(i < prob->l && readLine(fp,&line,&maxLen) != NULL)
+	{
+		lineNum++;
+		if((p = strtok(line," \t\n\r")) == NULL)
+			continue;
+
+		prob->x[i] = &(*xSpace)[j];
+		prob->y[i] = strtod(p,&endptr);
+		if(endptr == p)
+			break;
+
+		while((p = strtok(NULL," \t\n\r")) != NULL)
+		{
+			errno = 0;
+			(*xSpace)[j].index = (int)strtol(p,&endptr,10);
+			if(endptr == p || *endptr != ':' || errno != 0)
+				break;
+			p = endptr + 1;
+			(*xSpace)[j].value = strtod(p,&endptr);
+			if(endptr == p)
+				break;
+			if((*xSpace)[j].index > maxIdx)
+				maxIdx = (*xSpace)[j].index;
+			j++;
+		}
+		if(p != NULL)
+			break;
+		(*xSpace)[j++].index = -1;
+		i++;
+	}
+	free(line);
+	fclose(fp);
+
+	if(i < prob->l)
+	{
+		printf("ERROR wrong input format in %s at line %d!\n",fname,lineNum);
+		freeProblem(prob,*xSpace);
+		return -1;
+	}
+	if(maxIndex != NULL)
+		*maxIndex = maxIdx;
+
+	return 0;
+}
+
+
+
+
+void freeProblem(struct svm_problem *prob, struct svm_node *xSpace)
+{
+	free(prob->y);
+	free(prob->x);
+	free(xSpace);
+	prob->y = NULL;
+	prob->x = NULL;
+	prob->l = 0;
+}
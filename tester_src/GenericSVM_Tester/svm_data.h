@@ -0,0 +1,11 @@
+#ifndef _SVM_DATA_H
+#define _SVM_DATA_H
+
+#include "svm.h"
+
+/* Function Prototypes */
+int readProblem(const char *fname, struct svm_problem *prob, struct svm_node **xSpace, int *maxIndex);
+void freeProblem(struct svm_problem *prob, struct svm_node *xSpace);
+
+
+#endif /* _SVM_DATA_H */
@@ -0,0 +1,220 @@
+#ifndef _SVM_FIXED_H
+#define _SVM_FIXED_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "svm.h"
+
+//
+// svm_fixed_model<NF,NC>
+//
+// Classification model for a shape fixed at compile time: NF features and
+// NC classes, as set by NUM_FEATURES and NUM_CLASS in config_Flgs.h.  The
+// SVs are stored dense, so every kernel loop has a trip count of NF that the
+// compiler can unroll, and the pairwise loops run to the constant NC.  The
+// kernel type is a template argument of the evaluation, chosen once per
+// prediction rather than once per SV.
+//
+// The sums are taken in the same order as svm_predict and the terms that
+// sparse storage skips are exact zeros, so the labels and decision values
+// are the ones svm_predict gives.  svm_fixed_create returns NULL for a model
+// of any other shape, and svm_fixed_predict hands a test vector with feature
+// indices above NF to svm_predict on the source model, which must outlive
+// the fixed copy.
+//
+template <int NF, int NC>
+struct svm_fixed_model
+{
+	const struct svm_model *source;
+	int kernel_type;
+	int degree;
+	double gamma;
+	double coef0;
+	int l;
+	int start[NC+1];			/* first SV of each class */
+	int label[NC];
+	double rho[NC*(NC-1)/2];
+	double *sv;					/* l x NF, row major */
+	double *coef;				/* (NC-1) x l */
+};
+
+#define SVM_FIXED_STACK_SV	1024	/* kernel values kept on the stack up to this many SVs */
+
+template <int NF, int NC>
+svm_fixed_model<NF,NC> *svm_fixed_create(const struct svm_model *model)
+{
+	svm_fixed_model<NF,NC> *fm;
+	int i, k;
+
+	if(model == NULL || model->nr_class != NC ||
+	   (model->param.svm_type != C_SVC && model->param.svm_type != NU_SVC) ||
+	   model->param.kernel_type == PRECOMPUTED)
+		return NULL;
+	for(i=0;i<model->l;i++)
+		for(const svm_node *p=model->SV[i];p->index != -1;p++)
+			if(p->index < 1 || p->index > NF)
+				return NULL;
+
+	fm = (svm_fixed_model<NF,NC> *)malloc(sizeof(svm_fixed_model<NF,NC>));
+	if(fm == NULL)
+		return NULL;
+	fm->source = model;
+	fm->kernel_type = model->param.kernel_type;
+	fm->degree = model->param.degree;
+	fm->gamma = model->param.gamma;
+	fm->coef0 = model->param.coef0;
+	fm->l = model->l;
+	fm->start[0] = 0;
+	for(i=0;i<NC;i++)
+	{
+		fm->start[i+1] = fm->start[i] + model->nSV[i];
+		fm->label[i] = model->label[i];
+	}
+	for(i=0;i<NC*(NC-1)/2;i++)
+		fm->rho[i] = model->rho[i];
+
+	fm->sv = (double *)calloc((size_t)model->l*NF + 1,sizeof(double));
+	fm->coef = (double *)malloc(((size_t)(NC-1)*model->l + 1)*sizeof(double));
+	if(fm->sv == NULL || fm->coef == NULL)
+	{
+		free(fm->sv);
+		free(fm->coef);
+		free(fm);
+		return NULL;
+	}
+	for(i=0;i<model->l;i++)
+		for(const svm_node *p=model->SV[i];p->index != -1;p++)
+			fm->sv[(size_t)i*NF + p->index-1] = p->value;
+	for(k=0;k<NC-1;k++)
+		memcpy(&fm->coef[(size_t)k*model->l],model->sv_coef[k],model->l*sizeof(double));
+	return fm;
+}
+
+template <int NF, int NC>
+void svm_fixed_free(svm_fixed_model<NF,NC> **fm_ptr_ptr)
+{
+	if(fm_ptr_ptr != NULL && *fm_ptr_ptr != NULL)
+	{
+		free((*fm_ptr_ptr)->sv);
+		free((*fm_ptr_ptr)->coef);
+		free(*fm_ptr_ptr);
+		*fm_ptr_ptr = NULL;
+	}
+}
+
+// one kernel value, KERNEL folds to a single branch
+template <int KERNEL, int NF>
+inline double svm_fixed_kernel(const double *x, const double *s, double gamma, double coef0, int degree)
+{
+	double sum = 0;
+	int j;
+
+	if(KERNEL == RBF)
+	{
+		for(j=0;j<NF;j++)
+		{
+			double d = x[j] - s[j];
+			sum += d*d;
+		}
+		return exp(-gamma*sum);
+	}
+	for(j=0;j<NF;j++)
+		sum += x[j]*s[j];
+	if(KERNEL == LINEAR)
+		return sum;
+	if(KERNEL == SIGMOID)
+		return tanh(gamma*sum+coef0);
+
+	// POLY, same squaring sequence as powi in svm.cpp
+	double tmp = gamma*sum+coef0, ret = 1.0;
+	for(int t=degree;t>0;t/=2)
+	{
+		if(t%2==1) ret*=tmp;
+		tmp = tmp * tmp;
+	}
+	return ret;
+}
+
+template <int KERNEL, int NF, int NC>
+double svm_fixed_predict_dense(const svm_fixed_model<NF,NC> *fm, const double *x, double *dec_values)
+{
+	double stack_kvalue[SVM_FIXED_STACK_SV];
+	double *kvalue = stack_kvalue;
+	int vote[NC];
+	int i, j, k, p = 0, vote_max_idx = 0;
+	const int l = fm->l;
+
+	if(l > SVM_FIXED_STACK_SV)
+		kvalue = (double *)malloc(l*sizeof(double));
+	for(k=0;k<l;k++)
+		kvalue[k] = svm_fixed_kernel<KERNEL,NF>(x,&fm->sv[(size_t)k*NF],fm->gamma,fm->coef0,fm->degree);
+
+	for(i=0;i<NC;i++)
+		vote[i] = 0;
+	for(i=0;i<NC;i++)
+		for(j=i+1;j<NC;j++)
+		{
+			const double *coef1 = &fm->coef[(size_t)(j-1)*l];
+			const double *coef2 = &fm->coef[(size_t)i*l];
+			double sum = 0;
+
+			for(k=fm->start[i];k<fm->start[i+1];k++)
+				sum += coef1[k] * kvalue[k];
+			for(k=fm->start[j];k<fm->start[j+1];k++)
+				sum += coef2[k] * kvalue[k];
+			sum -= fm->rho[p];
+			if(dec_values != NULL)
+				dec_values[p] = sum;
+			p++;
+
+			if(sum > 0)
+				++vote[i];
+			else
+				++vote[j];
+		}
+	for(i=1;i<NC;i++)
+		if(vote[i] > vote[vote_max_idx])
+			vote_max_idx = i;
+
+	if(kvalue != stack_kvalue)
+		free(kvalue);
+	return fm->label[vote_max_idx];
+}
+
+//
+// dec_values may be NULL, otherwise it takes NC*(NC-1)/2 values
+//
+template <int NF, int NC>
+double svm_fixed_predict_values(const svm_fixed_model<NF,NC> *fm, const struct svm_node *x, double *dec_values)
+{
+	double dense[NF];
+
+	memset(dense,0,sizeof(dense));
+	for(const svm_node *p=x;p->index != -1;p++)
+	{
+		if(p->index < 1 || p->index > NF)
+		{
+			if(dec_values != NULL)
+				return svm_predict_values(fm->source,x,dec_values);
+			return svm_predict(fm->source,x);
+		}
+		dense[p->index-1] = p->value;
+	}
+
+	switch(fm->kernel_type)
+	{
+		case LINEAR:	return svm_fixed_predict_dense<LINEAR,NF,NC>(fm,dense,dec_values);
+		case POLY:		return svm_fixed_predict_dense<POLY,NF,NC>(fm,dense,dec_values);
+		case RBF:		return svm_fixed_predict_dense<RBF,NF,NC>(fm,dense,dec_values);
+		default:		return svm_fixed_predict_dense<SIGMOID,NF,NC>(fm,dense,dec_values);
+	}
+}
+
+template <int NF, int NC>
+double svm_fixed_predict(const svm_fixed_model<NF,NC> *fm, const struct svm_node *x)
+{
+	return svm_fixed_predict_values<NF,NC>(fm,x,NULL);
+}
+
+#endif /* _SVM_FIXED_H */
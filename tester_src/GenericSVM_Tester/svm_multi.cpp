@@ -0,0 +1,339 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "svm_multi.h"
+
+#define Malloc(type,n) (type *)malloc((n)*sizeof(type))
+
+struct svm_multi_model
+{
+	int nr_model;
+	struct svm_model *const *models;
+	int nr_unique;
+	const svm_node **usv;	/* unique SVs, pointing into the first model holding each */
+	int **sv_map;			/* per model: SV i -> unique index */
+	int need_dot;			/* some model uses a dot product kernel */
+	int need_dist;			/* some model uses RBF */
+	int nr_group;			/* distinct kernel settings */
+	svm_parameter *group_param;
+	char **group_used;		/* per group: unique SVs it needs */
+	int *model_group;
+};
+
+static unsigned int sv_hash(const svm_node *p)
+{
+	unsigned int h = 2166136261u;
+	for(;p->index != -1;p++)
+	{
+		unsigned char bytes[sizeof(int)+sizeof(double)];
+		memcpy(bytes,&p->index,sizeof(int));
+		memcpy(bytes+sizeof(int),&p->value,sizeof(double));
+		for(size_t b=0;b<sizeof(bytes);b++)
+			h = (h ^ bytes[b]) * 16777619u;
+	}
+	return h;
+}
+
+static int sv_equal(const svm_node *a, const svm_node *b)
+{
+	for(;a->index != -1 && b->index != -1;a++,b++)
+		if(a->index != b->index || a->value != b->value)
+			return 0;
+	return a->index == b->index;
+}
+
+static int same_kernel(const svm_parameter *a, const svm_parameter *b)
+{
+	if(a->kernel_type != b->kernel_type)
+		return 0;
+	switch(a->kernel_type)
+	{
+		case POLY: return a->gamma == b->gamma && a->coef0 == b->coef0 && a->degree == b->degree;
+		case RBF: return a->gamma == b->gamma;
+		case SIGMOID: return a->gamma == b->gamma && a->coef0 == b->coef0;
+		default: return 1;
+	}
+}
+
+struct svm_multi_model *svm_multi_create(struct svm_model *const *models, int nr_model)
+{
+	int m, i, total = 0;
+
+	for(m=0;m<nr_model;m++)
+	{
+		if(models[m]->param.kernel_type == PRECOMPUTED)
+		{
+			fprintf(stderr,"multi-model evaluation does not support precomputed kernels\n");
+			return NULL;
+		}
+		total += models[m]->l;
+	}
+
+	svm_multi_model *mm = Malloc(svm_multi_model,1);
+	mm->nr_model = nr_model;
+	mm->models = models;
+	mm->nr_unique = 0;
+	mm->usv = Malloc(const svm_node *,total+1);
+	mm->sv_map = Malloc(int *,nr_model);
+	mm->need_dot = 0;
+	mm->need_dist = 0;
+	mm->nr_group = 0;
+	mm->group_param = Malloc(svm_parameter,nr_model);
+	mm->group_used = Malloc(char *,nr_model);
+	mm->model_group = Malloc(int,nr_model);
+
+	// open addressing table of unique SV indices
+	int table_size = 1;
+	while(table_size < 2*total+1) table_size *= 2;
+	int *table = Malloc(int,table_size);
+	for(i=0;i<table_size;i++)
+		table[i] = -1;
+
+	for(m=0;m<nr_model;m++)
+	{
+		const svm_model *model = models[m];
+		mm->sv_map[m] = Malloc(int,model->l+1);
+		for(i=0;i<model->l;i++)
+		{
+			unsigned int h = sv_hash(model->SV[i]) & (table_size-1);
+			while(table[h] != -1 && !sv_equal(mm->usv[table[h]],model->SV[i]))
+				h = (h+1) & (table_size-1);
+			if(table[h] == -1)
+			{
+				table[h] = mm->nr_unique;
+				mm->usv[mm->nr_unique++] = model->SV[i];
+			}
+			mm->sv_map[m][i] = table[h];
+		}
+	}
+	free(table);
+
+	for(m=0;m<nr_model;m++)
+	{
+		const svm_parameter *param = &models[m]->param;
+		int g;
+		for(g=0;g<mm->nr_group;g++)
+			if(same_kernel(&mm->group_param[g],param))
+				break;
+		if(g == mm->nr_group)
+		{
+			mm->group_param[g] = *param;
+			mm->group_used[g] = Malloc(char,mm->nr_unique+1);
+			memset(mm->group_used[g],0,mm->nr_unique+1);
+			mm->nr_group++;
+		}
+		mm->model_group[m] = g;
+		for(i=0;i<models[m]->l;i++)
+			mm->group_used[g][mm->sv_map[m][i]] = 1;
+		if(param->kernel_type == RBF)
+			mm->need_dist = 1;
+		else
+			mm->need_dot = 1;
+	}
+	return mm;
+}
+
+void svm_multi_free(struct svm_multi_model **mmodel_ptr_ptr)
+{
+	svm_multi_model *mm = *mmodel_ptr_ptr;
+	int i;
+
+	if(mm == NULL)
+		return;
+	for(i=0;i<mm->nr_model;i++)
+		free(mm->sv_map[i]);
+	for(i=0;i<mm->nr_group;i++)
+		free(mm->group_used[i]);
+	free(mm->sv_map);
+	free(mm->group_used);
+	free(mm->group_param);
+	free(mm->model_group);
+	free(mm->usv);
+	free(mm);
+	*mmodel_ptr_ptr = NULL;
+}
+
+int svm_multi_nr_unique_sv(const struct svm_multi_model *mm)
+{
+	return mm->nr_unique;
+}
+
+static double powi(double base, int times)
+{
+	double tmp = base, ret = 1.0;
+
+	for(int t=times; t>0; t/=2)
+	{
+		if(t%2==1) ret*=tmp;
+		tmp = tmp * tmp;
+	}
+	return ret;
+}
+
+// Kernel::dot and the RBF distance of Kernel::k_function in one merge,
+// each sum accumulated in the same order as there
+static void dot_and_dist(const svm_node *x, const svm_node *y, int want_dist, double *dot, double *dist)
+{
+	double sum = 0, sq = 0;
+
+	if(!want_dist)
+	{
+		while(x->index != -1 && y->index != -1)
+		{
+			if(x->index == y->index)
+			{
+				sum += x->value * y->value;
+				++x;
+				++y;
+			}
+			else if(x->index > y->index)
+				++y;
+			else
+				++x;
+		}
+		*dot = sum;
+		*dist = 0;
+		return;
+	}
+
+	while(x->index != -1 && y->index != -1)
+	{
+		if(x->index == y->index)
+		{
+			double d = x->value - y->value;
+			sum += x->value * y->value;
+			sq += d*d;
+			++x;
+			++y;
+		}
+		else if(x->index > y->index)
+		{
+			sq += y->value * y->value;
+			++y;
+		}
+		else
+		{
+			sq += x->value * x->value;
+			++x;
+		}
+	}
+	for(;x->index != -1;x++)
+		sq += x->value * x->value;
+	for(;y->index != -1;y++)
+		sq += y->value * y->value;
+	*dot = sum;
+	*dist = sq;
+}
+
+// svm_predict_values' voting on precomputed kernel values
+static double predict_from_kvalue(const svm_model *model, const double *kvalue)
+{
+	if(model->param.svm_type == ONE_CLASS ||
+	   model->param.svm_type == EPSILON_SVR ||
+	   model->param.svm_type == NU_SVR)
+	{
+		double *sv_coef = model->sv_coef[0];
+		double sum = 0;
+		for(int i=0;i<model->l;i++)
+			sum += sv_coef[i] * kvalue[i];
+		sum -= model->rho[0];
+		if(model->param.svm_type == ONE_CLASS)
+			return (sum>0)?1:-1;
+		return sum;
+	}
+
+	int nr_class = model->nr_class;
+	int *vote = Malloc(int,nr_class);
+	int i, j, k, start_i, start_j;
+	int p = 0;
+
+	for(i=0;i<nr_class;i++)
+		vote[i] = 0;
+	start_i = 0;
+	for(i=0;i<nr_class;i++)
+	{
+		start_j = start_i + model->nSV[i];
+		for(j=i+1;j<nr_class;j++)
+		{
+			double sum = 0;
+			double *coef1 = model->sv_coef[j-1];
+			double *coef2 = model->sv_coef[i];
+			for(k=0;k<model->nSV[i];k++)
+				sum += coef1[start_i+k] * kvalue[start_i+k];
+			for(k=0;k<model->nSV[j];k++)
+				sum += coef2[start_j+k] * kvalue[start_j+k];
+			sum -= model->rho[p];
+			if(sum > 0)
+				++vote[i];
+			else
+				++vote[j];
+			p++;
+			start_j += model->nSV[j];
+		}
+		start_i += model->nSV[i];
+	}
+
+	int vote_max_idx = 0;
+	for(i=1;i<nr_class;i++)
+		if(vote[i] > vote[vote_max_idx])
+			vote_max_idx = i;
+	free(vote);
+	return model->label[vote_max_idx];
+}
+
+int svm_multi_predict(const struct svm_multi_model *mm, const struct svm_node *x, double *labels)
+{
+	int nu = mm->nr_unique;
+	double *dot = Malloc(double,nu+1);
+	double *dist = Malloc(double,nu+1);
+	double *gval = Malloc(double,(size_t)mm->nr_group*nu+1);
+	double *kvalue = NULL;
+	int max_l = 0;
+	int g, i, m;
+
+	// geometry shared by every model
+	for(i=0;i<nu;i++)
+		dot_and_dist(x,mm->usv[i],mm->need_dist,&dot[i],&dist[i]);
+
+	// kernel transform once per distinct kernel setting
+	for(g=0;g<mm->nr_group;g++)
+	{
+		const svm_parameter& param = mm->group_param[g];
+		const char *used = mm->group_used[g];
+		double *val = gval + (size_t)g*nu;
+		for(i=0;i<nu;i++)
+		{
+			if(!used[i])
+				continue;
+			switch(param.kernel_type)
+			{
+				case LINEAR: val[i] = dot[i]; break;
+				case POLY: val[i] = powi(param.gamma*dot[i]+param.coef0,param.degree); break;
+				case RBF: val[i] = exp(-param.gamma*dist[i]); break;
+				default: val[i] = tanh(param.gamma*dot[i]+param.coef0); break;
+			}
+		}
+	}
+
+	for(m=0;m<mm->nr_model;m++)
+		if(mm->models[m]->l > max_l)
+			max_l = mm->models[m]->l;
+	kvalue = Malloc(double,max_l+1);
+
+	for(m=0;m<mm->nr_model;m++)
+	{
+		const svm_model *model = mm->models[m];
+		const double *val = gval + (size_t)mm->model_group[m]*nu;
+		const int *map = mm->sv_map[m];
+		for(i=0;i<model->l;i++)
+			kvalue[i] = val[map[i]];
+		labels[m] = predict_from_kvalue(model,kvalue);
+	}
+
+	free(dot);
+	free(dist);
+	free(gval);
+	free(kvalue);
+	return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef _SVM_MULTI_H
+#define _SVM_MULTI_H
+
+#include "svm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// svm_multi_model
+//
+// Evaluates several models trained on the same features in one pass.
+// SVs that appear in more than one model are stored once.  Per sample,
+// each unique SV's dot product with x (linear, polynomial, sigmoid) and
+// squared distance to x (RBF) is computed once, and each distinct kernel
+// setting is applied to it once.  Each model then only sums its
+// coefficients.  The arithmetic matches svm_predict, so the labels are
+// the same as predicting with each model in turn.
+//
+// The models must outlive the multi model.  Precomputed kernels are not
+// supported.
+//
+struct svm_multi_model;
+
+struct svm_multi_model *svm_multi_create(struct svm_model *const *models, int nr_model);
+void svm_multi_free(struct svm_multi_model **mmodel_ptr_ptr);
+
+int svm_multi_nr_unique_sv(const struct svm_multi_model *mmodel);
+int svm_multi_predict(const struct svm_multi_model *mmodel, const struct svm_node *x, double *labels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SVM_MULTI_H */
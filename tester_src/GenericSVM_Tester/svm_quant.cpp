@@ -0,0 +1,564 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "svm_quant.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define SVM_QUANT_SSE2
+#include <emmintrin.h>
+#endif
+
+#define Malloc(type,n) (type *)malloc((n)*sizeof(type))
+
+// SV rows are padded to a multiple of this many features (one 128 bit
+// load of int8, two of fp16/bf16), padding is zero in every format
+#define QUANT_ROW_ALIGN 16
+
+struct svm_quantized_model
+{
+	struct svm_parameter param;
+	int nr_class;
+	int l;
+	int sv_format;
+	int coef_format;
+	int nr_feature;		/* features 1..nr_feature are stored */
+	int dim;			/* nr_feature rounded up to QUANT_ROW_ALIGN */
+	void *sv;			/* l rows of dim elements */
+	float *sv_scale;	/* int8: per-feature scale, dim entries */
+	void *coef;			/* nr_class-1 rows of l elements */
+	double *coef_scale;	/* int8: per-row scale */
+	double *rho;
+	int *label;
+	int *nSV;
+};
+
+static size_t format_size(int format)
+{
+	switch(format)
+	{
+		case SVM_STORE_FP32: return 4;
+		case SVM_STORE_FP16: return 2;
+		case SVM_STORE_BF16: return 2;
+		case SVM_STORE_INT8: return 1;
+		default: return 8;
+	}
+}
+
+const char *svm_store_format_name(int format)
+{
+	switch(format)
+	{
+		case SVM_STORE_FP32: return "fp32";
+		case SVM_STORE_FP16: return "fp16";
+		case SVM_STORE_BF16: return "bf16";
+		case SVM_STORE_INT8: return "int8";
+		default: return "double";
+	}
+}
+
+//
+// Scalar conversions, round to nearest even.  Values beyond the fp16
+// range saturate to the largest finite half.
+//
+static unsigned int float_bits(float f)
+{
+	unsigned int u;
+	memcpy(&u,&f,sizeof(u));
+	return u;
+}
+
+static float bits_float(unsigned int u)
+{
+	float f;
+	memcpy(&f,&u,sizeof(f));
+	return f;
+}
+
+static unsigned short float_to_half(float f)
+{
+	unsigned int u = float_bits(f);
+	unsigned int sign = (u >> 16) & 0x8000;
+	unsigned int a = u & 0x7fffffff;
+
+	if(a >= 0x477ff000)			// rounds to >= 65536, saturate
+		return (unsigned short)(sign | 0x7bff);
+	if(a < 0x38800000)			// fp16 denormal or zero
+	{
+		float d = bits_float(a) * 16777216.0f;	// scale by 2^24, the denormal step
+		unsigned int q = (unsigned int)d;
+		float r = d - (float)q;
+		if(r > 0.5f || (r == 0.5f && (q & 1)))
+			q++;
+		return (unsigned short)(sign | q);
+	}
+	a += 0xc8000fff + ((a >> 13) & 1);	// rebias 127->15 and round
+	return (unsigned short)(sign | (a >> 13));
+}
+
+static float half_to_float(unsigned short h)
+{
+	// exponent and mantissa moved into place, 2^112 rebiases 15->127 and
+	// normalizes denormals in one multiply
+	float f = bits_float((unsigned int)(h & 0x7fff) << 13) * bits_float(0x77800000);
+	return bits_float(float_bits(f) | ((unsigned int)(h & 0x8000) << 16));
+}
+
+static unsigned short float_to_bf16(float f)
+{
+	unsigned int u = float_bits(f);
+	u += 0x7fff + ((u >> 16) & 1);
+	return (unsigned short)(u >> 16);
+}
+
+static float bf16_to_float(unsigned short b)
+{
+	return bits_float((unsigned int)b << 16);
+}
+
+static void store_value(int format, void *base, size_t i, float v, float scale)
+{
+	switch(format)
+	{
+		case SVM_STORE_FP32: ((float *)base)[i] = v; break;
+		case SVM_STORE_FP16: ((unsigned short *)base)[i] = float_to_half(v); break;
+		case SVM_STORE_BF16: ((unsigned short *)base)[i] = float_to_bf16(v); break;
+		case SVM_STORE_INT8:
+		{
+			double q = floor(v/scale + 0.5);
+			if(q > 127) q = 127;
+			if(q < -127) q = -127;
+			((signed char *)base)[i] = (signed char)q;
+			break;
+		}
+	}
+}
+
+// sum of coef[k][start..start+count) * kvalue[start..start+count)
+static double coef_dot(const svm_quantized_model *qm, int k, int start, int count, const double *kvalue)
+{
+	size_t at = (size_t)k*qm->l + start;
+	double sum = 0;
+	int i;
+
+	switch(qm->coef_format)
+	{
+		case SVM_STORE_DOUBLE:
+		{
+			const double *c = (const double *)qm->coef + at;
+			for(i=0;i<count;i++) sum += c[i] * kvalue[start+i];
+			return sum;
+		}
+		case SVM_STORE_FP32:
+		{
+			const float *c = (const float *)qm->coef + at;
+			for(i=0;i<count;i++) sum += c[i] * kvalue[start+i];
+			return sum;
+		}
+		case SVM_STORE_FP16:
+		{
+			const unsigned short *c = (const unsigned short *)qm->coef + at;
+			for(i=0;i<count;i++) sum += half_to_float(c[i]) * kvalue[start+i];
+			return sum;
+		}
+		case SVM_STORE_BF16:
+		{
+			const unsigned short *c = (const unsigned short *)qm->coef + at;
+			for(i=0;i<count;i++) sum += bf16_to_float(c[i]) * kvalue[start+i];
+			return sum;
+		}
+		default:
+		{
+			const signed char *c = (const signed char *)qm->coef + at;
+			for(i=0;i<count;i++) sum += c[i] * kvalue[start+i];
+			return sum * qm->coef_scale[k];
+		}
+	}
+}
+
+//
+// Dequantize-and-accumulate kernels over one SV row.  x is dense with dim
+// entries; for int8 the dot product takes x pre-multiplied by the feature
+// scales, the distance takes the plain x and scales the row.  SSE2 widens
+// four elements per load: fp16 by the same 2^112 multiply as the scalar
+// path, bf16 by a 16 bit shift, int8 by sign-extending unpacks.
+//
+#ifdef SVM_QUANT_SSE2
+static inline __m128 load4(int format, const void *row, int i)
+{
+	switch(format)
+	{
+		case SVM_STORE_FP16:
+		{
+			__m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)((const unsigned short *)row + i)),_mm_setzero_si128());
+			__m128i sign = _mm_slli_epi32(_mm_and_si128(h,_mm_set1_epi32(0x8000)),16);
+			__m128i em = _mm_slli_epi32(_mm_and_si128(h,_mm_set1_epi32(0x7fff)),13);
+			__m128 f = _mm_mul_ps(_mm_castsi128_ps(em),_mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+			return _mm_or_ps(f,_mm_castsi128_ps(sign));
+		}
+		case SVM_STORE_BF16:
+			return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(),
+				_mm_loadl_epi64((const __m128i *)((const unsigned short *)row + i))));
+		case SVM_STORE_INT8:
+		{
+			int packed;
+			memcpy(&packed,(const signed char *)row + i,sizeof(packed));
+			__m128i b = _mm_cvtsi32_si128(packed);
+			b = _mm_unpacklo_epi8(b,b);
+			b = _mm_unpacklo_epi16(b,b);
+			return _mm_cvtepi32_ps(_mm_srai_epi32(b,24));
+		}
+		default:
+			return _mm_loadu_ps((const float *)row + i);
+	}
+}
+
+static inline float hsum(__m128 v)
+{
+	v = _mm_add_ps(v,_mm_movehl_ps(v,v));
+	v = _mm_add_ss(v,_mm_shuffle_ps(v,v,1));
+	return _mm_cvtss_f32(v);
+}
+
+static float row_dot(int format, const void *row, const float *x, int dim)
+{
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	for(int i=0;i<dim;i+=8)
+	{
+		acc0 = _mm_add_ps(acc0,_mm_mul_ps(_mm_loadu_ps(x+i),load4(format,row,i)));
+		acc1 = _mm_add_ps(acc1,_mm_mul_ps(_mm_loadu_ps(x+i+4),load4(format,row,i+4)));
+	}
+	return hsum(_mm_add_ps(acc0,acc1));
+}
+
+static float row_dist(int format, const void *row, const float *scale, const float *x, int dim)
+{
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	for(int i=0;i<dim;i+=8)
+	{
+		__m128 v0 = load4(format,row,i), v1 = load4(format,row,i+4);
+		if(format == SVM_STORE_INT8)
+		{
+			v0 = _mm_mul_ps(v0,_mm_loadu_ps(scale+i));
+			v1 = _mm_mul_ps(v1,_mm_loadu_ps(scale+i+4));
+		}
+		__m128 d0 = _mm_sub_ps(_mm_loadu_ps(x+i),v0);
+		__m128 d1 = _mm_sub_ps(_mm_loadu_ps(x+i+4),v1);
+		acc0 = _mm_add_ps(acc0,_mm_mul_ps(d0,d0));
+		acc1 = _mm_add_ps(acc1,_mm_mul_ps(d1,d1));
+	}
+	return hsum(_mm_add_ps(acc0,acc1));
+}
+#else
+static float load_value(int format, const void *base, size_t i, float scale)
+{
+	switch(format)
+	{
+		case SVM_STORE_FP32: return ((const float *)base)[i];
+		case SVM_STORE_FP16: return half_to_float(((const unsigned short *)base)[i]);
+		case SVM_STORE_BF16: return bf16_to_float(((const unsigned short *)base)[i]);
+		case SVM_STORE_INT8: return ((const signed char *)base)[i]*scale;
+		default: return ((const float *)base)[i];
+	}
+}
+
+static float row_dot(int format, const void *row, const float *x, int dim)
+{
+	float sum = 0;
+	for(int i=0;i<dim;i++)
+		sum += x[i]*load_value(format,row,i,1.0f);
+	return sum;
+}
+
+static float row_dist(int format, const void *row, const float *scale, const float *x, int dim)
+{
+	float sum = 0;
+	for(int i=0;i<dim;i++)
+	{
+		float d = x[i] - load_value(format,row,i,format == SVM_STORE_INT8 ? scale[i] : 1.0f);
+		sum += d*d;
+	}
+	return sum;
+}
+#endif
+
+static double powi(double base, int times)
+{
+	double tmp = base, ret = 1.0;
+
+	for(int t=times; t>0; t/=2)
+	{
+		if(t%2==1) ret*=tmp;
+		tmp = tmp * tmp;
+	}
+	return ret;
+}
+
+struct svm_quantized_model *svm_quantize_model(const struct svm_model *model, int sv_format, int coef_format)
+{
+	const svm_parameter& param = model->param;
+	int l = model->l;
+	int m = model->nr_class - 1;
+	int i, j, k;
+
+	if(param.kernel_type == PRECOMPUTED)
+	{
+		fprintf(stderr,"precomputed kernels cannot be quantized\n");
+		return NULL;
+	}
+	if(sv_format < SVM_STORE_FP32 || sv_format > SVM_STORE_INT8 ||
+	   coef_format < SVM_STORE_DOUBLE || coef_format > SVM_STORE_INT8)
+	{
+		fprintf(stderr,"unknown storage format\n");
+		return NULL;
+	}
+
+	svm_quantized_model *qm = Malloc(svm_quantized_model,1);
+	memset(qm,0,sizeof(svm_quantized_model));
+	qm->param = param;
+	qm->param.nr_weight = 0;
+	qm->param.weight_label = NULL;
+	qm->param.weight = NULL;
+	qm->nr_class = model->nr_class;
+	qm->l = l;
+	qm->sv_format = sv_format;
+	qm->coef_format = coef_format;
+
+	int nr_pair = model->nr_class*(model->nr_class-1)/2;
+	qm->rho = Malloc(double,nr_pair);
+	memcpy(qm->rho,model->rho,nr_pair*sizeof(double));
+	if(model->label)
+	{
+		qm->label = Malloc(int,model->nr_class);
+		memcpy(qm->label,model->label,model->nr_class*sizeof(int));
+	}
+	if(model->nSV)
+	{
+		qm->nSV = Malloc(int,model->nr_class);
+		memcpy(qm->nSV,model->nSV,model->nr_class*sizeof(int));
+	}
+
+	// dense rows over every feature an SV uses
+	for(i=0;i<l;i++)
+		for(const svm_node *p=model->SV[i];p->index!=-1;p++)
+			if(p->index > qm->nr_feature)
+				qm->nr_feature = p->index;
+	qm->dim = (qm->nr_feature + QUANT_ROW_ALIGN - 1)/QUANT_ROW_ALIGN*QUANT_ROW_ALIGN;
+	if(qm->dim == 0)
+		qm->dim = QUANT_ROW_ALIGN;
+
+	size_t sv_bytes = (size_t)l*qm->dim*format_size(sv_format);
+	qm->sv = malloc(sv_bytes > 0 ? sv_bytes : 1);
+	qm->sv_scale = Malloc(float,qm->dim);
+	qm->coef = malloc((size_t)m*l*format_size(coef_format) + 1);
+	qm->coef_scale = Malloc(double,m);
+	if(qm->sv == NULL || qm->coef == NULL)
+	{
+		fprintf(stderr,"cannot allocate quantized model\n");
+		svm_free_quantized_model(&qm);
+		return NULL;
+	}
+	memset(qm->sv,0,sv_bytes);
+
+	for(j=0;j<qm->dim;j++)
+		qm->sv_scale[j] = 1.0f;
+	if(sv_format == SVM_STORE_INT8)
+	{
+		for(j=0;j<qm->dim;j++)
+			qm->sv_scale[j] = 0.0f;
+		for(i=0;i<l;i++)
+			for(const svm_node *p=model->SV[i];p->index!=-1;p++)
+				if(p->index >= 1 && fabs(p->value) > qm->sv_scale[p->index-1])
+					qm->sv_scale[p->index-1] = (float)fabs(p->value);
+		for(j=0;j<qm->dim;j++)
+			qm->sv_scale[j] = (qm->sv_scale[j] > 0) ? qm->sv_scale[j]/127.0f : 1.0f;
+	}
+	for(i=0;i<l;i++)
+		for(const svm_node *p=model->SV[i];p->index!=-1;p++)
+			if(p->index >= 1)
+				store_value(sv_format,qm->sv,(size_t)i*qm->dim+p->index-1,(float)p->value,qm->sv_scale[p->index-1]);
+
+	for(k=0;k<m;k++)
+	{
+		double max_abs = 0;
+		for(i=0;i<l;i++)
+			if(fabs(model->sv_coef[k][i]) > max_abs)
+				max_abs = fabs(model->sv_coef[k][i]);
+		qm->coef_scale[k] = (max_abs > 0) ? max_abs/127.0 : 1.0;
+		for(i=0;i<l;i++)
+		{
+			size_t at = (size_t)k*l + i;
+			if(coef_format == SVM_STORE_DOUBLE)
+				((double *)qm->coef)[at] = model->sv_coef[k][i];
+			else
+				store_value(coef_format,qm->coef,at,(float)model->sv_coef[k][i],(float)qm->coef_scale[k]);
+		}
+	}
+
+	return qm;
+}
+
+void svm_free_quantized_model(struct svm_quantized_model **qmodel_ptr_ptr)
+{
+	svm_quantized_model *qm = *qmodel_ptr_ptr;
+	if(qm != NULL)
+	{
+		free(qm->sv);
+		free(qm->sv_scale);
+		free(qm->coef);
+		free(qm->coef_scale);
+		free(qm->rho);
+		free(qm->label);
+		free(qm->nSV);
+		free(qm);
+		*qmodel_ptr_ptr = NULL;
+	}
+}
+
+size_t svm_quantized_model_bytes(const struct svm_quantized_model *qm)
+{
+	return (size_t)qm->l*qm->dim*format_size(qm->sv_format) +
+		   (size_t)(qm->nr_class-1)*qm->l*format_size(qm->coef_format);
+}
+
+// x is dense over dim features; extra_sq is the squared norm of any input
+// features past nr_feature, which only the distance sees
+static double predict_dense(const svm_quantized_model *qm, const float *x, double extra_sq, double *dec_values)
+{
+	const svm_parameter& param = qm->param;
+	int l = qm->l;
+	int i;
+	size_t row_bytes = (size_t)qm->dim*format_size(qm->sv_format);
+	const char *row = (const char *)qm->sv;
+	double *kvalue = Malloc(double,l > 0 ? l : 1);
+	float *xs = NULL;
+
+	if(qm->sv_format == SVM_STORE_INT8 && param.kernel_type != RBF)
+	{
+		xs = Malloc(float,qm->dim);
+		for(i=0;i<qm->dim;i++)
+			xs[i] = x[i]*qm->sv_scale[i];
+	}
+
+	for(i=0;i<l;i++,row+=row_bytes)
+	{
+		switch(param.kernel_type)
+		{
+			case LINEAR:
+				kvalue[i] = row_dot(qm->sv_format,row,xs ? xs : x,qm->dim);
+				break;
+			case POLY:
+				kvalue[i] = powi(param.gamma*row_dot(qm->sv_format,row,xs ? xs : x,qm->dim)+param.coef0,param.degree);
+				break;
+			case RBF:
+				kvalue[i] = exp(-param.gamma*(row_dist(qm->sv_format,row,qm->sv_scale,x,qm->dim)+extra_sq));
+				break;
+			case SIGMOID:
+				kvalue[i] = tanh(param.gamma*row_dot(qm->sv_format,row,xs ? xs : x,qm->dim)+param.coef0);
+				break;
+		}
+	}
+	free(xs);
+
+	double result;
+	if(param.svm_type == ONE_CLASS || param.svm_type == EPSILON_SVR || param.svm_type == NU_SVR)
+	{
+		double sum = coef_dot(qm,0,0,l,kvalue) - qm->rho[0];
+		*dec_values = sum;
+		if(param.svm_type == ONE_CLASS)
+			result = (sum>0)?1:-1;
+		else
+			result = sum;
+	}
+	else
+	{
+		int nr_class = qm->nr_class;
+		int *start = Malloc(int,nr_class);
+		int *vote = Malloc(int,nr_class);
+
+		start[0] = 0;
+		for(i=1;i<nr_class;i++)
+			start[i] = start[i-1]+qm->nSV[i-1];
+		for(i=0;i<nr_class;i++)
+			vote[i] = 0;
+
+		int p=0;
+		for(i=0;i<nr_class;i++)
+			for(int j=i+1;j<nr_class;j++)
+			{
+				double sum = coef_dot(qm,j-1,start[i],qm->nSV[i],kvalue) +
+							 coef_dot(qm,i,start[j],qm->nSV[j],kvalue);
+				sum -= qm->rho[p];
+				dec_values[p] = sum;
+				if(dec_values[p] > 0)
+					++vote[i];
+				else
+					++vote[j];
+				p++;
+			}
+
+		int vote_max_idx = 0;
+		for(i=1;i<nr_class;i++)
+			if(vote[i] > vote[vote_max_idx])
+				vote_max_idx = i;
+		result = qm->label[vote_max_idx];
+		free(start);
+		free(vote);
+	}
+	free(kvalue);
+	return result;
+}
+
+double svm_quantized_predict_values(const struct svm_quantized_model *qm, const struct svm_node *x, double *dec_values)
+{
+	float *dense = Malloc(float,qm->dim);
+	double extra_sq = 0;
+
+	memset(dense,0,qm->dim*sizeof(float));
+	for(;x->index != -1;x++)
+	{
+		if(x->index >= 1 && x->index <= qm->nr_feature)
+			dense[x->index-1] = (float)x->value;
+		else
+			extra_sq += x->value*x->value;
+	}
+	double result = predict_dense(qm,dense,extra_sq,dec_values);
+	free(dense);
+	return result;
+}
+
+static double *alloc_dec_values(const svm_quantized_model *qm)
+{
+	int n = qm->nr_class*(qm->nr_class-1)/2;
+	return Malloc(double,n > 0 ? n : 1);
+}
+
+double svm_quantized_predict(const struct svm_quantized_model *qm, const struct svm_node *x)
+{
+	double *dec_values = alloc_dec_values(qm);
+	double result = svm_quantized_predict_values(qm,x,dec_values);
+	free(dec_values);
+	return result;
+}
+
+// x[0] is feature 1, as sent to the FPGA
+double svm_quantized_predict_dense(const struct svm_quantized_model *qm, const float *x, int n)
+{
+	float *dense = Malloc(float,qm->dim);
+	double *dec_values = alloc_dec_values(qm);
+	double extra_sq = 0;
+	int i;
+
+	memset(dense,0,qm->dim*sizeof(float));
+	for(i=0;i<n;i++)
+	{
+		if(i < qm->nr_feature)
+			dense[i] = x[i];
+		else
+			extra_sq += (double)x[i]*x[i];
+	}
+	double result = predict_dense(qm,dense,extra_sq,dec_values);
+	free(dense);
+	free(dec_values);
+	return result;
+}
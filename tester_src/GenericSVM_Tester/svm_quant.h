@@ -0,0 +1,37 @@
+#ifndef _SVM_QUANT_H
+#define _SVM_QUANT_H
+
+#include <stddef.h>
+#include "svm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { SVM_STORE_DOUBLE, SVM_STORE_FP32, SVM_STORE_FP16, SVM_STORE_BF16, SVM_STORE_INT8 };	/* storage format */
+
+//
+// svm_quantized_model
+//
+// Dense copy of a model with the SVs (and optionally the coefficients) held
+// in a reduced precision format.  It does not reference the svm_model it was
+// built from.  int8 SVs use one scale per feature, int8 coefficients one
+// scale per decision function row.
+//
+struct svm_quantized_model;
+
+struct svm_quantized_model *svm_quantize_model(const struct svm_model *model, int sv_format, int coef_format);
+void svm_free_quantized_model(struct svm_quantized_model **qmodel_ptr_ptr);
+
+double svm_quantized_predict_values(const struct svm_quantized_model *qmodel, const struct svm_node *x, double *dec_values);
+double svm_quantized_predict(const struct svm_quantized_model *qmodel, const struct svm_node *x);
+double svm_quantized_predict_dense(const struct svm_quantized_model *qmodel, const float *x, int n);
+
+size_t svm_quantized_model_bytes(const struct svm_quantized_model *qmodel);
+const char *svm_store_format_name(int format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SVM_QUANT_H */
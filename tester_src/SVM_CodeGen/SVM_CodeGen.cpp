@@ -0,0 +1,342 @@
+/////////////////////////////////////////////////////
+// SVM_CodeGen.cpp : Writes a libsvm model out as  //
+//     a C++ source/header pair with the model in  //
+//     constant arrays and a predict function for  //
+//     its kernel, so a fixed deployment needs no  //
+//     model file at run time.                     //
+/////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "svm.h"
+
+#define DOUBLES_PER_LINE	4
+#define STACK_KVALUE_MAX	8192	/* generated code keeps kernel values on the stack up to this many SVs */
+
+
+void exit_with_help()
+{
+	printf(
+	"Usage: SVM_CodeGen [options] model_file output_name\n"
+	"options:\n"
+	"-f features : dense width of the SV arrays (default: largest SV index)\n"
+	"Writes output_name.cpp and output_name.h.  The functions are named after\n"
+	"the file part of output_name:\n"
+	"  double <name>_predict(const struct svm_node *x);\n"
+	"  double <name>_predict_values(const struct svm_node *x, double *dec_values);\n"
+	"and return exactly what svm_predict and svm_predict_values return for the\n"
+	"model.  Probability outputs are not generated.\n");
+	exit(1);
+}
+
+
+/* shortest of %.15g..%.17g that reads back as the same double */
+static void printDouble(FILE *out, double v)
+{
+	char buf[64];
+	int digits;
+
+	for(digits=15;digits<17;digits++)
+	{
+		sprintf(buf,"%.*g",digits,v);
+		if(strtod(buf,NULL) == v)
+			break;
+	}
+	fprintf(out,"%.*g",digits,v);
+}
+
+static void emitDoubles(FILE *out, const char *decl, const double *v, int n)
+{
+	int i;
+
+	fprintf(out,"%s =\n{",decl);
+	for(i=0;i<n;i++)
+	{
+		fprintf(out,(i % DOUBLES_PER_LINE == 0) ? "\n\t" : " ");
+		printDouble(out,v[i]);
+		if(i+1 < n)
+			fprintf(out,",");
+	}
+	fprintf(out,"\n};\n\n");
+}
+
+static void emitInts(FILE *out, const char *decl, const int *v, int n)
+{
+	int i;
+
+	fprintf(out,"%s = {",decl);
+	for(i=0;i<n;i++)
+		fprintf(out,"%d%s",v[i],(i+1 < n) ? ", " : "");
+	fprintf(out,"};\n\n");
+}
+
+/* kernel value of SV k against dense[], as Kernel::k_function computes it */
+static void emitKernel(FILE *out, const struct svm_model *model)
+{
+	fprintf(out,"static double kernel(const double *s, const double *dense, const struct svm_node *tail)\n{\n");
+	fprintf(out,"\tdouble sum = 0;\n\tint j;\n\n");
+	if(model->param.kernel_type == RBF)
+	{
+		fprintf(out,"\tfor(j=0;j<NUM_FEATURES;j++)\n\t{\n\t\tdouble d = dense[j] - s[j];\n\t\tsum += d*d;\n\t}\n");
+		fprintf(out,"\t/* features past the SVs, in index order like the sparse merge */\n");
+		fprintf(out,"\tfor(;tail->index != -1;tail++)\n\t\tsum += tail->value * tail->value;\n");
+		fprintf(out,"\treturn exp(-KERNEL_GAMMA*sum);\n}\n\n");
+		return;
+	}
+	fprintf(out,"\t(void)tail;\n");
+	fprintf(out,"\tfor(j=0;j<NUM_FEATURES;j++)\n\t\tsum += dense[j]*s[j];\n");
+	switch(model->param.kernel_type)
+	{
+		case LINEAR:
+			fprintf(out,"\treturn sum;\n}\n\n");
+			break;
+		case POLY:
+			fprintf(out,"\n\t/* powi() of svm.cpp, the degree folds to a fixed sequence */\n");
+			fprintf(out,"\tdouble tmp = KERNEL_GAMMA*sum+KERNEL_COEF0, ret = 1.0;\n");
+			fprintf(out,"\tfor(int t=KERNEL_DEGREE;t>0;t/=2)\n\t{\n\t\tif(t%%2==1) ret*=tmp;\n\t\ttmp = tmp * tmp;\n\t}\n");
+			fprintf(out,"\treturn ret;\n}\n\n");
+			break;
+		default:
+			fprintf(out,"\treturn tanh(KERNEL_GAMMA*sum+KERNEL_COEF0);\n}\n\n");
+			break;
+	}
+}
+
+static int writeSource(const char *fname, const char *fileBase, const char *name, const char *modelName,
+					   const struct svm_model *model, int numFeatures)
+{
+	static const char *kernelName[] = {"linear","polynomial","rbf","sigmoid"};
+	int classification = (model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC);
+	int nr_class = model->nr_class;
+	int m = classification ? nr_class-1 : 1;
+	int l = model->l;
+	double *values;
+	char decl[256];
+	int i, k;
+	FILE *out;
+
+	if(!(out = fopen(fname,"w")))
+	{
+		printf("ERROR opening %s!\n",fname);
+		return -1;
+	}
+	fprintf(out,"// %s.cpp : generated by SVM_CodeGen from %s, do not edit.\n",fileBase,modelName);
+	fprintf(out,"//\n// %s kernel, %d SVs, %d features",kernelName[model->param.kernel_type],l,numFeatures);
+	if(classification)
+		fprintf(out,", %d classes",nr_class);
+	fprintf(out,"\n//\n#include <math.h>\n#include <stdlib.h>\n#include \"%s.h\"\n\n",fileBase);
+
+	fprintf(out,"#if defined(_MSC_VER)\n#define MODEL_ALIGN __declspec(align(64))\n#else\n#define MODEL_ALIGN __attribute__((aligned(64)))\n#endif\n\n");
+	fprintf(out,"#define NUM_SV\t\t\t%d\n#define NUM_FEATURES\t%d\n",l,numFeatures);
+	if(classification)
+		fprintf(out,"#define NUM_CLASS\t\t%d\n",nr_class);
+	fprintf(out,"\nstatic const double KERNEL_GAMMA = ");
+	printDouble(out,model->param.gamma);
+	fprintf(out,";\nstatic const double KERNEL_COEF0 = ");
+	printDouble(out,model->param.coef0);
+	fprintf(out,";\n");
+	fprintf(out,"static const int KERNEL_DEGREE = %d;\n\n",model->param.degree);
+
+	/* dense SVs, one row of NUM_FEATURES each */
+	values = (double *)calloc((size_t)l*numFeatures + 1,sizeof(double));
+	if(values == NULL)
+	{
+		printf("ERROR allocating %d x %d SV values!\n",l,numFeatures);
+		fclose(out);
+		return -1;
+	}
+	for(i=0;i<l;i++)
+		for(const struct svm_node *p=model->SV[i];p->index != -1;p++)
+			values[(size_t)i*numFeatures + p->index-1] = p->value;
+	emitDoubles(out,"MODEL_ALIGN static const double sv[NUM_SV*NUM_FEATURES]",values,l*numFeatures);
+	free(values);
+
+	/* coefficients, (nr_class-1) rows of NUM_SV */
+	values = (double *)malloc(((size_t)m*l + 1)*sizeof(double));
+	for(k=0;k<m;k++)
+		memcpy(&values[(size_t)k*l],model->sv_coef[k],l*sizeof(double));
+	sprintf(decl,"MODEL_ALIGN static const double coef[%d*NUM_SV]",m);
+	emitDoubles(out,decl,values,m*l);
+	free(values);
+
+	if(classification)
+	{
+		int *start = (int *)malloc((nr_class+1)*sizeof(int));
+
+		start[0] = 0;
+		for(i=0;i<nr_class;i++)
+			start[i+1] = start[i] + model->nSV[i];
+		emitDoubles(out,"static const double rho[NUM_CLASS*(NUM_CLASS-1)/2]",model->rho,nr_class*(nr_class-1)/2);
+		emitInts(out,"static const int start[NUM_CLASS+1]",start,nr_class+1);
+		emitInts(out,"static const int label[NUM_CLASS]",model->label,nr_class);
+		free(start);
+	}
+	else
+	{
+		fprintf(out,"static const double rho0 = ");
+		printDouble(out,model->rho[0]);
+		fprintf(out,";\n\n");
+	}
+
+	emitKernel(out,model);
+
+	fprintf(out,"double %s_predict_values(const struct svm_node *x, double *dec_values)\n{\n",name);
+	fprintf(out,"\tdouble dense[NUM_FEATURES];\n");
+	if(l <= STACK_KVALUE_MAX)
+		fprintf(out,"\tdouble kvalue[NUM_SV];\n");
+	else
+		fprintf(out,"\tdouble *kvalue = (double *)malloc(NUM_SV*sizeof(double));\n");
+	fprintf(out,"\tint i, j, k;\n\n");
+	fprintf(out,"\tfor(j=0;j<NUM_FEATURES;j++)\n\t\tdense[j] = 0;\n");
+	fprintf(out,"\tfor(;x->index != -1 && x->index <= NUM_FEATURES;x++)\n\t\tif(x->index >= 1)\n\t\t\tdense[x->index-1] = x->value;\n");
+	fprintf(out,"\tfor(k=0;k<NUM_SV;k++)\n\t\tkvalue[k] = kernel(&sv[k*NUM_FEATURES],dense,x);\n\n");
+
+	if(classification)
+	{
+		fprintf(out,"\tint vote[NUM_CLASS];\n\tint p = 0, vote_max_idx = 0;\n\n");
+		fprintf(out,"\tfor(i=0;i<NUM_CLASS;i++)\n\t\tvote[i] = 0;\n");
+		fprintf(out,"\tfor(i=0;i<NUM_CLASS;i++)\n\t\tfor(j=i+1;j<NUM_CLASS;j++)\n\t\t{\n");
+		fprintf(out,"\t\t\tdouble sum = 0;\n");
+		fprintf(out,"\t\t\tfor(k=start[i];k<start[i+1];k++)\n\t\t\t\tsum += coef[(j-1)*NUM_SV+k] * kvalue[k];\n");
+		fprintf(out,"\t\t\tfor(k=start[j];k<start[j+1];k++)\n\t\t\t\tsum += coef[i*NUM_SV+k] * kvalue[k];\n");
+		fprintf(out,"\t\t\tsum -= rho[p];\n\t\t\tdec_values[p] = sum;\n\n");
+		fprintf(out,"\t\t\tif(dec_values[p] > 0)\n\t\t\t\t++vote[i];\n\t\t\telse\n\t\t\t\t++vote[j];\n\t\t\tp++;\n\t\t}\n");
+		fprintf(out,"\tfor(i=1;i<NUM_CLASS;i++)\n\t\tif(vote[i] > vote[vote_max_idx])\n\t\t\tvote_max_idx = i;\n");
+		if(l > STACK_KVALUE_MAX)
+			fprintf(out,"\tfree(kvalue);\n");
+		fprintf(out,"\treturn label[vote_max_idx];\n}\n\n");
+	}
+	else
+	{
+		fprintf(out,"\tdouble sum = 0;\n\n\t(void)i;\n");
+		fprintf(out,"\tfor(k=0;k<NUM_SV;k++)\n\t\tsum += coef[k] * kvalue[k];\n");
+		fprintf(out,"\tsum -= rho0;\n\t*dec_values = sum;\n");
+		if(l > STACK_KVALUE_MAX)
+			fprintf(out,"\tfree(kvalue);\n");
+		if(model->param.svm_type == ONE_CLASS)
+			fprintf(out,"\treturn (sum>0)?1:-1;\n}\n\n");
+		else
+			fprintf(out,"\treturn sum;\n}\n\n");
+	}
+
+	fprintf(out,"double %s_predict(const struct svm_node *x)\n{\n",name);
+	if(classification)
+		fprintf(out,"\tdouble dec_values[NUM_CLASS*(NUM_CLASS-1)/2];\n");
+	else
+		fprintf(out,"\tdouble dec_values[1];\n");
+	fprintf(out,"\treturn %s_predict_values(x,dec_values);\n}\n",name);
+
+	fclose(out);
+	return 0;
+}
+
+static int writeHeader(const char *fname, const char *fileBase, const char *name, const char *modelName,
+					   const struct svm_model *model)
+{
+	char guard[256];
+	int i;
+	FILE *out;
+
+	if(!(out = fopen(fname,"w")))
+	{
+		printf("ERROR opening %s!\n",fname);
+		return -1;
+	}
+	for(i=0;name[i] != '\0' && i < 250;i++)
+		guard[i] = (char)toupper((unsigned char)name[i]);
+	guard[i] = '\0';
+
+	fprintf(out,"// %s.h : generated by SVM_CodeGen from %s, do not edit.\n",fileBase,modelName);
+	fprintf(out,"#ifndef _%s_H\n#define _%s_H\n\n#include \"svm.h\"\n\n",guard,guard);
+	if(model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC)
+		fprintf(out,"#define %s_NR_DEC_VALUES\t%d\n\n",guard,model->nr_class*(model->nr_class-1)/2);
+	else
+		fprintf(out,"#define %s_NR_DEC_VALUES\t1\n\n",guard);
+	fprintf(out,"double %s_predict(const struct svm_node *x);\n",name);
+	fprintf(out,"double %s_predict_values(const struct svm_node *x, double *dec_values);\n\n",name);
+	fprintf(out,"#endif /* _%s_H */\n",guard);
+	fclose(out);
+	return 0;
+}
+
+
+
+
+int main(int argc, char **argv)
+{
+	char srcName[1024], hdrName[1024], name[256];
+	const char *base, *c;
+	struct svm_model *model;
+	int numFeatures = 0, maxIndex = 0;
+	int i, sv, n;
+
+	for(i=1;i<argc && argv[i][0] == '-';i++)
+	{
+		if(++i >= argc)
+			exit_with_help();
+		switch(argv[i-1][1])
+		{
+			case 'f':
+				numFeatures = atoi(argv[i]);
+				break;
+			default:
+				printf("Unknown option: -%c\n",argv[i-1][1]);
+				exit_with_help();
+		}
+	}
+	if(argc - i != 2)
+		exit_with_help();
+
+	if(!(model = svm_load_model(argv[i])))
+	{
+		printf("ERROR loading model %s!\n",argv[i]);
+		return -1;
+	}
+	if(model->param.kernel_type == PRECOMPUTED || model->l == 0)
+	{
+		printf("ERROR %s has a precomputed kernel or no SVs!\n",argv[i]);
+		return -1;
+	}
+	for(sv=0;sv<model->l;sv++)
+		for(const struct svm_node *x=model->SV[sv];x->index != -1;x++)
+		{
+			if(x->index < 1)
+			{
+				printf("ERROR SV %d has feature index %d!\n",sv+1,x->index);
+				return -1;
+			}
+			if(x->index > maxIndex)
+				maxIndex = x->index;
+		}
+	if(numFeatures < maxIndex)
+	{
+		if(numFeatures > 0)
+			printf("Widening to %d features, the largest SV index\n",maxIndex);
+		numFeatures = (maxIndex > 0) ? maxIndex : 1;
+	}
+
+	/* C identifier from the file part of output_name */
+	base = argv[i+1];
+	for(c=base;*c != '\0';c++)
+		if(*c == '\\' || *c == '/')
+			base = c+1;
+	for(n=0;base[n] != '\0' && n < 250;n++)
+		name[n] = isalnum((unsigned char)base[n]) ? base[n] : '_';
+	name[n] = '\0';
+	if(n == 0 || isdigit((unsigned char)name[0]))
+	{
+		printf("ERROR %s does not give a C name!\n",argv[i+1]);
+		return -1;
+	}
+
+	sprintf(srcName,"%s.cpp",argv[i+1]);
+	sprintf(hdrName,"%s.h",argv[i+1]);
+	if(writeHeader(hdrName,base,name,argv[i],model) != 0 ||
+	   writeSource(srcName,base,name,argv[i],model,numFeatures) != 0)
+		return -1;
+	printf("Wrote %s and %s: %d SVs x %d features\n",srcName,hdrName,model->l,numFeatures);
+
+	svm_free_and_destroy_model(&model);
+	return 0;
+}
@@ -0,0 +1,573 @@
+/////////////////////////////////////////////////////
+// SVM_Compress.cpp : Reduced-set compression of   //
+//     libsvm classification models.  Each budget  //
+//     produces a libsvm model, an FPGA "A" model  //
+//     and a line in the trade-off report.         //
+/////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <windows.h>
+#include "config_Flgs.h"
+#include "svm.h"
+#include "svm_data.h"
+#include "fpga_model.h"
+
+#define DEFAULT_RIDGE		1e-6
+#define REFIT_ROW_BLOCK		256
+
+
+void exit_with_help()
+{
+	printf(
+	"Usage: SVM_Compress [options] model_file test_file budget [budget ...]\n"
+	"options:\n"
+	"-f features : feature count of the FPGA build (default: largest index seen)\n"
+	"-r ridge : relative ridge term of the coefficient refit (default %g)\n"
+	"Every budget is a total SV count.  For each one model_file.<nSV>.model,\n"
+	"model_file.<nSV>A.model and a line of model_file.compress.txt are written.\n",
+	DEFAULT_RIDGE);
+	exit(1);
+}
+
+
+/* SVs of each class in descending order of their total |coefficient| */
+typedef struct
+{
+	double weight;
+	int sv;
+} rankedSV;
+
+static double svWeight(const struct svm_model *model, int sv)
+{
+	double w = 0;
+	int k;
+
+	for(k=0;k<model->nr_class-1;k++)
+		w += fabs(model->sv_coef[k][sv]);
+	return w;
+}
+
+static int compareWeight(const void *a, const void *b)
+{
+	const rankedSV *ra = (const rankedSV *)a;
+	const rankedSV *rb = (const rankedSV *)b;
+
+	if(ra->weight > rb->weight) return -1;
+	if(ra->weight < rb->weight) return 1;
+	return ra->sv - rb->sv;
+}
+
+static int compareInt(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      classQuotas
+* Arguments: model, budget - total SVs to keep
+*            quota - receives the SVs kept per class
+* Returns:   ---
+*
+* Splits the budget in proportion to nSV (largest remainder), keeping at
+* least one SV in every class that has any while the budget allows.  The
+* quotas never add up to more than the budget.
+*
+***************************************************************************/
+static void classQuotas(const struct svm_model *model, int budget, int *quota)
+{
+	int nrClass = model->nr_class;
+	double *remainder = (double *)malloc(nrClass*sizeof(double));
+	int used = 0, i;
+
+	for(i=0;i<nrClass;i++)
+	{
+		double share = (double)budget*model->nSV[i]/model->l;
+
+		quota[i] = (int)share;
+		remainder[i] = share - quota[i];
+		if(quota[i] < 1 && model->nSV[i] > 0)
+		{
+			quota[i] = 1;
+			remainder[i] = -1;
+		}
+		used += quota[i];
+	}
+	while(used < budget)
+	{
+		int best = -1;
+
+		for(i=0;i<nrClass;i++)
+			if(quota[i] < model->nSV[i] && (best < 0 || remainder[i] > remainder[best]))
+				best = i;
+		if(best < 0)
+			break;
+		quota[best]++;
+		remainder[best] = -1;
+		used++;
+	}
+	/* The minimum of one per class can overshoot, take back from the largest */
+	while(used > budget)
+	{
+		int largest = 0;
+
+		for(i=1;i<nrClass;i++)
+			if(quota[i] > quota[largest])
+				largest = i;
+		quota[largest]--;
+		used--;
+	}
+	free(remainder);
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      choleskySolve
+* Arguments: a - n x n symmetric positive definite matrix, overwritten
+*            b - right hand side, receives the solution
+* Returns:   0 on success, -1 if a is not positive definite
+*
+***************************************************************************/
+static int choleskySolve(double *a, double *b, int n)
+{
+	int i, j, k;
+
+	for(j=0;j<n;j++)
+	{
+		double d = a[j*n+j];
+
+		for(k=0;k<j;k++)
+			d -= a[j*n+k]*a[j*n+k];
+		if(d <= 0)
+			return -1;
+		a[j*n+j] = sqrt(d);
+#pragma omp parallel for private(k)
+		for(i=j+1;i<n;i++)
+		{
+			double s = a[i*n+j];
+
+			for(k=0;k<j;k++)
+				s -= a[i*n+k]*a[j*n+k];
+			a[i*n+j] = s/a[j*n+j];
+		}
+	}
+	for(i=0;i<n;i++)
+	{
+		for(k=0;k<i;k++)
+			b[i] -= a[i*n+k]*b[k];
+		b[i] /= a[i*n+i];
+	}
+	for(i=n-1;i>=0;i--)
+	{
+		for(k=i+1;k<n;k++)
+			b[i] -= a[k*n+i]*b[k];
+		b[i] /= a[i*n+i];
+	}
+	return 0;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      refitPair
+* Arguments: model - original model, decValues - its decision values at
+*            every original SV (l x numPairs), pair - index of (ci,cj)
+*            small - compressed model, coefficients and rho are written
+*            ridge - relative ridge term
+* Returns:   0 on success, -1 if the system could not be solved
+*
+* Least squares fit of the kept SVs' coefficients (and rho) for one
+* pairwise classifier so its decision values at the original SVs of both
+* classes match the original ones.
+*
+***************************************************************************/
+static int refitPair(const struct svm_model *model, const double *decValues, int pair,
+					 int ci, int cj, const int *start, struct svm_model *small,
+					 const int *smallStart, double ridge)
+{
+	int numPairs = model->nr_class*(model->nr_class-1)/2;
+	int pi = small->nSV[ci], pj = small->nSV[cj];
+	int n = pi + pj + 1;		/* kept SVs plus rho */
+	int numRows = model->nSV[ci] + model->nSV[cj];
+	double *gram = (double *)calloc((size_t)n*n,sizeof(double));
+	double *rhs = (double *)calloc(n,sizeof(double));
+	double *block = (double *)malloc((size_t)REFIT_ROW_BLOCK*n*sizeof(double));
+	double *target = (double *)malloc(REFIT_ROW_BLOCK*sizeof(double));
+	double trace = 0;
+	int r0, i, j, rtnVal;
+
+	if(!gram || !rhs || !block || !target)
+	{
+		printf("ERROR allocating the %d x %d refit system!!\n",n,n);
+		free(gram); free(rhs); free(block); free(target);
+		return -1;
+	}
+
+	/* Accumulate the normal equations a block of rows at a time */
+	for(r0=0;r0<numRows;r0+=REFIT_ROW_BLOCK)
+	{
+		int rows = (numRows - r0 < REFIT_ROW_BLOCK) ? numRows - r0 : REFIT_ROW_BLOCK;
+
+#pragma omp parallel for private(j)
+		for(i=0;i<rows;i++)
+		{
+			int r = r0 + i;
+			int sv = (r < model->nSV[ci]) ? start[ci] + r : start[cj] + r - model->nSV[ci];
+			double *row = &block[i*n];
+
+			for(j=0;j<pi;j++)
+				row[j] = svm_k_function(model->SV[sv],small->SV[smallStart[ci]+j],&model->param);
+			for(j=0;j<pj;j++)
+				row[pi+j] = svm_k_function(model->SV[sv],small->SV[smallStart[cj]+j],&model->param);
+			row[n-1] = -1.0;
+			target[i] = decValues[(size_t)sv*numPairs+pair];
+		}
+
+#pragma omp parallel for private(j)
+		for(i=0;i<n;i++)
+		{
+			int r;
+
+			for(r=0;r<rows;r++)
+			{
+				double a = block[r*n+i];
+
+				if(a == 0)
+					continue;
+				for(j=0;j<=i;j++)
+					gram[i*n+j] += a*block[r*n+j];
+				rhs[i] += a*target[r];
+			}
+		}
+	}
+
+	for(i=0;i<n-1;i++)
+		trace += gram[i*n+i];
+	for(i=0;i<n;i++)
+		for(j=0;j<i;j++)
+			gram[j*n+i] = gram[i*n+j];
+
+	/* Ridge on the coefficients only, grown until the system factors */
+	rtnVal = -1;
+	for(;ridge < 1.0 && rtnVal != 0;ridge *= 10)
+	{
+		double *a = (double *)malloc((size_t)n*n*sizeof(double));
+		double *x = (double *)malloc(n*sizeof(double));
+		double lambda = ridge*trace/(n > 1 ? n - 1 : 1) + 1e-12;
+
+		memcpy(a,gram,(size_t)n*n*sizeof(double));
+		memcpy(x,rhs,n*sizeof(double));
+		for(i=0;i<n-1;i++)
+			a[i*n+i] += lambda;
+		a[(n-1)*n+(n-1)] += 1e-12;
+		if(choleskySolve(a,x,n) == 0)
+		{
+			for(j=0;j<pi;j++)
+				small->sv_coef[cj-1][smallStart[ci]+j] = x[j];
+			for(j=0;j<pj;j++)
+				small->sv_coef[ci][smallStart[cj]+j] = x[pi+j];
+			small->rho[pair] = x[n-1];
+			rtnVal = 0;
+		}
+		free(a);
+		free(x);
+	}
+
+	free(gram);
+	free(rhs);
+	free(block);
+	free(target);
+	return rtnVal;
+}
+
+
+
+
+/***************************************************************************
+*
+* Name:      compressModel
+* Arguments: model - classification model, budget - total SVs to keep
+*            ridge - relative ridge term of the refit
+* Returns:   new model with at most budget SVs, NULL on error
+*
+* Keeps the most heavily weighted SVs of every class and refits all
+* pairwise coefficients and rho values against the original decision
+* values.  The result owns its SV nodes and is released with
+* svm_free_and_destroy_model.
+*
+***************************************************************************/
+static struct svm_model *compressModel(const struct svm_model *model, int budget, double ridge)
+{
+	int nrClass = model->nr_class;
+	int numPairs = nrClass*(nrClass-1)/2;
+	int *start = (int *)malloc(nrClass*sizeof(int));
+	int *smallStart = (int *)malloc(nrClass*sizeof(int));
+	int *keep = (int *)malloc(model->l*sizeof(int));
+	rankedSV *rank = (rankedSV *)malloc(model->l*sizeof(rankedSV));
+	double *decValues;
+	struct svm_model *small;
+	struct svm_node *xSpace;
+	int numNodes = 0, newL = 0;
+	int i, j, k, p;
+
+	/* Pick the SVs */
+	small = (struct svm_model *)calloc(1,sizeof(struct svm_model));
+	small->param = model->param;
+	small->param.nr_weight = 0;
+	small->param.weight_label = NULL;
+	small->param.weight = NULL;
+	small->param.probability = 0;
+	small->nr_class = nrClass;
+	small->nSV = (int *)malloc(nrClass*sizeof(int));
+	small->label = (int *)malloc(nrClass*sizeof(int));
+	small->rho = (double *)malloc(numPairs*sizeof(double));
+	memcpy(small->label,model->label,nrClass*sizeof(int));
+	classQuotas(model,budget,small->nSV);
+
+	for(i=0,k=0;i<nrClass;i++)
+	{
+		int kept = small->nSV[i];
+
+		start[i] = k;
+		smallStart[i] = newL;
+		for(j=0;j<model->nSV[i];j++)
+		{
+			rank[j].weight = svWeight(model,k + j);
+			rank[j].sv = k + j;
+		}
+		qsort(rank,model->nSV[i],sizeof(rankedSV),compareWeight);
+		for(j=0;j<kept;j++)
+			keep[newL+j] = rank[j].sv;
+		qsort(&keep[newL],kept,sizeof(int),compareInt);
+		k += model->nSV[i];
+		newL += kept;
+	}
+	free(rank);
+
+	small->l = newL;
+	small->free_sv = 1;
+	small->SV = (struct svm_node **)malloc(newL*sizeof(struct svm_node *));
+	small->sv_coef = (double **)malloc((nrClass-1)*sizeof(double *));
+	for(k=0;k<nrClass-1;k++)
+		small->sv_coef[k] = (double *)calloc(newL,sizeof(double));
+	for(i=0;i<newL;i++)
+	{
+		const struct svm_node *x = model->SV[keep[i]];
+
+		while((x++)->index != -1)
+			numNodes++;
+		numNodes++;
+	}
+	xSpace = (struct svm_node *)malloc(numNodes*sizeof(struct svm_node));
+	for(i=0,j=0;i<newL;i++)
+	{
+		const struct svm_node *x = model->SV[keep[i]];
+
+		small->SV[i] = &xSpace[j];
+		do
+			xSpace[j++] = *x;
+		while((x++)->index != -1);
+	}
+
+	/* Original decision values at every original SV are the fit targets */
+	decValues = (double *)malloc((size_t)model->l*numPairs*sizeof(double));
+	if(decValues == NULL)
+	{
+		printf("ERROR allocating %d x %d decision values!!\n",model->l,numPairs);
+		svm_free_and_destroy_model(&small);
+		free(start); free(smallStart); free(keep);
+		return NULL;
+	}
+#pragma omp parallel for
+	for(i=0;i<model->l;i++)
+		svm_predict_values(model,model->SV[i],&decValues[(size_t)i*numPairs]);
+
+	/* Refit each pairwise classifier */
+	for(i=0,p=0;i<nrClass;i++)
+	{
+		for(j=i+1;j<nrClass;j++,p++)
+		{
+			if(refitPair(model,decValues,p,i,j,start,small,smallStart,ridge) != 0)
+			{
+				printf("ERROR refitting classifier %d vs %d!\n",model->label[i],model->label[j]);
+				svm_free_and_destroy_model(&small);
+				break;
+			}
+		}
+		if(small == NULL)
+			break;
+	}
+
+	free(decValues);
+	free(start);
+	free(smallStart);
+	free(keep);
+	return small;
+}
+
+
+
+
+/* Accuracy, agreement with the reference labels and mean CPU time (us) */
+static void evaluateModel(const struct svm_model *model, const struct svm_problem *test,
+						  const double *reference, double *predicted, double *accuracy,
+						  double *agreement, double *cpuUs)
+{
+	LARGE_INTEGER tick1, tick2, ticksPerSecond;
+	int correct = 0, agree = 0, i;
+
+	QueryPerformanceFrequency(&ticksPerSecond);
+	QueryPerformanceCounter(&tick1);
+	for(i=0;i<test->l;i++)
+		predicted[i] = svm_predict(model,test->x[i]);
+	QueryPerformanceCounter(&tick2);
+
+	for(i=0;i<test->l;i++)
+	{
+		if(predicted[i] == test->y[i])
+			correct++;
+		if(reference == NULL || predicted[i] == reference[i])
+			agree++;
+	}
+	*accuracy = (test->l > 0) ? 100.0*correct/test->l : 0;
+	*agreement = (test->l > 0) ? 100.0*agree/test->l : 0;
+	*cpuUs = (test->l > 0) ? 1e6*(double)(tick2.QuadPart - tick1.QuadPart)/(double)ticksPerSecond.QuadPart/test->l : 0;
+}
+
+static void reportLine(FILE *out, int budget, const struct svm_model *model, int numFeatures,
+					   double accuracy, double agreement, double cpuUs)
+{
+	long cycles = fpgaPredictCycles(model,numFeatures);
+
+	fprintf(out,"%8d %6d %9.3f%% %9.3f%% %10.3f %10ld %10.3f %5s\n",
+			budget,model->l,accuracy,agreement,cpuUs,cycles,fpgaCyclesToUs(cycles),
+			fpgaModelFits(model) ? "yes" : "no");
+}
+
+
+
+
+int main(int argc, char **argv)
+{
+	char fname[1024];
+	struct svm_model *model, *small;
+	struct svm_problem test;
+	struct svm_node *testSpace;
+	double ridge = DEFAULT_RIDGE;
+	double *reference, *predicted;
+	double accuracy, agreement, cpuUs;
+	int numFeatures = 0, maxIndex = 0;
+	int i, b;
+	FILE *report;
+
+	for(i=1;i<argc && argv[i][0] == '-';i++)
+	{
+		if(++i >= argc)
+			exit_with_help();
+		switch(argv[i-1][1])
+		{
+			case 'f':
+				numFeatures = atoi(argv[i]);
+				break;
+			case 'r':
+				ridge = atof(argv[i]);
+				break;
+			default:
+				printf("Unknown option: -%c\n",argv[i-1][1]);
+				exit_with_help();
+		}
+	}
+	if(argc - i < 3)
+		exit_with_help();
+
+	if(!(model = svm_load_model(argv[i])))
+	{
+		printf("ERROR loading model %s!\n",argv[i]);
+		return -1;
+	}
+	if(model->nSV == NULL || model->label == NULL)
+	{
+		printf("ERROR %s is not a classification model!\n",argv[i]);
+		svm_free_and_destroy_model(&model);
+		return -1;
+	}
+	if(readProblem(argv[i+1],&test,&testSpace,&maxIndex) != 0)
+	{
+		svm_free_and_destroy_model(&model);
+		return -1;
+	}
+	if(numFeatures <= 0)
+	{
+		int sv;
+
+		numFeatures = maxIndex;
+		for(sv=0;sv<model->l;sv++)
+		{
+			const struct svm_node *x = model->SV[sv];
+
+			for(;x->index != -1;x++)
+				if(x->index > numFeatures)
+					numFeatures = x->index;
+		}
+	}
+
+	sprintf(fname,"%s.compress.txt",argv[i]);
+	if(!(report = fopen(fname,"w")))
+	{
+		printf("ERROR opening report %s!\n",fname);
+		freeProblem(&test,testSpace);
+		svm_free_and_destroy_model(&model);
+		return -1;
+	}
+	fprintf(report,"Model %s, %d SVs, %d classes, %d features, test set %s (%d samples)\n",
+			argv[i],model->l,model->nr_class,numFeatures,argv[i+1],test.l);
+	fprintf(report,"  Budget    nSV  Accuracy  Agreement    CPU(us)     Cycles   FPGA(us)  Fits\n");
+	printf("  Budget    nSV  Accuracy  Agreement    CPU(us)     Cycles   FPGA(us)  Fits\n");
+
+	reference = (double *)malloc(test.l*sizeof(double));
+	predicted = (double *)malloc(test.l*sizeof(double));
+	evaluateModel(model,&test,NULL,reference,&accuracy,&agreement,&cpuUs);
+	reportLine(report,model->l,model,numFeatures,accuracy,agreement,cpuUs);
+	reportLine(stdout,model->l,model,numFeatures,accuracy,agreement,cpuUs);
+
+	for(b=i+2;b<argc;b++)
+	{
+		int budget = atoi(argv[b]);
+
+		if(budget <= 0 || budget >= model->l)
+		{
+			printf("Skipping budget %s, the model has %d SVs\n",argv[b],model->l);
+			continue;
+		}
+		if(!(small = compressModel(model,budget,ridge)))
+			continue;
+
+		evaluateModel(small,&test,reference,predicted,&accuracy,&agreement,&cpuUs);
+		reportLine(report,budget,small,numFeatures,accuracy,agreement,cpuUs);
+		reportLine(stdout,budget,small,numFeatures,accuracy,agreement,cpuUs);
+
+		sprintf(fname,"%s.%d.model",argv[i],small->l);
+		if(svm_save_model(fname,small) != 0)
+			printf("ERROR saving %s!\n",fname);
+		sprintf(fname,"%s.%dA.model",argv[i],small->l);
+		saveFPGAModel(fname,small,numFeatures);
+		svm_free_and_destroy_model(&small);
+	}
+
+	fclose(report);
+	free(reference);
+	free(predicted);
+	freeProblem(&test,testSpace);
+	svm_free_and_destroy_model(&model);
+	return 0;
+}
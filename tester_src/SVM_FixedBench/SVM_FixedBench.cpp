@@ -0,0 +1,169 @@
+/////////////////////////////////////////////////////
+// SVM_FixedBench.cpp : CPU prediction time of the //
+//     compile-time specialized predictor against  //
+//     svm_predict, for the model shapes of the    //
+//     data sets in config_Flgs.h.                 //
+/////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "svm.h"
+#include "svm_data.h"
+#include "svm_fixed.h"
+
+#define DEFAULT_PASSES		10
+
+
+void exit_with_help()
+{
+	printf(
+	"Usage: SVM_FixedBench [options] test_file model_file [model_file ...]\n"
+	"options:\n"
+	"-p passes : passes over the test file per timing (default %d)\n"
+	"Each model is matched to the compiled shape with its class count and the\n"
+	"fewest features that hold every SV and test vector index.\n",
+	DEFAULT_PASSES);
+	exit(1);
+}
+
+
+typedef struct
+{
+	double genericUs;		/* per vector */
+	double fixedUs;
+	int mismatches;
+} benchResult;
+
+static double elapsedUs(LARGE_INTEGER tick1, LARGE_INTEGER tick2, int vectors)
+{
+	LARGE_INTEGER ticksPerSecond;
+
+	QueryPerformanceFrequency(&ticksPerSecond);
+	return (double)(tick2.QuadPart-tick1.QuadPart)*1e6/ticksPerSecond.QuadPart/vectors;
+}
+
+/* NULL if the model does not have this shape */
+template <int NF, int NC>
+static int benchShape(const struct svm_model *model, const struct svm_problem *test, int passes,
+					  benchResult *result)
+{
+	svm_fixed_model<NF,NC> *fm = svm_fixed_create<NF,NC>(model);
+	LARGE_INTEGER tick1,tick2;
+	volatile double sink = 0;
+	int pass, s;
+
+	if(fm == NULL)
+		return -1;
+
+	result->mismatches = 0;
+	for(s=0;s<test->l;s++)
+		if(svm_fixed_predict(fm,test->x[s]) != svm_predict(model,test->x[s]))
+			result->mismatches++;
+
+	QueryPerformanceCounter(&tick1);
+	for(pass=0;pass<passes;pass++)
+		for(s=0;s<test->l;s++)
+			sink += svm_predict(model,test->x[s]);
+	QueryPerformanceCounter(&tick2);
+	result->genericUs = elapsedUs(tick1,tick2,passes*test->l);
+
+	QueryPerformanceCounter(&tick1);
+	for(pass=0;pass<passes;pass++)
+		for(s=0;s<test->l;s++)
+			sink += svm_fixed_predict(fm,test->x[s]);
+	QueryPerformanceCounter(&tick2);
+	result->fixedUs = elapsedUs(tick1,tick2,passes*test->l);
+
+	svm_fixed_free(&fm);
+	return 0;
+}
+
+typedef struct
+{
+	const char *name;
+	int numFeatures;
+	int numClasses;
+	int (*bench)(const struct svm_model *, const struct svm_problem *, int, benchResult *);
+} fixedShape;
+
+/* NUM_FEATURES / NUM_CLASS of each data set in config_Flgs.h */
+static const fixedShape shapes[] =
+{
+	{"Shuttle",	  9,  7, benchShape<  9,  7>},
+	{"Vowel",	 10, 11, benchShape< 10, 11>},
+	{"Letter",	 16, 26, benchShape< 16, 26>},
+	{"Hand",	 20,  7, benchShape< 20,  7>},
+	{"Sat",		 36,  6, benchShape< 36,  6>},
+	{"Adult",	123,  3, benchShape<123,  3>},
+	{"DNA",		180,  3, benchShape<180,  3>},
+};
+#define NUM_SHAPES	(int)(sizeof(shapes)/sizeof(shapes[0]))
+
+
+
+
+int main(int argc, char **argv)
+{
+	struct svm_problem test;
+	struct svm_node *testSpace;
+	int passes = DEFAULT_PASSES;
+	int maxTestIndex = 0;
+	int i, m;
+
+	for(i=1;i<argc && argv[i][0] == '-';i++)
+	{
+		if(++i >= argc)
+			exit_with_help();
+		switch(argv[i-1][1])
+		{
+			case 'p':
+				passes = atoi(argv[i]);
+				break;
+			default:
+				printf("Unknown option: -%c\n",argv[i-1][1]);
+				exit_with_help();
+		}
+	}
+	if(argc - i < 2 || passes <= 0)
+		exit_with_help();
+
+	if(readProblem(argv[i],&test,&testSpace,&maxTestIndex) != 0)
+		return -1;
+	printf("Test set %s, %d vectors, %d passes\n",argv[i],test.l,passes);
+	printf("%-40s %-8s Generic(us)  Fixed(us)  Speedup  Mismatches\n","Model","Shape");
+
+	for(m=i+1;m<argc;m++)
+	{
+		struct svm_model *model;
+		benchResult result;
+		int maxIndex = maxTestIndex;
+		int s, sv;
+
+		if(!(model = svm_load_model(argv[m])))
+		{
+			printf("ERROR loading model %s!\n",argv[m]);
+			continue;
+		}
+		for(sv=0;sv<model->l;sv++)
+			for(const struct svm_node *x=model->SV[sv];x->index != -1;x++)
+				if(x->index > maxIndex)
+					maxIndex = x->index;
+
+		/* shapes are in ascending feature count */
+		for(s=0;s<NUM_SHAPES;s++)
+			if(shapes[s].numClasses == model->nr_class && shapes[s].numFeatures >= maxIndex &&
+			   shapes[s].bench(model,&test,passes,&result) == 0)
+				break;
+
+		if(s == NUM_SHAPES)
+			printf("%-40s no compiled shape for %d classes, %d features\n",argv[m],model->nr_class,maxIndex);
+		else
+			printf("%-40s %-8s %11.3f %10.3f %7.2fx %11d\n",argv[m],shapes[s].name,
+				   result.genericUs,result.fixedUs,result.genericUs/result.fixedUs,result.mismatches);
+		svm_free_and_destroy_model(&model);
+	}
+
+	freeProblem(&test,testSpace);
+	return 0;
+}
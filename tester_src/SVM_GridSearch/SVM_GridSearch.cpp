@@ -0,0 +1,403 @@
+/////////////////////////////////////////////////////
+// SVM_GridSearch.cpp : (C, gamma) grid search of  //
+//     C-SVC models.  Scores every candidate on    //
+//     cross-validation accuracy, SV count, CPU    //
+//     and FPGA prediction time, and writes the    //
+//     Pareto-optimal models in libsvm and FPGA    //
+//     "A" format.                                 //
+/////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <windows.h>
+#include "config_Flgs.h"
+#include "svm.h"
+#include "svm_data.h"
+#include "fpga_model.h"
+
+#define MAX_GRID_STEPS		64
+#define FOLD_SEED			12345u
+
+
+void exit_with_help()
+{
+	printf(
+	"Usage: SVM_GridSearch [options] train_file test_file output_name\n"
+	"options:\n"
+	"-t kernel_type : 0 linear, 1 polynomial, 2 RBF, 3 sigmoid (default 2)\n"
+	"-d degree : set degree in kernel function (default 3)\n"
+	"-r coef0 : set coef0 in kernel function (default 0)\n"
+	"-c begin,end,step : log2 of C (default -5,15,2)\n"
+	"-g begin,end,step : log2 of gamma, not used by linear (default 3,-15,-2)\n"
+	"-v folds : cross-validation folds (default 5)\n"
+	"-m cachesize : cache memory size in MB of each training thread (default 100)\n"
+	"-e epsilon : set tolerance of termination criterion (default 0.001)\n"
+	"-h shrinking : whether to use the shrinking heuristics, 0 or 1 (default 1)\n"
+	"-j threads : training threads (default 1)\n"
+	"-f features : feature count of the FPGA build (default: largest index seen)\n"
+	"Each gamma and fold walks up the C axis, warm-starting every model from\n"
+	"the one before.  The candidates are listed in output_name.grid.txt.  The\n"
+	"Pareto-optimal ones in CV accuracy, nSV, CPU time and FPGA cycles are\n"
+	"written to output_name.c<log2C>.g<log2gamma>.model and ...A.model.\n");
+	exit(1);
+}
+
+
+typedef struct
+{
+	double log2c, log2g;
+	volatile LONG cvCorrect;	/* held-out rows predicted correctly, all folds */
+	struct svm_model *model;	/* trained on the whole training set */
+	double cvAccuracy;
+	double testAccuracy;
+	double cpuUs;				/* mean svm_predict time per test vector */
+	long cycles;				/* fpgaPredictCycles */
+	int pareto;
+} candidate;
+
+static void printNull(const char *s) {}
+
+/* begin,end,step into values; returns the count, 0 if malformed */
+static int parseRange(const char *arg, double *values)
+{
+	double begin, end, step, v;
+	int n = 0;
+
+	if(sscanf(arg,"%lf,%lf,%lf",&begin,&end,&step) != 3 || step == 0 || (end-begin)*step < 0)
+		return 0;
+	for(v=begin;(step > 0 ? v <= end+1e-9 : v >= end-1e-9) && n < MAX_GRID_STEPS;v+=step)
+		values[n++] = v;
+	return n;
+}
+
+/* Stratified fold of every row: each class is shuffled with a fixed
+   seed and dealt round robin, so every candidate sees the same folds */
+static void assignFolds(const struct svm_problem *prob, int nrFold, int *foldOf)
+{
+	unsigned int seed = FOLD_SEED;
+	int *order = (int *)malloc(sizeof(int)*prob->l);
+	int *done = (int *)calloc(prob->l,sizeof(int));
+	int i, j, n;
+
+	for(i=0;i<prob->l;i++)
+	{
+		if(done[i])
+			continue;
+
+		/* rows of the label of row i, in file order */
+		n = 0;
+		for(j=i;j<prob->l;j++)
+			if(!done[j] && prob->y[j] == prob->y[i])
+			{
+				order[n++] = j;
+				done[j] = 1;
+			}
+		for(j=n-1;j>0;j--)
+		{
+			int k, t;
+
+			seed = seed*1103515245u + 12345u;
+			k = (int)((seed >> 8) % (unsigned int)(j+1));
+			t = order[j]; order[j] = order[k]; order[k] = t;
+		}
+		for(j=0;j<n;j++)
+			foldOf[order[j]] = j % nrFold;
+	}
+
+	free(order);
+	free(done);
+}
+
+/* Rows outside fold k (train) and inside it (heldOut), pointing into prob */
+static void splitFold(const struct svm_problem *prob, const int *foldOf, int k,
+					  struct svm_problem *train, struct svm_problem *heldOut)
+{
+	int i;
+
+	train->l = heldOut->l = 0;
+	for(i=0;i<prob->l;i++)
+		if(foldOf[i] == k)
+			heldOut->l++;
+	train->l = prob->l - heldOut->l;
+	train->y = (double *)malloc(sizeof(double)*train->l);
+	train->x = (struct svm_node **)malloc(sizeof(struct svm_node *)*train->l);
+	heldOut->y = (double *)malloc(sizeof(double)*heldOut->l);
+	heldOut->x = (struct svm_node **)malloc(sizeof(struct svm_node *)*heldOut->l);
+
+	train->l = heldOut->l = 0;
+	for(i=0;i<prob->l;i++)
+	{
+		struct svm_problem *p = foldOf[i] == k ? heldOut : train;
+
+		p->y[p->l] = prob->y[i];
+		p->x[p->l] = prob->x[i];
+		p->l++;
+	}
+}
+
+/* One gamma on one training set, up the C axis with warm starts.  With
+   heldOut the models are scored and freed, otherwise they are kept. */
+static void runChain(const struct svm_problem *train, const struct svm_problem *heldOut,
+					 const struct svm_parameter *base, candidate *row, int nrC)
+{
+	struct svm_parameter param = *base;
+	struct svm_model *prior = NULL;
+	int c, i;
+
+	if(param.kernel_type != LINEAR)
+		param.gamma = pow(2.0,row[0].log2g);
+	for(c=0;c<nrC;c++)
+	{
+		struct svm_model *model;
+
+		param.C = pow(2.0,row[c].log2c);
+		model = svm_train_warm(train,&param,prior,NULL);
+		if(heldOut != NULL)
+		{
+			LONG correct = 0;
+
+			for(i=0;i<heldOut->l;i++)
+				if(svm_predict(model,heldOut->x[i]) == heldOut->y[i])
+					correct++;
+			InterlockedExchangeAdd(&row[c].cvCorrect,correct);
+			if(prior != NULL)
+				svm_free_and_destroy_model(&prior);
+		}
+		else
+			row[c].model = model;
+		prior = model;
+	}
+	if(heldOut != NULL)
+		svm_free_and_destroy_model(&prior);
+}
+
+/* Test accuracy and mean CPU time (us) of svm_predict */
+static void evaluateModel(const struct svm_model *model, const struct svm_problem *test,
+						  double *accuracy, double *cpuUs)
+{
+	LARGE_INTEGER tick1, tick2, ticksPerSecond;
+	int correct = 0, i;
+
+	QueryPerformanceFrequency(&ticksPerSecond);
+	QueryPerformanceCounter(&tick1);
+	for(i=0;i<test->l;i++)
+		if(svm_predict(model,test->x[i]) == test->y[i])
+			correct++;
+	QueryPerformanceCounter(&tick2);
+
+	*accuracy = (test->l > 0) ? 100.0*correct/test->l : 0;
+	*cpuUs = (test->l > 0) ? 1e6*(double)(tick2.QuadPart - tick1.QuadPart)/(double)ticksPerSecond.QuadPart/test->l : 0;
+}
+
+/* a is at least as good as b on every score and better on one */
+static int dominates(const candidate *a, const candidate *b)
+{
+	if(a->cvAccuracy < b->cvAccuracy || a->model->l > b->model->l ||
+	   a->cpuUs > b->cpuUs || a->cycles > b->cycles)
+		return 0;
+	return a->cvAccuracy > b->cvAccuracy || a->model->l < b->model->l ||
+		   a->cpuUs < b->cpuUs || a->cycles < b->cycles;
+}
+
+static void reportLine(FILE *out, const candidate *cand)
+{
+	fprintf(out,"%7g %7g %9.3f%% %9.3f%% %6d %10.3f %10ld %10.3f %5s %7s\n",
+			cand->log2c,cand->log2g,cand->cvAccuracy,cand->testAccuracy,cand->model->l,
+			cand->cpuUs,cand->cycles,fpgaCyclesToUs(cand->cycles),
+			fpgaModelFits(cand->model) ? "yes" : "no",cand->pareto ? "*" : "");
+}
+
+
+
+
+int main(int argc, char **argv)
+{
+	char fname[1024];
+	struct svm_problem train, test;
+	struct svm_node *trainSpace, *testSpace;
+	struct svm_parameter param;
+	struct svm_problem *foldTrain, *foldHeldOut;
+	double log2c[MAX_GRID_STEPS], log2g[MAX_GRID_STEPS];
+	const char *cRange = "-5,15,2", *gRange = "3,-15,-2";
+	candidate *cand;
+	int *foldOf;
+	int nrC, nrG, nrFold = 5, threads = 1;
+	int numFeatures = 0, maxIndex = 0, maxTestIndex = 0;
+	int i, k, q;
+	FILE *report;
+
+	/* svm-train defaults */
+	param.svm_type = C_SVC;
+	param.kernel_type = RBF;
+	param.degree = 3;
+	param.gamma = 0;
+	param.coef0 = 0;
+	param.nu = 0.5;
+	param.cache_size = 100;
+	param.C = 1;
+	param.eps = 1e-3;
+	param.p = 0.1;
+	param.shrinking = 1;
+	param.probability = 0;
+	param.nr_weight = 0;
+	param.weight_label = NULL;
+	param.weight = NULL;
+
+	for(i=1;i<argc && argv[i][0] == '-';i++)
+	{
+		if(++i >= argc)
+			exit_with_help();
+		switch(argv[i-1][1])
+		{
+			case 't': param.kernel_type = atoi(argv[i]); break;
+			case 'd': param.degree = atoi(argv[i]); break;
+			case 'r': param.coef0 = atof(argv[i]); break;
+			case 'c': cRange = argv[i]; break;
+			case 'g': gRange = argv[i]; break;
+			case 'v': nrFold = atoi(argv[i]); break;
+			case 'm': param.cache_size = atof(argv[i]); break;
+			case 'e': param.eps = atof(argv[i]); break;
+			case 'h': param.shrinking = atoi(argv[i]); break;
+			case 'j': threads = atoi(argv[i]); break;
+			case 'f': numFeatures = atoi(argv[i]); break;
+			default:
+				printf("Unknown option: -%c\n",argv[i-1][1]);
+				exit_with_help();
+		}
+	}
+	if(argc - i != 3)
+		exit_with_help();
+
+	nrC = parseRange(cRange,log2c);
+	nrG = parseRange(gRange,log2g);
+	if(nrC == 0 || nrG == 0)
+	{
+		printf("ERROR: a grid range is not begin,end,step\n");
+		return -1;
+	}
+	if(param.kernel_type == LINEAR)
+	{
+		nrG = 1;
+		log2g[0] = 0;
+	}
+	if(nrFold < 2)
+	{
+		printf("ERROR: -v needs at least 2 folds\n");
+		return -1;
+	}
+
+	if(readProblem(argv[i],&train,&trainSpace,&maxIndex) != 0)
+		return -1;
+	if(readProblem(argv[i+1],&test,&testSpace,&maxTestIndex) != 0)
+	{
+		freeProblem(&train,trainSpace);
+		return -1;
+	}
+	if(numFeatures <= 0)
+		numFeatures = maxIndex > maxTestIndex ? maxIndex : maxTestIndex;
+	if(nrFold > train.l)
+		nrFold = train.l;
+
+	param.gamma = 1;
+	const char *error_msg = svm_check_parameter(&train,&param);
+	if(error_msg)
+	{
+		printf("ERROR: %s\n",error_msg);
+		freeProblem(&train,trainSpace);
+		freeProblem(&test,testSpace);
+		return -1;
+	}
+
+	threads = svm_set_train_threads(threads,0);
+	svm_set_print_string_function(printNull);
+
+	printf("Train set %s, %d vectors; test set %s, %d vectors\n",argv[i],train.l,argv[i+1],test.l);
+	printf("%d x %d grid, %d folds, %d thread(s)\n",nrC,nrG,nrFold,threads);
+
+	/* the same folds for every candidate */
+	foldOf = (int *)malloc(sizeof(int)*train.l);
+	assignFolds(&train,nrFold,foldOf);
+	foldTrain = (struct svm_problem *)malloc(sizeof(struct svm_problem)*nrFold);
+	foldHeldOut = (struct svm_problem *)malloc(sizeof(struct svm_problem)*nrFold);
+	for(k=0;k<nrFold;k++)
+		splitFold(&train,foldOf,k,&foldTrain[k],&foldHeldOut[k]);
+
+	cand = (candidate *)calloc(nrC*nrG,sizeof(candidate));
+	for(q=0;q<nrC*nrG;q++)
+	{
+		cand[q].log2g = log2g[q/nrC];
+		cand[q].log2c = log2c[q%nrC];
+	}
+
+	/* a chain per gamma and fold, plus one per gamma on the whole set;
+	   svm_train stays on one thread inside them */
+#pragma omp parallel for schedule(dynamic,1) num_threads(threads)
+	for(q=0;q<nrG*(nrFold+1);q++)
+	{
+		int g = q/(nrFold+1), f = q%(nrFold+1);
+
+		if(f < nrFold)
+			runChain(&foldTrain[f],&foldHeldOut[f],&param,&cand[g*nrC],nrC);
+		else
+			runChain(&train,NULL,&param,&cand[g*nrC],nrC);
+	}
+
+	/* timed one at a time so the threads do not disturb the CPU numbers */
+	for(q=0;q<nrC*nrG;q++)
+	{
+		cand[q].cvAccuracy = 100.0*cand[q].cvCorrect/train.l;
+		cand[q].cycles = fpgaPredictCycles(cand[q].model,numFeatures);
+		evaluateModel(cand[q].model,&test,&cand[q].testAccuracy,&cand[q].cpuUs);
+	}
+	for(q=0;q<nrC*nrG;q++)
+	{
+		cand[q].pareto = 1;
+		for(i=0;i<nrC*nrG && cand[q].pareto;i++)
+			if(dominates(&cand[i],&cand[q]))
+				cand[q].pareto = 0;
+	}
+
+	sprintf(fname,"%s.grid.txt",argv[argc-1]);
+	if(!(report = fopen(fname,"w")))
+		printf("ERROR opening report %s!\n",fname);
+	else
+		fprintf(report,"Train set %s (%d samples), test set %s (%d samples), %d features, %d folds\n",
+				argv[argc-3],train.l,argv[argc-2],test.l,numFeatures,nrFold);
+	printf("  log2C log2gam    CV acc  Test acc    nSV    CPU(us)     Cycles   FPGA(us)  Fits  Pareto\n");
+	if(report)
+		fprintf(report,"  log2C log2gam    CV acc  Test acc    nSV    CPU(us)     Cycles   FPGA(us)  Fits  Pareto\n");
+	for(q=0;q<nrC*nrG;q++)
+	{
+		if(report)
+			reportLine(report,&cand[q]);
+		if(!cand[q].pareto)
+			continue;
+		reportLine(stdout,&cand[q]);
+
+		sprintf(fname,"%s.c%g.g%g.model",argv[argc-1],cand[q].log2c,cand[q].log2g);
+		if(svm_save_model(fname,cand[q].model) != 0)
+			printf("ERROR saving %s!\n",fname);
+		sprintf(fname,"%s.c%g.g%gA.model",argv[argc-1],cand[q].log2c,cand[q].log2g);
+		saveFPGAModel(fname,cand[q].model,numFeatures);
+	}
+	if(report)
+		fclose(report);
+
+	for(q=0;q<nrC*nrG;q++)
+		svm_free_and_destroy_model(&cand[q].model);
+	free(cand);
+	for(k=0;k<nrFold;k++)
+	{
+		free(foldTrain[k].x);
+		free(foldTrain[k].y);
+		free(foldHeldOut[k].x);
+		free(foldHeldOut[k].y);
+	}
+	free(foldTrain);
+	free(foldHeldOut);
+	free(foldOf);
+	freeProblem(&train,trainSpace);
+	freeProblem(&test,testSpace);
+	return 0;
+}
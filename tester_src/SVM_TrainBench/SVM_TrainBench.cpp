@@ -0,0 +1,346 @@
+/////////////////////////////////////////////////////
+// SVM_TrainBench.cpp : training time, objective   //
+//     and test accuracy of svm_train with a float //
+//     kernel cache against fp16 and bf16 caches,  //
+//     or of a cold retrain against a warm start.  //
+/////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <windows.h>
+#include "svm.h"
+#include "svm_data.h"
+
+
+void exit_with_help()
+{
+	printf(
+	"Usage: SVM_TrainBench [options] train_file test_file\n"
+	"options:\n"
+	"-s svm_type : 0 C-SVC, 1 nu-SVC, 2 one-class, 3 epsilon-SVR, 4 nu-SVR (default 0)\n"
+	"-t kernel_type : 0 linear, 1 polynomial, 2 RBF, 3 sigmoid (default 2)\n"
+	"-d degree : set degree in kernel function (default 3)\n"
+	"-g gamma : set gamma in kernel function (default 1/num_features)\n"
+	"-r coef0 : set coef0 in kernel function (default 0)\n"
+	"-c cost : set C of C-SVC, epsilon-SVR and nu-SVR (default 1)\n"
+	"-n nu : set nu of nu-SVC, one-class and nu-SVR (default 0.5)\n"
+	"-p epsilon : set epsilon of epsilon-SVR (default 0.1)\n"
+	"-m cachesize : set cache memory size in MB (default 100)\n"
+	"-e epsilon : set tolerance of termination criterion (default 0.001)\n"
+	"-h shrinking : whether to use the shrinking heuristics, 0 or 1 (default 1)\n"
+	"-j threads : one-vs-one pairs trained at once (default 1)\n"
+	"-x shared : MB of same-class kernel values shared by the pairs (default 0)\n"
+	"-w percent : C-SVC retrain report, see below (default 0, off)\n"
+	"Trains with each cache precision and reports the time, the cache hits and\n"
+	"misses, the dual objective (C-SVC only), the test accuracy or mean squared\n"
+	"error, and the test predictions that differ from the float cache model.\n"
+	"With -w it instead treats the last percent of the training set as appended\n"
+	"data: it trains on the rest, then on the whole set both from scratch and\n"
+	"warm-started from that model, and reports the solver iterations of each.\n");
+	exit(1);
+}
+
+
+typedef struct
+{
+	double trainSec;
+	double objective;		/* sum over the pairs, C-SVC only */
+	double score;			/* accuracy % or mean squared error */
+	int differ;
+	struct svm_cache_stats stats;
+} benchResult;
+
+static const char *precisionNames[] = {"float", "fp16", "bf16"};
+
+static void printNull(const char *s) {}
+
+/* solver iterations, summed from the "#iter = " lines of svm_train */
+static volatile LONG iterations = 0;
+
+static void printIterations(const char *s)
+{
+	const char *p = strstr(s,"#iter = ");
+	if(p != NULL)
+		InterlockedExchangeAdd(&iterations,atol(p+8));
+}
+
+/* 0.5 a'Qa - e'a of each pair of a C-SVC model, from its SVs and coefficients */
+static double dualObjective(const struct svm_model *model)
+{
+	int nr_class = model->nr_class;
+	int *start = (int *)malloc(sizeof(int)*nr_class);
+	double obj = 0;
+	int i, j, s, t;
+
+	start[0] = 0;
+	for(i=1;i<nr_class;i++)
+		start[i] = start[i-1]+model->nSV[i-1];
+
+	for(i=0;i<nr_class;i++)
+		for(j=i+1;j<nr_class;j++)
+		{
+			int n = model->nSV[i]+model->nSV[j];
+			double quad = 0, lin = 0;
+			for(s=0;s<n;s++)
+			{
+				int ss = s < model->nSV[i] ? start[i]+s : start[j]+s-model->nSV[i];
+				double cs = model->sv_coef[s < model->nSV[i] ? j-1 : i][ss];
+				if(cs == 0)
+					continue;
+				lin += fabs(cs);
+				for(t=0;t<n;t++)
+				{
+					int tt = t < model->nSV[i] ? start[i]+t : start[j]+t-model->nSV[i];
+					double ct = model->sv_coef[t < model->nSV[i] ? j-1 : i][tt];
+					if(ct != 0)
+						quad += cs*ct*svm_k_function(model->SV[ss],model->SV[tt],&model->param);
+				}
+			}
+			obj += 0.5*quad-lin;
+		}
+
+	free(start);
+	return obj;
+}
+
+static struct svm_model *benchPrecision(const struct svm_problem *train, const struct svm_problem *test,
+										const struct svm_parameter *param, int precision,
+										const double *reference, double *predictions, benchResult *result)
+{
+	struct svm_model *model;
+	LARGE_INTEGER tick1,tick2,ticksPerSecond;
+	double sum = 0;
+	int s;
+
+	svm_set_cache_precision(precision);
+	svm_get_cache_stats(&result->stats,1);
+
+	QueryPerformanceCounter(&tick1);
+	model = svm_train(train,param);
+	QueryPerformanceCounter(&tick2);
+	QueryPerformanceFrequency(&ticksPerSecond);
+	result->trainSec = (double)(tick2.QuadPart-tick1.QuadPart)/ticksPerSecond.QuadPart;
+	svm_get_cache_stats(&result->stats,1);
+
+	result->objective = param->svm_type == C_SVC ? dualObjective(model) : 0;
+
+	result->differ = 0;
+	for(s=0;s<test->l;s++)
+	{
+		predictions[s] = svm_predict(model,test->x[s]);
+		if(param->svm_type == EPSILON_SVR || param->svm_type == NU_SVR)
+			sum += (predictions[s]-test->y[s])*(predictions[s]-test->y[s]);
+		else if(predictions[s] == test->y[s])
+			sum += 1;
+		if(reference != NULL && predictions[s] != reference[s])
+			result->differ++;
+	}
+	if(param->svm_type == EPSILON_SVR || param->svm_type == NU_SVR)
+		result->score = sum/test->l;
+	else
+		result->score = 100.0*sum/test->l;
+
+	return model;
+}
+
+/* test accuracy and the predictions that differ from reference (when not NULL) */
+static double testModel(const struct svm_model *model, const struct svm_problem *test,
+						const double *reference, double *predictions, int *differ)
+{
+	int correct = 0;
+	int s;
+
+	*differ = 0;
+	for(s=0;s<test->l;s++)
+	{
+		predictions[s] = svm_predict(model,test->x[s]);
+		if(predictions[s] == test->y[s])
+			correct++;
+		if(reference != NULL && predictions[s] != reference[s])
+			(*differ)++;
+	}
+	return 100.0*correct/test->l;
+}
+
+/* svm_train, or svm_train_warm from prior; counts iterations and time */
+static struct svm_model *trainCounted(const struct svm_problem *prob, const struct svm_parameter *param,
+									  const struct svm_model *prior, double *seconds)
+{
+	struct svm_model *model;
+	LARGE_INTEGER tick1,tick2,ticksPerSecond;
+
+	iterations = 0;
+	QueryPerformanceCounter(&tick1);
+	if(prior == NULL)
+		model = svm_train(prob,param);
+	else
+		model = svm_train_warm(prob,param,prior,NULL);
+	QueryPerformanceCounter(&tick2);
+	QueryPerformanceFrequency(&ticksPerSecond);
+	*seconds = (double)(tick2.QuadPart-tick1.QuadPart)/ticksPerSecond.QuadPart;
+	return model;
+}
+
+/* all but the last percent of train, then all of it cold and warm-started */
+static void benchWarm(const struct svm_problem *train, const struct svm_problem *test,
+					  const struct svm_parameter *param, double percent)
+{
+	struct svm_problem older = *train;
+	struct svm_model *prior, *cold, *warm;
+	double *reference = (double *)malloc(sizeof(double)*test->l);
+	double *predictions = (double *)malloc(sizeof(double)*test->l);
+	double seconds, score;
+	LONG coldIterations;
+	int differ;
+
+	older.l = (int)(train->l*(100-percent)/100);
+	printf("Prior model on the first %d vectors, %d appended\n",older.l,train->l-older.l);
+	printf("%-9s %9s %12s %18s %10s\n","Start","Train(s)","Iterations","Objective","Accuracy");
+	svm_set_print_string_function(printIterations);
+
+	prior = trainCounted(&older,param,NULL,&seconds);
+	score = testModel(prior,test,NULL,predictions,&differ);
+	printf("%-9s %9.3f %12ld %18.6f %10.4f\n","prior",seconds,(long)iterations,dualObjective(prior),score);
+
+	cold = trainCounted(train,param,NULL,&seconds);
+	coldIterations = iterations;
+	score = testModel(cold,test,NULL,reference,&differ);
+	printf("%-9s %9.3f %12ld %18.6f %10.4f\n","cold",seconds,(long)iterations,dualObjective(cold),score);
+
+	warm = trainCounted(train,param,prior,&seconds);
+	score = testModel(warm,test,reference,predictions,&differ);
+	printf("%-9s %9.3f %12ld %18.6f %10.4f\n","warm",seconds,(long)iterations,dualObjective(warm),score);
+	printf("Warm start: %.1f%% fewer iterations, %d test predictions differ from cold\n",
+		   coldIterations > 0 ? 100.0*(coldIterations-iterations)/coldIterations : 0.0,differ);
+
+	svm_set_print_string_function(printNull);
+	svm_free_and_destroy_model(&prior);
+	svm_free_and_destroy_model(&cold);
+	svm_free_and_destroy_model(&warm);
+	free(reference);
+	free(predictions);
+}
+
+int main(int argc, char **argv)
+{
+	struct svm_problem train, test;
+	struct svm_node *trainSpace, *testSpace;
+	struct svm_parameter param;
+	double *reference, *predictions;
+	int maxIndex = 0, maxTestIndex = 0;
+	int threads = 1;
+	double shared = 0;
+	double warmPercent = 0;
+	int i, p;
+
+	/* svm-train defaults */
+	param.svm_type = C_SVC;
+	param.kernel_type = RBF;
+	param.degree = 3;
+	param.gamma = 0;
+	param.coef0 = 0;
+	param.nu = 0.5;
+	param.cache_size = 100;
+	param.C = 1;
+	param.eps = 1e-3;
+	param.p = 0.1;
+	param.shrinking = 1;
+	param.probability = 0;
+	param.nr_weight = 0;
+	param.weight_label = NULL;
+	param.weight = NULL;
+
+	for(i=1;i<argc && argv[i][0] == '-';i++)
+	{
+		if(++i >= argc)
+			exit_with_help();
+		switch(argv[i-1][1])
+		{
+			case 's': param.svm_type = atoi(argv[i]); break;
+			case 't': param.kernel_type = atoi(argv[i]); break;
+			case 'd': param.degree = atoi(argv[i]); break;
+			case 'g': param.gamma = atof(argv[i]); break;
+			case 'r': param.coef0 = atof(argv[i]); break;
+			case 'c': param.C = atof(argv[i]); break;
+			case 'n': param.nu = atof(argv[i]); break;
+			case 'p': param.p = atof(argv[i]); break;
+			case 'm': param.cache_size = atof(argv[i]); break;
+			case 'e': param.eps = atof(argv[i]); break;
+			case 'h': param.shrinking = atoi(argv[i]); break;
+			case 'j': threads = atoi(argv[i]); break;
+			case 'x': shared = atof(argv[i]); break;
+			case 'w': warmPercent = atof(argv[i]); break;
+			default:
+				printf("Unknown option: -%c\n",argv[i-1][1]);
+				exit_with_help();
+		}
+	}
+	if(argc - i != 2)
+		exit_with_help();
+
+	if(readProblem(argv[i],&train,&trainSpace,&maxIndex) != 0)
+		return -1;
+	if(readProblem(argv[i+1],&test,&testSpace,&maxTestIndex) != 0)
+	{
+		freeProblem(&train,trainSpace);
+		return -1;
+	}
+	if(param.gamma == 0 && maxIndex > 0)
+		param.gamma = 1.0/maxIndex;
+	if(warmPercent != 0 && (param.svm_type != C_SVC || warmPercent <= 0 || warmPercent >= 100))
+	{
+		printf("ERROR: -w needs C-SVC and a percent between 0 and 100\n");
+		freeProblem(&train,trainSpace);
+		freeProblem(&test,testSpace);
+		return -1;
+	}
+
+	const char *error_msg = svm_check_parameter(&train,&param);
+	if(error_msg)
+	{
+		printf("ERROR: %s\n",error_msg);
+		freeProblem(&train,trainSpace);
+		freeProblem(&test,testSpace);
+		return -1;
+	}
+
+	threads = svm_set_train_threads(threads,0);
+	svm_set_shared_cache(shared);
+	svm_set_print_string_function(printNull);
+
+	printf("Train set %s, %d vectors; test set %s, %d vectors\n",argv[i],train.l,argv[i+1],test.l);
+	printf("Cache %g MB, %d thread(s), %g MB shared\n",param.cache_size,threads,shared);
+	if(warmPercent > 0)
+	{
+		benchWarm(&train,&test,&param,warmPercent);
+		freeProblem(&train,trainSpace);
+		freeProblem(&test,testSpace);
+		return 0;
+	}
+	printf("%-9s %9s %12s %12s %18s %10s %8s\n","Cache","Train(s)","Hits","Misses","Objective",
+		   param.svm_type == EPSILON_SVR || param.svm_type == NU_SVR ? "MSE" : "Accuracy","Differ");
+
+	reference = (double *)malloc(sizeof(double)*test.l);
+	predictions = (double *)malloc(sizeof(double)*test.l);
+	for(p=SVM_CACHE_FLOAT;p<=SVM_CACHE_BF16;p++)
+	{
+		benchResult result;
+		struct svm_model *model = benchPrecision(&train,&test,&param,p,p == SVM_CACHE_FLOAT ? NULL : reference,
+												 p == SVM_CACHE_FLOAT ? reference : predictions,&result);
+		if(param.svm_type == C_SVC)
+			printf("%-9s %9.3f %12lu %12lu %18.6f %10.4f %8d\n",precisionNames[p],result.trainSec,
+				   result.stats.hits,result.stats.misses,result.objective,result.score,result.differ);
+		else
+			printf("%-9s %9.3f %12lu %12lu %18s %10.4f %8d\n",precisionNames[p],result.trainSec,
+				   result.stats.hits,result.stats.misses,"-",result.score,result.differ);
+		svm_free_and_destroy_model(&model);
+	}
+	svm_set_cache_precision(SVM_CACHE_FLOAT);
+
+	free(reference);
+	free(predictions);
+	freeProblem(&train,trainSpace);
+	freeProblem(&test,testSpace);
+	return 0;
+}